@@ -7,6 +7,8 @@
 #endif
 
 #include "imgui.h"
+#include "../trace.h"
+#include "../counters.h"
 
 #include <map>
 #include <list>
@@ -66,9 +68,22 @@ namespace
 		};
 	}
 
+	// All Size entries (list and hash nodes) are allocated up front and recycled on eviction, so a cache miss does not allocate.
 	template <typename Key, typename Value, std::size_t Size> class LRUCache
 	{
 	public:
+		LRUCache()
+		{
+			Container.reserve(Size + 1);
+			Free.resize(Size);
+			FreeNodes.reserve(Size);
+			for (std::size_t i = 0; i < Size; i++)
+			{
+				Container.emplace(Key(), Order.end());
+				FreeNodes.push_back(Container.extract(Container.begin()));
+			}
+		}
+
 		bool Contains(const Key& key) const
 		{
 			return Container.find(key) != Container.end();
@@ -83,34 +98,46 @@ namespace
 			return location->second->second;
 		}
 
-		void Insert(const Key& key, Value value)
+		void Insert(const Key& key, Value&& value)
 		{
 			const auto existingLocation = Container.find(key);
 			if (existingLocation != Container.end())
 			{
-				Order.erase(existingLocation->second);
-				Container.erase(existingLocation);
+				Release(existingLocation);
+			}
+			else if (FreeNodes.empty())
+			{
+				auto last = Order.end();
+				last--;
+				Release(Container.find(last->first));
 			}
 
-			Order.push_front(std::make_pair(key, std::move(value)));
-			Container.insert(std::make_pair(key, Order.begin()));
+			Order.splice(Order.begin(), Free, Free.begin());
+			Order.front().first = key;
+			Order.front().second = std::move(value);
 
-			Clean();
+			auto node = std::move(FreeNodes.back());
+			FreeNodes.pop_back();
+			node.key() = key;
+			node.mapped() = Order.begin();
+			Container.insert(std::move(node));
 		}
 	private:
-		void Clean()
+		using Entries = std::list<std::pair<Key, Value>>;
+		using Index = std::unordered_map<Key, typename Entries::iterator, TupleHash::Hash<Key>>;
+
+		// Hands the entry's list and hash nodes back to the free lists.
+		void Release(typename Index::iterator location)
 		{
-			while (Container.size() > Size)
-			{
-				auto last = Order.end();
-				last--;
-				Container.erase(last->first);
-				Order.pop_back();
-			}
+			location->second->second = Value();
+			Free.splice(Free.begin(), Order, location->second);
+			FreeNodes.push_back(Container.extract(location));
 		}
 
-		std::list<std::pair<Key, Value>> Order;
-		std::unordered_map<Key, decltype(Order.begin()), TupleHash::Hash<Key>> Container;
+		Entries Order;
+		Entries Free;
+		Index Container;
+		std::vector<typename Index::node_type> FreeNodes;
 	};
 
 	struct Color
@@ -157,6 +184,16 @@ namespace
 			SDL_Texture* Texture = nullptr;
 			int Width = 0, Height = 0;
 
+			TriangleCacheItem() = default;
+			TriangleCacheItem(TriangleCacheItem&& other) : Texture(other.Texture), Width(other.Width), Height(other.Height) { other.Texture = nullptr; }
+			TriangleCacheItem& operator=(TriangleCacheItem&& other)
+			{
+				std::swap(Texture, other.Texture);
+				Width = other.Width;
+				Height = other.Height;
+				return *this;
+			}
+
 			~TriangleCacheItem() { if (Texture) SDL_DestroyTexture(Texture); }
 		};
 
@@ -171,8 +208,8 @@ namespace
 		using GenericTriangleVertexKey = std::tuple<int, int, double, double, uint32_t>;
 		using GenericTriangleKey = std::tuple<GenericTriangleVertexKey, GenericTriangleVertexKey, GenericTriangleVertexKey>;
 
-		LRUCache<UniformColorTriangleKey, std::unique_ptr<TriangleCacheItem>, UniformColorTriangleCacheSize> UniformColorTriangleCache;
-		LRUCache<GenericTriangleKey, std::unique_ptr<TriangleCacheItem>, GenericTriangleCacheSize> GenericTriangleCache;
+		LRUCache<UniformColorTriangleKey, TriangleCacheItem, UniformColorTriangleCacheSize> UniformColorTriangleCache;
+		LRUCache<GenericTriangleKey, TriangleCacheItem, GenericTriangleCacheSize> GenericTriangleCache;
 
 		Device(SDL_Renderer* renderer) : Renderer(renderer) { }
 
@@ -318,7 +355,7 @@ namespace
 		}
 	};
 
-	void DrawTriangleWithColorFunction(const FixedPointTriangleRenderInfo& renderInfo, const std::function<Color(float x, float y)>& colorFunction, Device::TriangleCacheItem* cacheItem)
+	template <typename ColorFunction> void DrawTriangleWithColorFunction(const FixedPointTriangleRenderInfo& renderInfo, const ColorFunction& colorFunction, Device::TriangleCacheItem* cacheItem)
 	{
 		// Implementation source: https://web.archive.org/web/20171128164608/http://forum.devmaster.net/t/advanced-rasterization/6145.
 		// This is a fixed point implementation that rounds to top-left.
@@ -410,18 +447,20 @@ namespace
 
 		if (CurrentDevice->GenericTriangleCache.Contains(key))
 		{
+			counter_add(COUNTER_UI_CACHE_HITS);
 			const auto& cached = CurrentDevice->GenericTriangleCache.At(key);
-			DrawCachedTriangle(*cached, renderInfo);
+			DrawCachedTriangle(cached, renderInfo);
 
 			return;
 		}
+		counter_add(COUNTER_UI_CACHE_MISSES);
 
 		const InterpolatedFactorEquation<float> textureU(v1.uv.x, v2.uv.x, v3.uv.x, v1.pos, v2.pos, v3.pos);
 		const InterpolatedFactorEquation<float> textureV(v1.uv.y, v2.uv.y, v3.uv.y, v1.pos, v2.pos, v3.pos);
 
 		const InterpolatedFactorEquation<Color> shadeColor(Color(v1.col), Color(v2.col), Color(v3.col), v1.pos, v2.pos, v3.pos);
 
-		auto cached = std::make_unique<Device::TriangleCacheItem>();
+		Device::TriangleCacheItem cached;
 		DrawTriangleWithColorFunction(renderInfo, [&](float x, float y) {
 			const float u = textureU.Evaluate(x, y);
 			const float v = textureV.Evaluate(x, y);
@@ -429,12 +468,12 @@ namespace
 			const Color shade = shadeColor.Evaluate(x, y);
 
 			return sampled * shade;
-		}, cached.get());
+		}, &cached);
 
-		if (!cached->Texture) return;
+		if (!cached.Texture) return;
 
-		const SDL_Rect destination = { renderInfo.MinX, renderInfo.MinY, cached->Width, cached->Height };
-		SDL_RenderCopy(CurrentDevice->Renderer, cached->Texture, nullptr, &destination);
+		const SDL_Rect destination = { renderInfo.MinX, renderInfo.MinY, cached.Width, cached.Height };
+		SDL_RenderCopy(CurrentDevice->Renderer, cached.Texture, nullptr, &destination);
 
 		CurrentDevice->GenericTriangleCache.Insert(key, std::move(cached));
 	}
@@ -452,19 +491,21 @@ namespace
 			static_cast<int>(std::round(v3.pos.x)) - renderInfo.MinX, static_cast<int>(std::round(v3.pos.y)) - renderInfo.MinY);
 		if (CurrentDevice->UniformColorTriangleCache.Contains(key))
 		{
+			counter_add(COUNTER_UI_CACHE_HITS);
 			const auto& cached = CurrentDevice->UniformColorTriangleCache.At(key);
-			DrawCachedTriangle(*cached, renderInfo);
+			DrawCachedTriangle(cached, renderInfo);
 
 			return;
 		}
+		counter_add(COUNTER_UI_CACHE_MISSES);
 
-		auto cached = std::make_unique<Device::TriangleCacheItem>();
-		DrawTriangleWithColorFunction(renderInfo, [&color](float, float) { return color; }, cached.get());
+		Device::TriangleCacheItem cached;
+		DrawTriangleWithColorFunction(renderInfo, [&color](float, float) { return color; }, &cached);
 
-		if (!cached->Texture) return;
+		if (!cached.Texture) return;
 
-		const SDL_Rect destination = { renderInfo.MinX, renderInfo.MinY, cached->Width, cached->Height };
-		SDL_RenderCopy(CurrentDevice->Renderer, cached->Texture, nullptr, &destination);
+		const SDL_Rect destination = { renderInfo.MinX, renderInfo.MinY, cached.Width, cached.Height };
+		SDL_RenderCopy(CurrentDevice->Renderer, cached.Texture, nullptr, &destination);
 
 		CurrentDevice->UniformColorTriangleCache.Insert(key, std::move(cached));
 	}
@@ -556,6 +597,7 @@ namespace ImGuiSDL
 
 	void Render(ImDrawData* drawData)
 	{
+		TRACE_ZONE("ImGuiSDL::Render");
 		SDL_BlendMode blendMode;
 		SDL_GetRenderDrawBlendMode(CurrentDevice->Renderer, &blendMode);
 		SDL_SetRenderDrawBlendMode(CurrentDevice->Renderer, SDL_BLENDMODE_BLEND);
@@ -565,7 +607,7 @@ namespace ImGuiSDL
 		for (int n = 0; n < drawData->CmdListsCount; n++)
 		{
 			auto commandList = drawData->CmdLists[n];
-			auto vertexBuffer = commandList->VtxBuffer;
+			const auto& vertexBuffer = commandList->VtxBuffer;
 			auto indexBuffer = commandList->IdxBuffer.Data;
 
 			for (int cmd_i = 0; cmd_i < commandList->CmdBuffer.Size; cmd_i++)
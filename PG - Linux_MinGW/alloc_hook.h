@@ -0,0 +1,234 @@
+#ifndef ALLOCHOOKH
+#define ALLOCHOOKH
+
+/*  Opt-in heap allocation tracking. Build with -DALLOC_HOOK, and in the one
+    translation unit that holds main()
+
+        #define ALLOC_HOOK_IMPLEMENTATION
+        #include "alloc_hook.h"
+
+    to replace the global operator new/delete, aligned and nothrow forms
+    included, with versions that count every allocation and its size:
+
+      - alloc_totals() sums all threads; frame_counters turns it into
+        allocations and bytes per frame;
+      - alloc_thread_totals() is the calling thread's, which trace zones use
+        to record what was allocated inside each zone;
+      - alloc_forbid(true) makes the next allocation print its size and
+        abort, to keep the steady-state frame loop allocation free; an
+        alloc_permit scope exempts its own thread (e.g. a trace export).
+
+    Memory taken with malloc() directly (SDL, stdio) is not seen; pass
+    alloc_tracked/alloc_release to ImGui::SetAllocatorFunctions to count
+    ImGui's. Without ALLOC_HOOK every query reads zero and nothing is
+    replaced. */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <atomic>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+#include <new>
+
+struct alloc_counts
+{
+    uint64_t count;
+    uint64_t bytes;
+};
+
+#ifdef ALLOC_HOOK
+
+const bool ALLOC_HOOK_ENABLED = true;
+
+struct alloc_state
+{
+    std::atomic<uint64_t> count{0}, bytes{0};
+    std::atomic<bool> forbidden{false};
+
+    static alloc_state &get()
+    {
+        static alloc_state state;   // constant initialized, usable before main
+        return state;
+    }
+};
+
+struct alloc_thread_state
+{
+    alloc_counts totals;
+    int permits;
+
+    static alloc_thread_state &local()
+    {
+        static thread_local alloc_thread_state state = { { 0, 0 }, 0 };
+        return state;
+    }
+};
+
+// Counts one allocation of size bytes on the calling thread; aborts if allocations are forbidden.
+inline void alloc_note(size_t size)
+{
+    alloc_thread_state &t = alloc_thread_state::local();
+    t.totals.count++;
+    t.totals.bytes += size;
+
+    alloc_state &g = alloc_state::get();
+    g.count.fetch_add(1, std::memory_order_relaxed);
+    g.bytes.fetch_add(size, std::memory_order_relaxed);
+    if (g.forbidden.load(std::memory_order_relaxed) && t.permits == 0)
+    {
+        fprintf(stderr, "alloc_hook: %zu byte allocation while allocations are forbidden\n", size);
+        abort();
+    }
+}
+
+inline void *alloc_tracked(size_t size, void * = nullptr)
+{
+    alloc_note(size);
+    return malloc(size ? size : 1);
+}
+
+inline void alloc_release(void *p, void * = nullptr) { free(p); }
+
+// The same for over-aligned types (operator new with std::align_val_t).
+inline void *alloc_tracked_aligned(size_t size, size_t alignment)
+{
+    alloc_note(size);
+#ifdef _WIN32
+    return _aligned_malloc(size ? size : 1, alignment);
+#else
+    void *p = nullptr;
+    if (alignment < sizeof(void *))
+        alignment = sizeof(void *);
+    return posix_memalign(&p, alignment, size ? size : 1) == 0 ? p : nullptr;
+#endif
+}
+
+inline void alloc_release_aligned(void *p)
+{
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+inline alloc_counts alloc_totals()
+{
+    alloc_state &g = alloc_state::get();
+    return alloc_counts{ g.count.load(std::memory_order_relaxed), g.bytes.load(std::memory_order_relaxed) };
+}
+
+inline alloc_counts alloc_thread_totals() { return alloc_thread_state::local().totals; }
+
+inline void alloc_forbid(bool on) { alloc_state::get().forbidden.store(on, std::memory_order_relaxed); }
+inline bool alloc_forbidden() { return alloc_state::get().forbidden.load(std::memory_order_relaxed); }
+
+// Lets the calling thread allocate while alloc_forbid() is on.
+class alloc_permit
+{
+public:
+    alloc_permit() { alloc_thread_state::local().permits++; }
+    ~alloc_permit() { alloc_thread_state::local().permits--; }
+
+    alloc_permit(const alloc_permit &) = delete;
+    alloc_permit &operator=(const alloc_permit &) = delete;
+};
+
+#else
+
+const bool ALLOC_HOOK_ENABLED = false;
+
+inline alloc_counts alloc_totals() { return alloc_counts{ 0, 0 }; }
+inline alloc_counts alloc_thread_totals() { return alloc_counts{ 0, 0 }; }
+inline void alloc_forbid(bool) {}
+inline bool alloc_forbidden() { return false; }
+
+// User-provided, like the real one, so a scoped permit is not an unused variable.
+class alloc_permit
+{
+public:
+    alloc_permit() {}
+    ~alloc_permit() {}
+
+    alloc_permit(const alloc_permit &) = delete;
+    alloc_permit &operator=(const alloc_permit &) = delete;
+};
+
+#endif
+
+#endif
+
+// Outside the include guard so the implementation can be requested after another header pulled this one in.
+#if defined(ALLOC_HOOK) && defined(ALLOC_HOOK_IMPLEMENTATION) && !defined(ALLOC_HOOK_OPERATORS)
+#define ALLOC_HOOK_OPERATORS
+
+/*  Kept out of line: inlined into a caller, GCC sees new paired with free()
+    and warns (-Wmismatched-new-delete) wherever it can follow a pointer from
+    one to the other. */
+#if defined(__GNUC__)
+#define ALLOC_HOOK_NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+#define ALLOC_HOOK_NOINLINE __declspec(noinline)
+#else
+#define ALLOC_HOOK_NOINLINE
+#endif
+
+ALLOC_HOOK_NOINLINE void *operator new(size_t size)
+{
+    if (void *p = alloc_tracked(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+ALLOC_HOOK_NOINLINE void *operator new[](size_t size)
+{
+    if (void *p = alloc_tracked(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+ALLOC_HOOK_NOINLINE void *operator new(size_t size, const std::nothrow_t &) noexcept { return alloc_tracked(size); }
+ALLOC_HOOK_NOINLINE void *operator new[](size_t size, const std::nothrow_t &) noexcept { return alloc_tracked(size); }
+
+ALLOC_HOOK_NOINLINE void operator delete(void *p) noexcept { free(p); }
+ALLOC_HOOK_NOINLINE void operator delete[](void *p) noexcept { free(p); }
+ALLOC_HOOK_NOINLINE void operator delete(void *p, size_t) noexcept { free(p); }
+ALLOC_HOOK_NOINLINE void operator delete[](void *p, size_t) noexcept { free(p); }
+ALLOC_HOOK_NOINLINE void operator delete(void *p, const std::nothrow_t &) noexcept { free(p); }
+ALLOC_HOOK_NOINLINE void operator delete[](void *p, const std::nothrow_t &) noexcept { free(p); }
+
+ALLOC_HOOK_NOINLINE void *operator new(size_t size, std::align_val_t alignment)
+{
+    if (void *p = alloc_tracked_aligned(size, (size_t)alignment))
+        return p;
+    throw std::bad_alloc();
+}
+
+ALLOC_HOOK_NOINLINE void *operator new[](size_t size, std::align_val_t alignment)
+{
+    if (void *p = alloc_tracked_aligned(size, (size_t)alignment))
+        return p;
+    throw std::bad_alloc();
+}
+
+ALLOC_HOOK_NOINLINE void *operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    return alloc_tracked_aligned(size, (size_t)alignment);
+}
+
+ALLOC_HOOK_NOINLINE void *operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    return alloc_tracked_aligned(size, (size_t)alignment);
+}
+
+ALLOC_HOOK_NOINLINE void operator delete(void *p, std::align_val_t) noexcept { alloc_release_aligned(p); }
+ALLOC_HOOK_NOINLINE void operator delete[](void *p, std::align_val_t) noexcept { alloc_release_aligned(p); }
+ALLOC_HOOK_NOINLINE void operator delete(void *p, size_t, std::align_val_t) noexcept { alloc_release_aligned(p); }
+ALLOC_HOOK_NOINLINE void operator delete[](void *p, size_t, std::align_val_t) noexcept { alloc_release_aligned(p); }
+ALLOC_HOOK_NOINLINE void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept { alloc_release_aligned(p); }
+ALLOC_HOOK_NOINLINE void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept { alloc_release_aligned(p); }
+
+#endif
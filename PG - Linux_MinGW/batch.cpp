@@ -0,0 +1,200 @@
+
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include "camera.h"
+#include "camera_path.h"
+#include "thread_pool.h"
+#include "image_writer.h"
+#include "weld.h"
+#include "mesh_optimize.h"
+#include "lod.h"
+#include "meshlet.h"
+
+// Renders a mesh from many viewpoints (turntables, thumbnails, regression
+// views) without a window. Every frame is independent: the workers share the
+// loaded mesh read-only and each renders whole frames into its own
+// framebuffer, so throughput grows with the number of cores.
+
+static void usage()
+{
+	fprintf(stderr,
+		"usage: batch MESH.obj [path] [options]\n"
+		"path (default --orbit 36):\n"
+		"  --orbit N           N views around the mesh\n"
+		"  --views FILE        one 'fx fy fz ax ay az [ux uy uz]' per line\n"
+		"  --keyframes FILE    'frame fx fy fz ax ay az [ux uy uz]' per line, interpolated\n"
+		"options:\n"
+		"  --elevation DEG     orbit height angle (20)\n"
+		"  --radius R          orbit radius (fits the mesh bounds)\n"
+		"  --size WxH          image size (600x400)\n"
+		"  --fov DEG           vertical field of view (60)\n"
+		"  --shade flat|lambert|textured\n"
+		"  --output PREFIX     writes PREFIX_0000.ppm, ... (view)\n"
+		"  --format FORMAT     ppm, pam, qoi or png (ppm)\n"
+		"  --no-write          render only\n"
+		"  --threads N         worker threads including this one (one per core)\n"
+		"  --weld EPS          merge corners within EPS into shared vertices first (off)\n"
+		"  --optimize          reorder for vertex reuse, welding exact copies unless --weld\n"
+		"  --quantize          keep only 16-bit vertices, welding the same way\n"
+		"  --lod PIXELS        build levels of detail, drawn while their error is under PIXELS\n"
+		"  --meshlets          split into clusters culled by sphere and normal cone\n");
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2 || argv[1][0] == '-') {
+		usage();
+		return 1;
+	}
+
+	const char* meshPath = argv[1];
+	const char* viewsPath = nullptr;
+	bool keyed = false;
+	int orbitFrames = 36, width = WIDTH, height = HEIGHT;
+	unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+	float elevation = 20.0f, radius = 0.0f, fov = 60.0f;
+	float weldEpsilon = -1.0f;	// negative: no welding
+	bool optimize = false, quantize = false, meshlets = false;
+	float lodPixels = 0.0f;
+	const char* output = "view";
+	image_format format = IMAGE_PPM;
+	pipeline_state state;
+	state.shade = SHADE_TEXTURED;
+
+	for (int i = 2; i < argc; i++) {
+		const bool value = i + 1 < argc;
+		if (strcmp(argv[i], "--orbit") == 0 && value)
+			orbitFrames = atoi(argv[++i]);
+		else if ((strcmp(argv[i], "--views") == 0 || strcmp(argv[i], "--keyframes") == 0) && value) {
+			keyed = argv[i][2] == 'k';
+			viewsPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--elevation") == 0 && value)
+			elevation = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--radius") == 0 && value)
+			radius = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--size") == 0 && value)
+			sscanf(argv[++i], "%dx%d", &width, &height);
+		else if (strcmp(argv[i], "--fov") == 0 && value)
+			fov = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--shade") == 0 && value) {
+			i++;
+			state.shade = strcmp(argv[i], "flat") == 0 ? SHADE_FLAT : strcmp(argv[i], "lambert") == 0 ? SHADE_LAMBERT : SHADE_TEXTURED;
+		}
+		else if (strcmp(argv[i], "--output") == 0 && value)
+			output = argv[++i];
+		else if (strcmp(argv[i], "--no-write") == 0)
+			output = nullptr;
+		else if (strcmp(argv[i], "--format") == 0 && value && image_format_from_name(argv[i + 1], format))
+			i++;
+		else if (strcmp(argv[i], "--weld") == 0 && value)
+			weldEpsilon = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--optimize") == 0)
+			optimize = true;
+		else if (strcmp(argv[i], "--quantize") == 0)
+			quantize = true;
+		else if (strcmp(argv[i], "--meshlets") == 0)
+			meshlets = true;
+		else if (strcmp(argv[i], "--lod") == 0 && value)
+			lodPixels = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--threads") == 0 && value)
+			threads = std::max(1, atoi(argv[++i]));
+		else {
+			usage();
+			return 1;
+		}
+	}
+	if (width <= 0 || height <= 0 || orbitFrames <= 0) {
+		usage();
+		return 1;
+	}
+
+	Mesh mesh;
+	if (!mesh.load_mesh_from_file(meshPath) || mesh.tris.empty()) {
+		fprintf(stderr, "no triangles in %s\n", meshPath);
+		return 1;
+	}
+	if (lodPixels > 0)
+		optimize = true;
+	if (weldEpsilon >= 0 || optimize || quantize || meshlets) {
+		weld_options weldOptions;
+		weldOptions.epsilon = weldOptions.uv_epsilon = std::max(weldEpsilon, 0.0f);
+		std::unique_ptr<thread_pool> pool(threads > 1 ? new thread_pool(threads - 1) : nullptr);
+		const weld_stats stats = weld(mesh, weldOptions, pool.get());
+		fprintf(stderr, "welded %zu corners into %zu vertices\n", stats.corners, stats.vertices);
+	}
+	if (optimize) {
+		const mesh_optimize_stats stats = optimize_mesh(mesh);
+		fprintf(stderr, "vertex reuse: acmr %.3f -> %.3f (cache of %d)\n", stats.acmr_before, stats.acmr_after, stats.cache_size);
+	}
+	if (lodPixels > 0) {
+		build_lods(mesh);
+		for (size_t k = 0; k < mesh.lods.size(); k++)
+			fprintf(stderr, "lod %zu: %zu triangles, error %g\n", k + 1, mesh.lods[k].indices.size() / 3, mesh.lods[k].error);
+	}
+	if (meshlets) {
+		build_meshlets(mesh);
+		fprintf(stderr, "meshlets: %zu for %zu triangles\n", mesh.meshlets.size(), mesh.triangle_count());
+	}
+	if (quantize) {
+		const size_t before = mesh.memory_bytes();
+		mesh.quantize();
+		fprintf(stderr, "quantized: %zu -> %zu bytes\n", before, mesh.memory_bytes());
+	}
+
+	std::vector<Obj> objects;
+	objects.push_back( Obj(std::make_shared<const Mesh>(std::move(mesh)), matrix44(), texture::checkerboard(256, 16, 0xffe0e0e0, 0xff3070c0)) );
+
+	std::vector<camera_view> views;
+	if (viewsPath) {
+		std::string error;
+		if (!load_camera_path(viewsPath, keyed, views, error)) {
+			fprintf(stderr, "%s\n", error.c_str());
+			return 1;
+		}
+	}
+	else {
+		vec3 center;
+		float fit;
+		orbit_framing(objects[0].mesh->bounds, std::min(fov, fov * width / height), center, fit);
+		views = orbit_path(orbitFrames, center, radius > 0 ? radius : fit, elevation);
+	}
+
+	// encoding and disk writes run behind the renderers; a full queue makes them wait
+	image_writer writer(2 * threads);
+	auto render = [&](size_t i) {
+		static thread_local framebuffer fb;
+		if (fb.width != width || fb.height != height)
+			fb.resize(width, height);
+		fb.clear();
+
+		camera cam(views[i].from, views[i].at, views[i].up, fov, 0.1f, 1000.0f, width, height);
+		cam.state = state;
+		cam.lod_pixels = lodPixels;
+		cam.render_scene(objects, fb);
+
+		if (output) {
+			char path[512];
+			snprintf(path, sizeof(path), "%s_%04d.%s", output, (int)i, IMAGE_EXTENSIONS[format]);
+			writer.write(fb, path, format);
+		}
+	};
+
+	const auto start = std::chrono::steady_clock::now();
+	if (threads > 1) {
+		thread_pool pool(threads - 1); // parallel_for runs on the calling thread too
+		pool.parallel_for(views.size(), render);
+	}
+	else {
+		for (size_t i = 0; i < views.size(); i++)
+			render(i);
+	}
+	writer.flush();
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("%d views %dx%d on %u threads: %.3f s, %.1f frames/s\n", (int)views.size(), width, height, threads,
+		seconds, seconds > 0 ? views.size() / seconds : 0.0);
+	return writer.failed() ? 1 : 0;
+}
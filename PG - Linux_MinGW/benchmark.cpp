@@ -0,0 +1,104 @@
+
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include "frame_pipeline.h"
+
+// Renders the same view with every pipeline state through the specialized
+// dispatch table and through the generic run-time flag path, then the default
+// state rendered immediately against frame_pipeline.
+
+// Best of a few repetitions, which filters out scheduler noise on shared hosts.
+static double time_frames(camera &cam, const std::vector<Obj> &objects, framebuffer &fb, int frames)
+{
+	cam.render_scene(objects, fb); // warm up caches and the dispatch table
+
+	double best = 1e30;
+	for (int rep = 0; rep < 5; rep++) {
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < frames; i++) {
+			fb.clear();
+			cam.render_scene(objects, fb);
+		}
+		auto end = std::chrono::steady_clock::now();
+		best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count() / frames);
+	}
+	return best;
+}
+
+// Same frames through frame_pipeline: transform and raster of consecutive frames overlap.
+static double time_pipelined(const camera &cam, const std::vector<Obj> &objects, int frames)
+{
+	frame_pipeline pipeline;
+
+	double best = 1e30;
+	for (int rep = 0; rep < 5; rep++) {
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < frames; i++) {
+			pipeline.submit(cam, objects);
+			if (pipeline.acquire())
+				pipeline.release();
+		}
+		pipeline.flush();
+		auto end = std::chrono::steady_clock::now();
+		best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count() / frames);
+	}
+	return best;
+}
+
+int main(int argc, char* argv[])
+{
+	const int frames = argc > 1 ? atoi(argv[1]) : 40;
+	const char* cullNames[] = { "none", "back", "front" };
+	const char* shadeNames[] = { "flat", "lambert", "textured" };
+
+	std::vector<Obj> objects;
+	objects.push_back( Obj("./objects/monkey_smooth.obj", texture::checkerboard(256, 16, 0xffe0e0e0, 0xff3070c0)) );
+
+	// close enough for the mesh to cover most of the framebuffer
+	camera cam(vec3(0.5f, 0.5f, 2.0f), vec3(0, 0, 0), vec3(0, 1, 0), 60.0f, 1.f, 50.0f, WIDTH, HEIGHT);
+	framebuffer fb(WIDTH, HEIGHT);
+
+	printf("%-6s %-9s %-5s %-5s %-5s %12s %12s %8s\n", "cull", "shade", "depth", "blend", "wire", "generic ms", "special ms", "speedup");
+
+	double totalGeneric = 0, totalSpecial = 0;
+	for (int cull = CULL_NONE; cull <= CULL_FRONT; cull++) {
+		for (int shade = SHADE_FLAT; shade <= SHADE_TEXTURED; shade++) {
+			for (int flags = 0; flags < 8; flags++) {
+				pipeline_state s;
+				s.cull = cull;
+				s.shade = shade;
+				s.depth_test = flags & 1;
+				s.blend = flags & 2;
+				s.wireframe = flags & 4;
+				s.color = s.blend ? 0x80ffffff : 0xffffffff;
+
+				// wireframe ignores depth and blending, skip the duplicates
+				if (s.wireframe && (s.depth_test || s.blend))
+					continue;
+
+				cam.state = s;
+				cam.specialize = false;
+				const double generic = time_frames(cam, objects, fb, frames);
+				cam.specialize = true;
+				const double special = time_frames(cam, objects, fb, frames);
+
+				totalGeneric += generic;
+				totalSpecial += special;
+				printf("%-6s %-9s %-5d %-5d %-5d %12.3f %12.3f %7.2fx\n", cullNames[cull], shadeNames[shade],
+					s.depth_test, s.blend, s.wireframe, generic, special, generic / special);
+			}
+		}
+	}
+
+	printf("total %50.3f %12.3f %7.2fx\n", totalGeneric, totalSpecial, totalGeneric / totalSpecial);
+
+	// default UI state, immediate against pipelined
+	cam.state = pipeline_state();
+	cam.specialize = true;
+	const double immediate = time_frames(cam, objects, fb, frames);
+	const double pipelined = time_pipelined(cam, objects, frames);
+	printf("\n%u hardware threads\n", std::thread::hardware_concurrency());
+	printf("immediate %8.3f ms/frame\npipelined %8.3f ms/frame %7.2fx\n", immediate, pipelined, immediate / pipelined);
+	return 0;
+}
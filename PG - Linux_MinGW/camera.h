@@ -1,16 +1,15 @@
 #ifndef CAMERAH
 #define CAMERAH
 
+#include <utility>
 #include "vec3.h"
 #include "vec2.h"
 #include "matrix44.h"
 #include "object.h"
-
-#ifdef _WIN32 || WIN32
-#include <SDL.h>
-#elif defined(__unix__)
-#include <SDL2/SDL.h>
-#endif
+#include "framebuffer.h"
+#include "raster.h"
+#include "trace.h"
+#include "counters.h"
 
 const int WIDTH = 600;
 const int HEIGHT = 400;
@@ -20,6 +19,27 @@ const int RIGHT = 2;    // 0010
 const int BOTTOM = 4;   // 0100
 const int TOP = 8;      // 1000
 
+// Level of detail each object was drawn at last frame, indexed like the scene.
+struct lod_history
+{
+    std::vector<uint8_t> level;
+};
+
+const float LOD_HYSTERESIS = 0.5f;
+
+/*  Uma instância vista pela câmera neste frame (camera::view_of): a matriz
+    do objeto à câmera e o que normais, raios e cones precisam do model. */
+struct object_view
+{
+    matrix44 toCamera;          // model * worldToCamera
+    matrix44 normalToWorld;     // inversa transposta do model
+    vec3 eye;                   // olho no espaço do objeto
+    float scale = 1;            // maior escala do model, para raios e erros
+    bool moved = false;         // model diferente da identidade
+    bool conformal = true;      // escala uniforme sem cisalhamento: os ângulos, e os cones, se mantêm
+    bool mirrored = false;      // determinante negativo: a ordem dos vértices na tela se inverte, e a face da frente junto
+};
+
 class camera
 {
 public:
@@ -32,8 +52,15 @@ public:
     vec3 _from, _at, _up;
     vec3 axisX, axisY, axisZ;
 
+    pipeline_state state;
+    bool specialize = true;     // false runs the generic run-time flag path
+
+    float lod_pixels = 0;               // screen error allowed for coarser levels of detail; 0 keeps full detail
+    lod_history *lod_memory = nullptr;  // levels picked last frame, for hysteresis; owned by the caller
+
 public:
-    camera();
+    // mesma vista inicial do main.cpp
+    camera() : camera(vec3(0, 0, 5), vec3(0, 0, -1), vec3(0, 1, 0), 90.0f, 1.0f, 50.0f, WIDTH, HEIGHT) {}
     camera(const vec3 &from, const vec3 &at, const vec3 &up,
            const float &f, const float &n, const float &far,
            const int &iwidth, const int &iheight) : fov(f), _near(n), imgWidth(iwidth), imgHeight(iheight),
@@ -66,159 +93,590 @@ public:
         );
 
         worldToCamera = camToWorld.inverse();
+        update_frustum();
     }
 
-    bool compute_pixel_coordinates(const vec3 &pWorld, vec2 &pRaster)
+    // janela no plano near a partir do fov vertical
+    void update_frustum()
     {
-        vec3 screen, projPerspectiva, pJanela;
-        
-        if(pWorld.z() >= _from.z() ){   // pois o Z é negativo
-            return false;
-        }
-
-        worldToCamera.mult_point_matrix(pWorld,screen);
-
-        projPerspectiva = vec3(
-                                screen.x()*(_near/screen.z()),
-                                screen.y()*(_near/screen.z()),
-                                _near);
-
-        matrix44 applicationWindowMatrix = matrix44(
-            (2*_near)/(right-left), 0,0,0,
-            0,(2*_near)/(bottom-top),0,0,
-            -(right+left)/(right-left), -(bottom+top)/(bottom-top),(_far+_near)/(_far-_near),1,
-            0,0,-(2*_near)/(_far-_near),0
-        );
-        
-        applicationWindowMatrix.mult_point_matrix(projPerspectiva,pJanela); // normalizando o ponto para mapear para janela da aplicação
-
         float aspect_ratio = (float)imgWidth/(float)imgHeight;
-        top = tan((fov/2)*(M_PI/180.0));
+        top = tan((fov/2)*(M_PI/180.0))*_near;
         right = top*aspect_ratio;
         left = -right;
         bottom = -top;
+    }
 
-        pRaster = vec2(
-                        (1+pJanela.x())/2*imgWidth,
-                        (1-pJanela.y())/2*imgHeight
-        );
-        
-        if(pJanela.x() >= left && pJanela.x() <= right && pJanela.y() >= bottom && pJanela.y() <= top){
-            return true;    // o ponto pode ser visto
+    /*  Ponto no espaço da câmera (Z negativo à frente) para coordenadas raster.
+        Guarda também 1/w para o teste de profundidade e a interpolação correta
+        em perspectiva. */
+    inline void project(const vec3 &pCamera, raster_vertex &out) const
+    {
+        const float inv_w = -1.0f / pCamera.z();
+        out.x = (1 + pCamera.x()*_near*inv_w/right)/2*imgWidth;
+        out.y = (1 - pCamera.y()*_near*inv_w/top)/2*imgHeight;
+        out.inv_w = inv_w;
+    }
+
+    int GetOutCode (const vec2 &p0) const {
+        int outcode = 0;
+
+        if(p0.e[1] > imgHeight) {
+            outcode |= TOP;
+        } else if(p0.e[1] < 0) {
+            outcode |= BOTTOM;
         }
-        return false; // o ponto não pode ser visto
+        if(p0.e[0] > imgWidth) {
+            outcode |= RIGHT;
+        } else if(p0.e[0] < 0) {
+            outcode |= LEFT;
+        }
+
+        return outcode;
     }
 
-    void DrawLine(SDL_Renderer* renderer, vec2 &p0, vec2 &p1) {
-        vec2 director = p1 - p0;
-        vec2 start = p0;
-        int iterations =(int)director.length();
-        director.make_unit_vector();
+    struct clip_vertex
+    {
+        vec3 pos;   // espaço da câmera
+        vec2 uv;
+    };
 
-        if(ClipLine(p0,p1)){
-            for(int i = 0 ; i < iterations; i++) {
-                SDL_RenderDrawPoint(renderer, start.e[0], start.e[1]);
-                start += director; 
+    // Recorta o triângulo contra o plano near (z = -near); gera até 4 vértices.
+    int clip_near(const clip_vertex in[3], clip_vertex out[4]) const
+    {
+        int count = 0;
+        for (int i = 0; i < 3; i++)
+        {
+            const clip_vertex &a = in[i];
+            const clip_vertex &b = in[(i + 1) % 3];
+            const float da = -_near - a.pos.z();    // >= 0 dentro
+            const float db = -_near - b.pos.z();
+
+            if (da >= 0)
+                out[count++] = a;
+            if ((da >= 0) != (db >= 0))
+            {
+                const float t = da / (da - db);
+                out[count].pos = a.pos + t * (b.pos - a.pos);
+                out[count].uv = a.uv + t * (b.uv - a.uv);
+                count++;
             }
-        } 
+        }
+        return count;
+    }
+
+    /*  Recorta no near o triângulo já no espaço da câmera e projeta. Só o que
+        sai da guard band passa pelo recorte em 2D; o resto vai direto para o
+        setup em ponto fixo. Devolve o número de vértices do polígono (0 se
+        foi descartado). */
+    int clip_and_project(const clip_vertex cam[3], clip_vertex poly[4], raster_vertex r[MAX_CLIP_VERTS]) const
+    {
+        int inside = 0;
+        for (int i = 0; i < 3; i++)
+            inside += cam[i].pos.z() <= -_near;
+        if (inside == 0 || (cam[0].pos.z() < -_far && cam[1].pos.z() < -_far && cam[2].pos.z() < -_far))
+        {
+            counter_add(COUNTER_TRIANGLES_REJECTED);
+            return 0;
+        }
+
+        int count = 3;
+        if (inside == 3)
+            std::copy(cam, cam + 3, poly);
+        else
+        {
+            counter_add(COUNTER_TRIANGLES_CLIPPED);
+            count = clip_near(cam, poly);
+        }
+
+        const guard_band guard(imgWidth, imgHeight);
+        bool inGuard = true;
+        int outcodes = TOP | BOTTOM | LEFT | RIGHT;
+        for (int i = 0; i < count; i++)
+        {
+            project(poly[i].pos, r[i]);
+            r[i].u = poly[i].uv.x() * r[i].inv_w;
+            r[i].v = poly[i].uv.y() * r[i].inv_w;
+            inGuard = inGuard && guard.contains(r[i].x, r[i].y);
+            outcodes &= GetOutCode(vec2(r[i].x, r[i].y));
+        }
+        if (outcodes)
+        {
+            counter_add(COUNTER_TRIANGLES_REJECTED);
+            return 0;   // inteiro fora de um dos lados da tela
+        }
+        if (!inGuard)
+        {
+            // raro: só triângulos que saem da guard band
+            TRACE_ZONE("camera::clip_guard_band");
+            if (inside == 3)
+                counter_add(COUNTER_TRIANGLES_CLIPPED);     // os recortados no near já contaram
+            count = clip_guard_band(guard, r, count, r);
+        }
+        return count;
     }
 
-    bool ClipLine(vec2 &p0, vec2 &p1) {
+    object_view view_of(const Obj &obj) const
+    {
+        object_view v;
+        const matrix44 &m = obj.model;
+        const vec3 eye(camToWorld[3][0], camToWorld[3][1], camToWorld[3][2]);
+        v.toCamera = m * worldToCamera;
+        v.eye = eye;
+        for (int i = 0; i < 4; i++)
+            for (int j = 0; j < 4; j++)
+                v.moved = v.moved || m[i][j] != (i == j ? 1.0f : 0.0f);
+        if (!v.moved)
+            return v;
+
+        const matrix44 inverse = m.inverse();
+        inverse.mult_point_matrix(eye, v.eye);
+        v.normalToWorld = inverse.transposed();
+        const vec3 axis[3] = { vec3(m[0][0], m[0][1], m[0][2]), vec3(m[1][0], m[1][1], m[1][2]), vec3(m[2][0], m[2][1], m[2][2]) };
+        const float length[3] = { axis[0].length(), axis[1].length(), axis[2].length() };
+        v.scale = std::max(length[0], std::max(length[1], length[2]));
+        v.mirrored = dot(cross(axis[0], axis[1]), axis[2]) < 0;
+        const float tolerance = 1e-4f * v.scale;
+        v.conformal = std::fabs(length[0] - length[1]) <= tolerance && std::fabs(length[0] - length[2]) <= tolerance &&
+                      std::fabs(dot(axis[0], axis[1])) <= tolerance * v.scale && std::fabs(dot(axis[0], axis[2])) <= tolerance * v.scale &&
+                      std::fabs(dot(axis[1], axis[2])) <= tolerance * v.scale;
+        return v;
+    }
 
-        int outp0 = GetOutCode(p0);
-        int outp1 = GetOutCode(p1);
-        int slope = 0;
-        int tmp_x, tmp_y = 0;
+    // Normal do espaço do objeto para o mundo; sem model, a própria.
+    static vec3 world_normal(const object_view &view, const vec3 &normal)
+    {
+        if (!view.moved)
+            return normal;
+        vec3 world;
+        view.normalToWorld.mult_vec_matrix(normal, world);
+        return world;
+    }
 
-        bool accept = false;
-        int outcodeOutside = 0;
+    // Falso só quando os 8 cantos da AABB estão do lado de fora de um mesmo plano do frustum.
+    bool in_frustum(const float bounds[6], const matrix44 &toCamera) const
+    {
+        int outside[6] = { 0, 0, 0, 0, 0, 0 };
+        for (int i = 0; i < 8; i++)
+        {
+            const vec3 corner(bounds[(i & 1) ? max_x : min_x], bounds[(i & 2) ? max_y : min_y], bounds[(i & 4) ? max_z : min_z]);
+            vec3 p(0, 0, 0);
+            toCamera.mult_point_matrix(corner, p);
+            const float depth = -p.z();
+            outside[0] += depth < _near;
+            outside[1] += depth > _far;
+            outside[2] += p.x() * _near > right * depth;
+            outside[3] += p.x() * _near < -right * depth;
+            outside[4] += p.y() * _near > top * depth;
+            outside[5] += p.y() * _near < -top * depth;
+        }
+        for (int plane = 0; plane < 6; plane++)
+            if (outside[plane] == 8)
+                return false;
+        return true;
+    }
+
+    /*  Falso quando o meshlet inteiro cai fora do frustum (a esfera passa de
+        um dos planos) ou, com cull, quando o cone de normais mostra que todas
+        as faces estão de costas (ou de frente) para o olho. slack aumenta o
+        raio, para cobrir o arredondamento das posições quantizadas. O cone é
+        testado no espaço do objeto, e só quando o model preserva ângulos. */
+    bool meshlet_visible(const meshlet &m, const object_view &view, int cull, float slack) const
+    {
+        const vec3 center(m.center[0], m.center[1], m.center[2]);
+        const float objectRadius = m.radius + slack, radius = objectRadius * view.scale;
+        vec3 p(0, 0, 0);
+        view.toCamera.mult_point_matrix(center, p);
+        const float depth = -p.z();
+        if (depth + radius < _near || depth - radius > _far)
+            return false;
+        // planos laterais pela origem: distância = (x*near - right*depth) / |(near, right)|
+        const float sideX = radius * std::sqrt(_near * _near + right * right);
+        const float sideY = radius * std::sqrt(_near * _near + top * top);
+        if (p.x() * _near - right * depth > sideX || -p.x() * _near - right * depth > sideX ||
+            p.y() * _near - top * depth > sideY || -p.y() * _near - top * depth > sideY)
+            return false;
+
+        if (cull == CULL_NONE || m.cone_cutoff >= 1 || !view.conformal)
+            return true;
+        const vec3 toCenter = center - view.eye;
+        const float along = dot(toCenter, vec3(m.cone_axis[0], m.cone_axis[1], m.cone_axis[2]));
+        return (cull == CULL_BACK ? along : -along) < m.cone_cutoff * toCenter.length() + objectRadius;
+    }
+
+    // Lambert por face, com um pouco de ambiente; 256 = totalmente iluminado. A normal não precisa ser unitária.
+    int lambert(const vec3 &normal) const
+    {
+        vec3 light(0.0f, 0.0f, -1.0f);
+        light.make_unit_vector();
+
+        const float len = normal.length();
+        const float diffuse = len > 0 ? std::max(0.0f, dot(normal, -light) / len) : 0.0f;
+        return (int)(256 * (0.15f + 0.85f * diffuse));
+    }
+
+    int texture_level(const texture &tex, const clip_vertex poly[4], float rasterArea) const
+    {
+        const vec2 d1 = poly[1].uv - poly[0].uv, d2 = poly[2].uv - poly[0].uv;
+        return tex.select_level(fabs(d1.x() * d2.y() - d1.y() * d2.x()), fabs(rasterArea));
+    }
 
-        while(true) {
-            if(outp0 | outp1 == 0) {
-                accept = true;
-                break;
+    /*  Entrega a fn cada triângulo da malha no espaço da câmera, junto com uma
+        função que devolve a normal da face no mundo (só chamada se o shading
+        usar). Malhas indexadas transformam cada vértice uma vez só em
+        geom.view_positions, e no nível de detalhe level > 0 só o prefixo de
+        vértices que ele usa; as outras, os três cantos de cada triângulo. Nas
+        quantizadas a descompressão entra na matriz, e a normal vem pronta.
+        Com meshlets, o nível 0 anda por cluster e cull decide quais descartar
+        antes de tocar nos vértices deles. */
+    template <class F>
+    void for_each_view_triangle(const Mesh &mesh, const object_view &view, int level, int cull, frame_geometry &geom, F fn) const
+    {
+        if (level == 0 && !mesh.meshlets.empty())
+        {
+            for_each_meshlet_triangle(mesh, view, cull, fn);
+            return;
+        }
+
+        clip_vertex cam[3];
+        const mesh_lod *lod = level > 0 ? &mesh.lods[level - 1] : nullptr;
+        const std::vector<uint32_t> &indices = lod ? lod->indices : mesh.indices;
+        if (mesh.quantized())
+        {
+            const quantized_mesh &q = mesh.packed;
+            const std::vector<oct_normal> &normals = lod ? lod->normals : q.normals;
+            const size_t used = lod ? lod->vertex_count : q.vertices.size();
+            const matrix44 toCamera = q.dequantize() * view.toCamera;
+            geom.view_positions.resize(used);
+            for (size_t i = 0; i < used; i++)
+            {
+                const uint16_t *p = q.vertices[i].pos;
+                toCamera.mult_point_matrix(vec3(p[0], p[1], p[2]), geom.view_positions[i]);
             }
-            else if(outp0 & outp1) {
-                break;
-            }else {
-                outcodeOutside = outp1 != 0? outp1: outp0;
-
-                if(outcodeOutside & TOP) {
-                    tmp_x = p0.e[0] + (p1.e[0] - p0.e[0]) * (HEIGHT - p0.e[1]) / (p1.e[1] - p0.e[1]);
-                    tmp_y = HEIGHT;
-                } else if(outcodeOutside & BOTTOM) {
-                    tmp_x = p0.e[0] + (p1.e[0] - p0.e[0]) * (0 - p0.e[1]) / (p1.e[1] - p0.e[1]);
-                    tmp_y = 0;
-                } if(outcodeOutside & RIGHT) {
-                    tmp_y = p0.e[1] + (p1.e[1] - p0.e[1]) * (WIDTH - p0.e[0]) / (p1.e[0] - p0.e[0]);
-                    tmp_x = WIDTH;
-                } else if(outcodeOutside & LEFT) {
-                    tmp_y = p0.e[1] + (p1.e[1] - p0.e[1]) * (0 - p0.e[0]) / (p1.e[0] - p0.e[0]);
-                    tmp_x = 0;
+            const uint32_t *index = indices.data();
+            for (size_t t = 0; t < normals.size(); t++, index += 3)
+            {
+                for (int i = 0; i < 3; i++)
+                {
+                    cam[i].pos = geom.view_positions[index[i]];
+                    cam[i].uv = q.uv(index[i]);
                 }
+                fn(cam, [&] { return world_normal(view, oct_decode(normals[t])); });
+            }
+            counter_add(COUNTER_VERTICES_TRANSFORMED, used);
+            return;
+        }
 
-                if(outcodeOutside == outp0) {
-                    p0.e[0] = tmp_x;
-                    p0.e[1] = tmp_y;
-                    outp0 = GetOutCode(p0);
-                } else {
-                    p1.e[0] = tmp_x;
-                    p1.e[1] = tmp_y;
-                    outp1 = GetOutCode(p1);
+        if (mesh.indexed())
+        {
+            const size_t used = lod ? lod->vertex_count : mesh.vertices.size();
+            geom.view_positions.resize(used);
+            for (size_t i = 0; i < used; i++)
+                view.toCamera.mult_point_matrix(mesh.vertices[i].pos, geom.view_positions[i]);
+            const uint32_t *index = indices.data();
+            for (size_t t = 0; t < indices.size(); t += 3, index += 3)
+            {
+                for (int i = 0; i < 3; i++)
+                {
+                    cam[i].pos = geom.view_positions[index[i]];
+                    cam[i].uv = mesh.vertices[index[i]].uv;
                 }
+                const vec3 &p0 = mesh.vertices[index[0]].pos, &p1 = mesh.vertices[index[1]].pos, &p2 = mesh.vertices[index[2]].pos;
+                fn(cam, [&] { return world_normal(view, cross(p1 - p0, p2 - p0)); });
+            }
+            counter_add(COUNTER_VERTICES_TRANSFORMED, used);
+            return;
+        }
+
+        for (const Triangle &tri : mesh.tris)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                view.toCamera.mult_point_matrix(tri.vertex[i].pos, cam[i].pos);
+                cam[i].uv = tri.vertex[i].uv;
             }
+            fn(cam, [&] { return world_normal(view, cross(tri.vertex[1].pos - tri.vertex[0].pos, tri.vertex[2].pos - tri.vertex[0].pos)); });
         }
-        return accept;
+        counter_add(COUNTER_VERTICES_TRANSFORMED, 3 * mesh.tris.size());
     }
 
-    int GetOutCode (vec2 &p0) {
-        int outcode = 0;
+    // Os meshlets visíveis, cada um transformando só os seus até 64 vértices.
+    template <class F>
+    void for_each_meshlet_triangle(const Mesh &mesh, const object_view &view, int cull, F fn) const
+    {
+        uint64_t culled = 0, transformed = 0;
+        vec3 local[MESHLET_MAX_VERTICES];
+        clip_vertex cam[3];
 
-        if(p0.e[1] > HEIGHT) {
-            outcode |= TOP;
-        } else if(p0.e[1] < 0) {
-            outcode |= BOTTOM;
+        auto clusters = [&](const matrix44 &toCamera, float slack, auto position, auto uv, auto face_normal) {
+            for (const meshlet &m : mesh.meshlets)
+            {
+                if (!meshlet_visible(m, view, cull, slack))
+                {
+                    culled++;
+                    continue;
+                }
+                const uint32_t *global = &mesh.meshlet_vertices[m.vertex_offset];
+                for (int i = 0; i < m.vertex_count; i++)
+                    toCamera.mult_point_matrix(position(global[i]), local[i]);
+                transformed += m.vertex_count;
+
+                const uint8_t *corner = &mesh.meshlet_triangles[3 * (size_t)m.triangle_offset];
+                for (uint32_t t = m.triangle_offset; t < m.triangle_offset + m.triangle_count; t++, corner += 3)
+                {
+                    for (int i = 0; i < 3; i++)
+                    {
+                        cam[i].pos = local[corner[i]];
+                        cam[i].uv = uv(global[corner[i]]);
+                    }
+                    fn(cam, [&] { return world_normal(view, face_normal(t)); });
+                }
+            }
+        };
+
+        if (mesh.quantized())
+        {
+            const quantized_mesh &q = mesh.packed;
+            const float slack = 0.5f * vec3(q.scale[0], q.scale[1], q.scale[2]).length();
+            clusters(q.dequantize() * view.toCamera, slack,
+                [&](uint32_t v) { const uint16_t *p = q.vertices[v].pos; return vec3(p[0], p[1], p[2]); },
+                [&](uint32_t v) { return q.uv(v); },
+                [&](uint32_t t) { return oct_decode(q.normals[t]); });
         }
-        if(p0.e[0] > WIDTH) {
-            outcode |= RIGHT;
-        } else if(p0.e[0] < 0) {
-            outcode |= LEFT;
+        else
+        {
+            clusters(view.toCamera, 0.0f,
+                [&](uint32_t v) -> const vec3 & { return mesh.vertices[v].pos; },
+                [&](uint32_t v) -> const vec2 & { return mesh.vertices[v].uv; },
+                [&](uint32_t t) {
+                    const uint32_t *index = &mesh.indices[3 * (size_t)t];
+                    const vec3 &p0 = mesh.vertices[index[0]].pos;
+                    return cross(mesh.vertices[index[1]].pos - p0, mesh.vertices[index[2]].pos - p0);
+                });
         }
+        counter_add(COUNTER_MESHLETS_SUBMITTED, mesh.meshlets.size());
+        counter_add(COUNTER_MESHLETS_CULLED, culled);
+        counter_add(COUNTER_VERTICES_TRANSFORMED, transformed);
+    }
 
-        return outcode;
+    /*  Estágio de transformação: recorta, projeta e descarta as faces de um
+        objeto, gravando os triângulos em tela em geom para o raster. Uma
+        instância por combinação de Cull, Shade e Wire; profundidade e mistura
+        só importam no raster. */
+    template <int Cull, int Shade, bool Wire>
+    void transform_mesh(const Obj &obj, const object_view &view, int level, uint32_t draw, frame_geometry &geom) const
+    {
+        const pipeline_state &s = geom.draws[draw];
+        const texture *tex = Shade == SHADE_TEXTURED ? obj.tex.get() : nullptr;
+        const int alpha = (s.color >> 24) + (s.color >> 31);
+        uint64_t culled = 0;
+
+        for_each_view_triangle(*obj.mesh, view, level, Cull, geom, [&](const clip_vertex cam[3], auto face_normal) {
+            clip_vertex poly[4];
+            raster_vertex r[MAX_CLIP_VERTS];
+            const int count = clip_and_project(cam, poly, r);
+            if (count == 0)
+                return;
+
+            // OBJ é anti-horário; com o Y do raster para baixo a área da face da frente fica negativa
+            const float area = edge_function(r[0], r[1], r[2].x, r[2].y);
+            const float facing = view.mirrored ? -area : area;
+            if ((Cull == CULL_BACK && facing >= 0) || (Cull == CULL_FRONT && facing <= 0))
+            {
+                culled++;
+                return;
+            }
+
+            raster_triangle t;
+            t.draw = draw;
+            t.frag.intensity = Shade == SHADE_FLAT ? 256 : lambert(face_normal());
+            t.frag.color = Shade == SHADE_FLAT ? s.color : modulate(s.color, t.frag.intensity);
+            t.frag.alpha = alpha;
+            t.frag.tex = Shade == SHADE_TEXTURED ? &tex->levels[texture_level(*tex, poly, area)] : nullptr;
+            emit_fan(t, r, count, Wire, geom);
+        });
+        counter_add(COUNTER_TRIANGLES_BACKFACE_CULLED, culled);
+    }
+
+    // Mesma transformação lendo o estado em tempo de execução (referência para o benchmark).
+    void transform_mesh_generic(const Obj &obj, const object_view &view, int level, uint32_t draw, frame_geometry &geom) const
+    {
+        const pipeline_state &s = geom.draws[draw];
+        const int alpha = (s.color >> 24) + (s.color >> 31);
+        uint64_t culled = 0;
+
+        for_each_view_triangle(*obj.mesh, view, level, s.cull, geom, [&](const clip_vertex cam[3], auto face_normal) {
+            clip_vertex poly[4];
+            raster_vertex r[MAX_CLIP_VERTS];
+            const int count = clip_and_project(cam, poly, r);
+            if (count == 0)
+                return;
+
+            const float area = edge_function(r[0], r[1], r[2].x, r[2].y);
+            const float facing = view.mirrored ? -area : area;
+            if ((s.cull == CULL_BACK && facing >= 0) || (s.cull == CULL_FRONT && facing <= 0))
+            {
+                culled++;
+                return;
+            }
+
+            raster_triangle t;
+            t.draw = draw;
+            t.frag.intensity = s.shade == SHADE_FLAT ? 256 : lambert(face_normal());
+            t.frag.color = s.shade == SHADE_FLAT ? s.color : modulate(s.color, t.frag.intensity);
+            t.frag.alpha = alpha;
+            t.frag.tex = (s.shade == SHADE_TEXTURED && !s.wireframe) ? &obj.tex->levels[texture_level(*obj.tex, poly, area)] : nullptr;
+            emit_fan(t, r, count, s.wireframe, geom);
+        });
+        counter_add(COUNTER_TRIANGLES_BACKFACE_CULLED, culled);
     }
 
-    void render_scene(std::vector<Obj> objs, SDL_Renderer *renderer)
+    // Divide o polígono recortado em leque; no wireframe só as arestas do polígono são desenhadas.
+    static void emit_fan(raster_triangle &t, const raster_vertex *r, int count, bool wire, frame_geometry &geom)
     {
+        for (int i = 2; i < count; i++)
+        {
+            t.v[0] = r[0];
+            t.v[1] = r[i - 1];
+            t.v[2] = r[i];
+            t.edges = wire ? (uint8_t)((i == 2 ? 1 : 0) | 2 | (i == count - 1 ? 4 : 0)) : 0;
+            geom.tris.push_back(t);
+        }
+    }
 
-        vec3 light(0.0f, 0.0f, -1.0f);
-        light.make_unit_vector();
+    typedef void (camera::*transform_fn)(const Obj &, const object_view &, int, uint32_t, frame_geometry &) const;
+
+    static const int TRANSFORM_STATE_COUNT = 3 * 3 * 2;
 
-        for (auto obj : objs)
+    // O wireframe não lê textura: a combinação com SHADE_TEXTURED cai no Lambert.
+    template <int I>
+    static constexpr transform_fn transform_table_entry()
+    {
+        return &camera::transform_mesh<I / 6, (I % 2 && (I / 2) % 3 == SHADE_TEXTURED) ? SHADE_LAMBERT : (I / 2) % 3, I % 2>;
+    }
+
+    template <std::size_t... I>
+    static const transform_fn *make_transform_table(std::index_sequence<I...>)
+    {
+        static const transform_fn table[] = { transform_table_entry<I>()... };
+        return table;
+    }
+
+    static transform_fn select_transform(const pipeline_state &s)
+    {
+        static const transform_fn *table = make_transform_table(std::make_index_sequence<TRANSFORM_STATE_COUNT>());
+        return table[(s.cull * 3 + s.shade) * 2 + s.wireframe];
+    }
+
+    /*  Nível de detalhe do objeto index: o mais grosso cujo erro, projetado
+        na distância do centro da AABB, fica abaixo de lod_pixels. Com
+        lod_memory, só se troca por um nível mais grosso quando ele fica abaixo
+        de LOD_HYSTERESIS * lod_pixels; para um mais fino, na hora. */
+    int select_lod(const Mesh &mesh, const object_view &view, size_t index) const
+    {
+        if (lod_pixels <= 0 || mesh.lods.empty())
+            return 0;
+        const float *b = mesh.bounds;
+        const vec3 center(0.5f * (b[min_x] + b[max_x]), 0.5f * (b[min_y] + b[max_y]), 0.5f * (b[min_z] + b[max_z]));
+        const float radius = 0.5f * view.scale * (vec3(b[max_x], b[max_y], b[max_z]) - vec3(b[min_x], b[min_y], b[min_z])).length();
+        vec3 p(0, 0, 0);
+        view.toCamera.mult_point_matrix(center, p);
+        const float distance = -p.z() - radius;
+        if (distance <= _near)
+            return 0;
+        const float pixelsPerUnit = 0.5f * imgHeight * _near * view.scale / (top * distance);    // por unidade do objeto
+
+        auto coarsest_within = [&](float limit) {
+            int level = 0;
+            for (size_t k = 0; k < mesh.lods.size() && mesh.lods[k].error * pixelsPerUnit <= limit; k++)
+                level = (int)k + 1;
+            return level;
+        };
+        const int wanted = coarsest_within(lod_pixels);
+        if (!lod_memory)
+            return wanted;
+
+        if (lod_memory->level.size() <= index)
+            lod_memory->level.resize(index + 1, 0);
+        const int previous = std::min<int>(lod_memory->level[index], (int)mesh.lods.size());
+        const int level = wanted < previous ? wanted : std::max(previous, coarsest_within(LOD_HYSTERESIS * lod_pixels));
+        lod_memory->level[index] = (uint8_t)level;
+        return level;
+    }
+
+    /*  Ordem de desenho: as instâncias de uma mesma malha em seguida, as
+        malhas na ordem em que aparecem primeiro em objs, e cada grupo na
+        ordem da cena. Uma cena sem malhas repetidas fica como está. */
+    static void group_by_mesh(const std::vector<Obj> &objs, frame_geometry &geom)
+    {
+        std::vector<uint32_t> &order = geom.object_order, &group = geom.object_group;
+        order.resize(objs.size());
+        group.resize(objs.size());
+        for (size_t i = 0; i < objs.size(); i++)
+            order[i] = (uint32_t)i;
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return std::less<const Mesh *>()(objs[a].mesh.get(), objs[b].mesh.get()); });
+        for (size_t i = 0; i < order.size(); i++)
+            group[order[i]] = i > 0 && objs[order[i]].mesh == objs[order[i - 1]].mesh ? group[order[i - 1]] : order[i];
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return group[a] < group[b]; });
+    }
+
+    // Primeira metade do frame: todos os objetos viram triângulos em tela em geom.
+    void transform_scene(const std::vector<Obj> &objs, frame_geometry &geom) const
+    {
+        TRACE_ZONE("camera::transform_scene");
+        geom.clear();
+        counter_add(COUNTER_OBJECTS_SUBMITTED, objs.size());
+        group_by_mesh(objs, geom);
+        for (uint32_t index : geom.object_order)
         {
-            for (int i = 0; i < obj.mesh.tris.size(); i++)
+            const Obj &obj = objs[index];
+            const object_view view = view_of(obj);
+            if (!in_frustum(obj.mesh->bounds, view.toCamera))
             {
-                vec2 praster1;
-                vec2 praster2;
-                vec2 praster3;
-
-                vec3 col(255, 255, 255);
-                SDL_SetRenderDrawColor(renderer, 255, 255, 255, SDL_ALPHA_OPAQUE);
-
-                bool v1, v2, v3;
-                v1 = compute_pixel_coordinates(obj.mesh.tris[i].vertex[0].pos, praster1);
-                v2 = compute_pixel_coordinates(obj.mesh.tris[i].vertex[1].pos, praster2);
-                v3 = compute_pixel_coordinates(obj.mesh.tris[i].vertex[2].pos, praster3);
-
-                if (v1 && v2)
-                    DrawLine(renderer, praster1, praster2);
-                if (v1 && v3)
-                    DrawLine(renderer, praster1, praster3);
-                if (v2 && v3)
-                    DrawLine(renderer, praster2, praster3);
+                counter_add(COUNTER_OBJECTS_CULLED);
+                continue;
             }
+            const int level = select_lod(*obj.mesh, view, index);
+
+            // objetos sem textura são iluminados normalmente; caixas de malhas ainda carregando, só em arame
+            pipeline_state s = state;
+            if (s.shade == SHADE_TEXTURED && (!obj.tex || obj.tex->levels.empty()))
+                s.shade = SHADE_LAMBERT;
+            if (obj.placeholder)
+            {
+                s.shade = SHADE_FLAT;
+                s.wireframe = true;
+                s.cull = CULL_NONE;
+            }
+
+            const uint32_t draw = (uint32_t)geom.draws.size();
+            geom.draws.push_back(s);
+            if (specialize)
+                (this->*select_transform(s))(obj, view, level, draw, geom);
+            else
+                transform_mesh_generic(obj, view, level, draw, geom);
         }
     }
+
+    // Segunda metade: rasteriza geom num único tile do tamanho do framebuffer.
+    void rasterize_scene(frame_geometry &geom, framebuffer &fb) const
+    {
+        TRACE_ZONE("camera::rasterize_scene");
+        geom.bin(fb.width, fb.height, std::max(fb.width, fb.height));
+        rasterize(geom, 0, fb, tile_rect{0, 0, fb.width, fb.height}, specialize);
+    }
+
+    void render_scene(const std::vector<Obj> &objs, framebuffer &fb, frame_geometry &geom) const
+    {
+        TRACE_ZONE("camera::render_scene");
+        transform_scene(objs, geom);
+        rasterize_scene(geom, fb);
+    }
+
+    void render_scene(const std::vector<Obj> &objs, framebuffer &fb) const
+    {
+        static thread_local frame_geometry scratch;
+        render_scene(objs, fb, scratch);
+    }
 };
 
-#endif
+#endif
\ No newline at end of file
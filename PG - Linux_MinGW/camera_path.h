@@ -0,0 +1,128 @@
+#ifndef CAMERAPATHH
+#define CAMERAPATHH
+
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include "vec3.h"
+#include "object.h"
+
+/*  Camera paths for batch rendering: one from/at/up view per output frame.
+
+        orbit_path      turntable around a point, evenly spaced
+        keyframe_path   linear interpolation between keyed frames
+        load_views      a text file of views, one per frame
+
+    Text files hold one entry per line; blank lines and lines starting with
+    '#' are skipped. A view is "fx fy fz  ax ay az  ux uy uz" (up is
+    optional, default 0 1 0); a keyframe is the frame number followed by a
+    view. */
+
+struct camera_view
+{
+    vec3 from, at, up;
+};
+
+// frames views on a circle of radius around center, raised by elevation degrees, starting on +z.
+inline std::vector<camera_view> orbit_path(int frames, const vec3 &center, float radius, float elevation)
+{
+    std::vector<camera_view> path;
+    const float pitch = elevation * (float)M_PI / 180.0f;
+    for (int i = 0; i < frames; i++)
+    {
+        const float yaw = 2.0f * (float)M_PI * i / frames;
+        const vec3 offset(radius * std::cos(pitch) * std::sin(yaw), radius * std::sin(pitch), radius * std::cos(pitch) * std::cos(yaw));
+        path.push_back(camera_view{ center + offset, center, vec3(0, 1, 0) });
+    }
+    return path;
+}
+
+// Center and a radius that keeps the whole AABB in a fov degrees view.
+inline void orbit_framing(const float bounds[6], float fov, vec3 &center, float &radius)
+{
+    center = vec3((bounds[min_x] + bounds[max_x]) * 0.5f, (bounds[min_y] + bounds[max_y]) * 0.5f, (bounds[min_z] + bounds[max_z]) * 0.5f);
+    const float extent = 0.5f * vec3(bounds[max_x] - bounds[min_x], bounds[max_y] - bounds[min_y], bounds[max_z] - bounds[min_z]).length();
+    radius = extent / std::sin(0.5f * fov * (float)M_PI / 180.0f);
+}
+
+struct camera_keyframe
+{
+    int frame;
+    camera_view view;
+};
+
+// One view per frame from the first to the last key (keys sorted by frame), lerping between keys.
+inline std::vector<camera_view> keyframe_path(const std::vector<camera_keyframe> &keys)
+{
+    std::vector<camera_view> path;
+    for (size_t k = 0; k + 1 < keys.size(); k++)
+    {
+        const camera_keyframe &a = keys[k], &b = keys[k + 1];
+        for (int f = a.frame; f < b.frame; f++)
+        {
+            const float t = (float)(f - a.frame) / (b.frame - a.frame);
+            path.push_back(camera_view{ a.view.from + t * (b.view.from - a.view.from), a.view.at + t * (b.view.at - a.view.at),
+                                        a.view.up + t * (b.view.up - a.view.up) });
+        }
+    }
+    if (!keys.empty())
+        path.push_back(keys.back().view);
+    return path;
+}
+
+// Reads the next view from a line; false if it has fewer than six numbers.
+inline bool parse_view(std::istringstream &line, camera_view &view)
+{
+    float v[9] = { 0, 0, 0, 0, 0, 0, 0, 1, 0 };
+    int n = 0;
+    while (n < 9 && line >> v[n])
+        n++;
+    if (n < 6)
+        return false;
+    view = camera_view{ vec3(v[0], v[1], v[2]), vec3(v[3], v[4], v[5]), vec3(v[6], v[7], v[8]) };
+    return true;
+}
+
+/*  Parses a views file, or a keyframes file when keyed is set, into one
+    view per frame. Returns false with the offending line in error. */
+inline bool load_camera_path(const char *path, bool keyed, std::vector<camera_view> &views, std::string &error)
+{
+    std::ifstream f(path);
+    if (!f.is_open())
+    {
+        error = std::string("cannot open ") + path;
+        return false;
+    }
+
+    std::vector<camera_keyframe> keys;
+    views.clear();
+    std::string text;
+    for (int number = 1; std::getline(f, text); number++)
+    {
+        if (text.find_first_not_of(" \t\r") == std::string::npos || text[text.find_first_not_of(" \t\r")] == '#')
+            continue;
+
+        std::istringstream line(text);
+        camera_keyframe key = { 0, camera_view() };
+        const bool ok = keyed ? (line >> key.frame) && parse_view(line, key.view) && (keys.empty() || key.frame > keys.back().frame)
+                              : parse_view(line, key.view);
+        if (!ok)
+        {
+            error = std::string(path) + ":" + std::to_string(number) + ": bad " + (keyed ? "keyframe" : "view");
+            return false;
+        }
+        if (keyed)
+            keys.push_back(key);
+        else
+            views.push_back(key.view);
+    }
+
+    if (keyed)
+        views = keyframe_path(keys);
+    return true;
+}
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef COUNTERSH
+#define COUNTERSH
+
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include <cstdio>
+#include "alloc_hook.h"
+
+/*  Pipeline counters. Each thread adds to its own block of running totals
+    (only the owner writes, so an increment is a plain load and store), and
+    frame_counters::end_frame() on the main thread sums the blocks and keeps
+    the difference since the previous frame. Hot loops should accumulate
+    locally and call counter_add() once per triangle or per mesh.
+
+    The allocation counters come from alloc_hook.h instead and stay zero
+    unless it is compiled in. */
+
+enum frame_counter
+{
+    COUNTER_OBJECTS_SUBMITTED,
+    COUNTER_OBJECTS_CULLED,
+    COUNTER_MESHLETS_SUBMITTED,
+    COUNTER_MESHLETS_CULLED,
+    COUNTER_VERTICES_TRANSFORMED,
+    COUNTER_TRIANGLES_BACKFACE_CULLED,
+    COUNTER_TRIANGLES_CLIPPED,
+    COUNTER_TRIANGLES_REJECTED,
+    COUNTER_PIXELS_WRITTEN,
+    COUNTER_UI_CACHE_HITS,
+    COUNTER_UI_CACHE_MISSES,
+    COUNTER_ALLOCATIONS,
+    COUNTER_ALLOCATED_BYTES,
+    COUNTER_COUNT
+};
+
+const char *const COUNTER_NAMES[COUNTER_COUNT] = {
+    "objects_submitted", "objects_culled", "meshlets_submitted", "meshlets_culled", "vertices_transformed",
+    "triangles_backface_culled", "triangles_clipped", "triangles_rejected", "pixels_written", "ui_cache_hits", "ui_cache_misses",
+    "allocations", "allocated_bytes"
+};
+
+struct counter_block
+{
+    std::atomic<uint64_t> values[COUNTER_COUNT];
+
+    counter_block()
+    {
+        for (std::atomic<uint64_t> &v : values)
+            v.store(0, std::memory_order_relaxed);
+    }
+};
+
+struct counter_registry
+{
+    std::mutex mutex;
+    std::vector<std::shared_ptr<counter_block>> blocks;   // kept after their thread exits
+
+    static counter_registry &get()
+    {
+        static counter_registry registry;
+        return registry;
+    }
+};
+
+inline counter_block &counters_local()
+{
+    static thread_local counter_block *local = nullptr;
+    if (!local)
+    {
+        std::shared_ptr<counter_block> b = std::make_shared<counter_block>();
+        counter_registry &r = counter_registry::get();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        r.blocks.push_back(b);
+        local = b.get();
+    }
+    return *local;
+}
+
+inline void counter_add(frame_counter c, uint64_t n = 1)
+{
+    std::atomic<uint64_t> &v = counters_local().values[c];
+    v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// Per-frame view of the counters, owned by the thread that ends frames.
+class frame_counters
+{
+public:
+    frame_counters()
+    {
+        for (int c = 0; c < COUNTER_COUNT; c++)
+            totals[c] = frame[c] = 0;
+    }
+
+    void end_frame()
+    {
+        uint64_t sum[COUNTER_COUNT] = {};
+        {
+            counter_registry &r = counter_registry::get();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            for (const std::shared_ptr<counter_block> &b : r.blocks)
+                for (int c = 0; c < COUNTER_COUNT; c++)
+                    sum[c] += b->values[c].load(std::memory_order_relaxed);
+        }
+        const alloc_counts allocs = alloc_totals();
+        sum[COUNTER_ALLOCATIONS] += allocs.count;
+        sum[COUNTER_ALLOCATED_BYTES] += allocs.bytes;
+        for (int c = 0; c < COUNTER_COUNT; c++)
+        {
+            frame[c] = sum[c] - totals[c];
+            totals[c] = sum[c];
+        }
+        frames++;
+    }
+
+    uint64_t operator[](int c) const { return frame[c]; }
+    uint64_t index() const { return frames; }
+
+    // One JSON object per line: {"frame":N,"objects_submitted":...}
+    void write_json(FILE *f) const
+    {
+        fprintf(f, "{\"frame\":%llu", (unsigned long long)frames);
+        for (int c = 0; c < COUNTER_COUNT; c++)
+            fprintf(f, ",\"%s\":%llu", COUNTER_NAMES[c], (unsigned long long)frame[c]);
+        fprintf(f, "}\n");
+    }
+
+private:
+    uint64_t totals[COUNTER_COUNT];
+    uint64_t frame[COUNTER_COUNT];
+    uint64_t frames = 0;
+};
+
+#endif
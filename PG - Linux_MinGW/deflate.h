@@ -0,0 +1,241 @@
+#ifndef DEFLATEH
+#define DEFLATEH
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/*  Small dependency-free deflate (RFC 1951) for the PNG writer: greedy LZ77
+    over a hash chain, coded with the fixed Huffman tables, which is fast
+    and does well on rendered images (long runs, repeated rows) without the
+    cost of building dynamic trees.
+
+    deflate_band() compresses one independent piece of a stream. A piece
+    that is not the last one ends with an empty stored block, which
+    byte-aligns it, so pieces compressed separately (in parallel) form a
+    valid stream when concatenated. The adler-32 of the whole zlib stream
+    follows from the pieces' with adler32_combine(). */
+
+const uint32_t ADLER_BASE = 65521;
+
+inline uint32_t adler32(const uint8_t *data, size_t size, uint32_t adler = 1)
+{
+    uint32_t a = adler & 0xffff, b = adler >> 16;
+    while (size > 0)
+    {
+        const size_t n = size < 5552 ? size : 5552;    // largest run before b can overflow 32 bits
+        for (size_t i = 0; i < n; i++)
+        {
+            a += data[i];
+            b += a;
+        }
+        a %= ADLER_BASE;
+        b %= ADLER_BASE;
+        data += n;
+        size -= n;
+    }
+    return a | (b << 16);
+}
+
+// adler-32 of A followed by B, from adler-32(A), adler-32(B) and the length of B (as in zlib).
+inline uint32_t adler32_combine(uint32_t adlerA, uint32_t adlerB, size_t sizeB)
+{
+    const uint32_t rem = (uint32_t)(sizeB % ADLER_BASE);
+    uint32_t sum1 = adlerA & 0xffff;
+    uint32_t sum2 = (rem * sum1) % ADLER_BASE;
+    sum1 += (adlerB & 0xffff) + ADLER_BASE - 1;
+    sum2 += (adlerA >> 16) + (adlerB >> 16) + ADLER_BASE - rem;
+    if (sum1 >= ADLER_BASE) sum1 -= ADLER_BASE;
+    if (sum1 >= ADLER_BASE) sum1 -= ADLER_BASE;
+    if (sum2 >= 2 * ADLER_BASE) sum2 -= 2 * ADLER_BASE;
+    if (sum2 >= ADLER_BASE) sum2 -= ADLER_BASE;
+    return sum1 | (sum2 << 16);
+}
+
+class bit_writer
+{
+public:
+    explicit bit_writer(std::vector<uint8_t> &o) : out(o) {}
+
+    // LSB first, as deflate packs everything but Huffman codes.
+    void put(uint32_t value, int count)
+    {
+        bits |= (uint64_t)value << used;
+        used += count;
+        while (used >= 8)
+        {
+            out.push_back((uint8_t)bits);
+            bits >>= 8;
+            used -= 8;
+        }
+    }
+
+    void align()
+    {
+        if (used > 0)
+            put(0, 8 - used);
+    }
+
+private:
+    std::vector<uint8_t> &out;
+    uint64_t bits = 0;
+    int used = 0;
+};
+
+struct deflate_tables
+{
+    uint16_t literal_code[288];     // fixed Huffman codes, bit-reversed so put() emits them MSB first
+    uint8_t literal_bits[288];
+    uint8_t distance_code[30];
+    uint16_t length_base[29];
+    uint8_t length_extra[29];
+    uint16_t distance_base[30];
+    uint8_t distance_extra[30];
+    uint8_t length_symbol[259];     // match length -> length code - 257
+    uint8_t distance_symbol[512];   // see distance_index()
+
+    static uint32_t reverse(uint32_t code, int bits)
+    {
+        uint32_t r = 0;
+        for (int i = 0; i < bits; i++)
+            r |= ((code >> i) & 1) << (bits - 1 - i);
+        return r;
+    }
+
+    deflate_tables()
+    {
+        for (int s = 0; s < 288; s++)
+        {
+            if (s < 144) { literal_bits[s] = 8; literal_code[s] = (uint16_t)reverse(0x30 + s, 8); }
+            else if (s < 256) { literal_bits[s] = 9; literal_code[s] = (uint16_t)reverse(0x190 + s - 144, 9); }
+            else if (s < 280) { literal_bits[s] = 7; literal_code[s] = (uint16_t)reverse(s - 256, 7); }
+            else { literal_bits[s] = 8; literal_code[s] = (uint16_t)reverse(0xc0 + s - 280, 8); }
+        }
+
+        int base = 3;
+        for (int c = 0; c < 28; c++)
+        {
+            length_extra[c] = (uint8_t)(c < 8 ? 0 : (c - 4) / 4);
+            length_base[c] = (uint16_t)base;
+            for (int l = 0; l < (1 << length_extra[c]); l++)
+                length_symbol[base + l] = (uint8_t)c;
+            base += 1 << length_extra[c];
+        }
+        length_extra[28] = 0;
+        length_base[28] = 258;
+        length_symbol[258] = 28;
+
+        base = 1;
+        for (int c = 0; c < 30; c++)
+        {
+            distance_code[c] = (uint8_t)reverse(c, 5);
+            distance_extra[c] = (uint8_t)(c < 4 ? 0 : (c - 2) / 2);
+            distance_base[c] = (uint16_t)base;
+            base += 1 << distance_extra[c];
+        }
+        for (int d = 1; d <= 32768; d++)
+        {
+            int c = 0;
+            while (c < 29 && distance_base[c + 1] <= d)
+                c++;
+            distance_symbol[distance_index(d)] = (uint8_t)c;
+        }
+    }
+
+    // Distances up to 256 map directly, larger ones by d/128 (codes 16+ span multiples of 128).
+    static int distance_index(int d) { return d <= 256 ? d - 1 : 256 + ((d - 1) >> 7); }
+
+    static const deflate_tables &get()
+    {
+        static const deflate_tables tables;
+        return tables;
+    }
+};
+
+/*  Appends one piece of a deflate stream for data to out. Matches never
+    reach before data, so pieces are independent; last marks the final
+    piece of the stream. */
+inline void deflate_band(const uint8_t *data, size_t size, bool last, std::vector<uint8_t> &out)
+{
+    static const int HASH_BITS = 15;
+    static const int MAX_CHAIN = 16;
+    static const size_t WINDOW = 32768;
+    const deflate_tables &t = deflate_tables::get();
+
+    std::vector<int32_t> head(1 << HASH_BITS, -1);
+    std::vector<int32_t> prev(size);
+    bit_writer bits(out);
+    bits.put(last ? 1 : 0, 1);
+    bits.put(1, 2);     // fixed Huffman block
+
+    auto hash = [&](size_t i) {
+        return ((uint32_t)data[i] << 16 | (uint32_t)data[i + 1] << 8 | data[i + 2]) * 2654435761u >> (32 - HASH_BITS);
+    };
+    auto insert = [&](size_t i) {
+        const uint32_t h = hash(i);
+        prev[i] = head[h];
+        head[h] = (int32_t)i;
+    };
+
+    size_t i = 0;
+    while (i < size)
+    {
+        int bestLength = 0, bestDistance = 0;
+        if (i + 3 <= size)
+        {
+            const size_t maxLength = size - i < 258 ? size - i : 258;
+            int32_t candidate = head[hash(i)];
+            for (int chain = 0; chain < MAX_CHAIN && candidate >= 0 && i - candidate <= WINDOW; chain++)
+            {
+                const uint8_t *a = data + candidate, *b = data + i;
+                size_t l = 0;
+                while (l < maxLength && a[l] == b[l])
+                    l++;
+                if ((int)l > bestLength)
+                {
+                    bestLength = (int)l;
+                    bestDistance = (int)(i - candidate);
+                    if (l == maxLength)
+                        break;
+                }
+                candidate = prev[candidate];
+            }
+            insert(i);
+        }
+
+        if (bestLength >= 3)
+        {
+            const int lc = t.length_symbol[bestLength];
+            bits.put(t.literal_code[257 + lc], t.literal_bits[257 + lc]);
+            bits.put(bestLength - t.length_base[lc], t.length_extra[lc]);
+            const int dc = t.distance_symbol[deflate_tables::distance_index(bestDistance)];
+            bits.put(t.distance_code[dc], 5);
+            bits.put(bestDistance - t.distance_base[dc], t.distance_extra[dc]);
+
+            // the skipped positions still go into the chains so later matches can find them
+            for (size_t j = i + 1; j < i + bestLength && j + 3 <= size; j++)
+                insert(j);
+            i += bestLength;
+        }
+        else
+        {
+            bits.put(t.literal_code[data[i]], t.literal_bits[data[i]]);
+            i++;
+        }
+    }
+    bits.put(t.literal_code[256], t.literal_bits[256]);
+
+    if (!last)
+    {
+        bits.put(0, 3);     // empty stored block: byte aligns the piece
+        bits.align();
+        out.push_back(0x00);
+        out.push_back(0x00);
+        out.push_back(0xff);
+        out.push_back(0xff);
+    }
+    else
+        bits.align();
+}
+
+#endif
@@ -0,0 +1,229 @@
+#ifndef FRAMEPIPELINEH
+#define FRAMEPIPELINEH
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include "camera.h"
+#include "thread_pool.h"
+#include "hw_counters.h"
+
+struct frame_stats
+{
+    double transform_ms = 0;    // transform and binning, on the transform thread
+    double raster_ms = 0;       // handed to the pool until the last tile is done
+    hw_sample transform_hw;     // with hardware counters on; raster sums every job
+    hw_sample raster_hw;
+};
+
+/*  Overlaps consecutive frames: a transform thread turns frame N+1 into
+    binned screen-space triangles while the pool rasterizes the tiles of
+    frame N, and the caller presents finished frames on its own thread.
+
+    Each frame is rendered at the camera's image size, so the resolution
+    may change from one submit() to the next.
+
+    There are DEPTH frame slots, so submit() blocks once DEPTH frames are in
+    flight and the image on screen is at most one frame behind the input.
+    Each slot keeps its own copy of the objects passed to submit() (handles
+    and matrices, the meshes are shared and immutable), so the caller may
+    change the scene, e.g. swap in a mesh that finished loading, while
+    earlier frames are still being drawn. */
+class frame_pipeline
+{
+public:
+    static const int DEPTH = 2;
+    static const int TILE_SIZE = 64;
+
+    explicit frame_pipeline(unsigned rasterThreads = 0) : pool(rasterThreads)
+    {
+        transformer = std::thread([this] { transform_loop(); });
+    }
+
+    ~frame_pipeline()
+    {
+        flush();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        changed.notify_all();
+        transformer.join();
+    }
+
+    // Queues a frame seen from cam; waits while every slot is busy.
+    void submit(const camera &cam, const std::vector<Obj> &objects)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        slot &s = slots[tail];
+        changed.wait(lock, [&] { return s.stage == FREE; });
+
+        s.cam = cam;
+        s.objects = objects;    // reuses the slot's capacity
+        if (s.fb.width != cam.imgWidth || s.fb.height != cam.imgHeight)
+            s.fb.resize(cam.imgWidth, cam.imgHeight);
+        s.stage = QUEUED;
+        tail = (tail + 1) % DEPTH;
+        in_flight++;
+        changed.notify_all();
+    }
+
+    /*  Oldest finished frame, or nullptr while the pipeline is still filling.
+        Must be handed back with release() before the next acquire(). With
+        draining set it waits for any frame in flight instead, returning
+        nullptr only once none is left (to collect the last frames). */
+    const framebuffer *acquire(bool draining = false)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (in_flight < (draining ? 1 : DEPTH))
+            return nullptr;
+
+        slot &s = slots[head];
+        changed.wait(lock, [&] { return s.stage == DONE; });
+        s.stage = PRESENTING;
+        return &s.fb;
+    }
+
+    void release()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        slots[head].stage = FREE;
+        head = (head + 1) % DEPTH;
+        in_flight--;
+        changed.notify_all();
+    }
+
+    // Hardware counters are read on the pipeline threads from the next frame on.
+    void enable_hardware(bool on) { hardware = on; }
+
+    // Stage timings of the frame returned by the last acquire().
+    const frame_stats &stats() const { return slots[head].stats; }
+
+    // Waits for every frame in flight and drops them, e.g. before leaving pipelined mode.
+    void flush()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] {
+            for (const slot &s : slots)
+                if (s.stage == QUEUED || s.stage == RASTER)
+                    return false;
+            return true;
+        });
+        for (slot &s : slots)
+            s.stage = FREE;
+        head = tail;
+        in_flight = 0;
+        changed.notify_all();
+    }
+
+private:
+    enum stage { FREE, QUEUED, RASTER, DONE, PRESENTING };
+
+    struct slot
+    {
+        int stage = FREE;
+        camera cam;
+        std::vector<Obj> objects;
+        frame_geometry geom;
+        framebuffer fb;
+        frame_stats stats;
+
+        int tiles = 0;
+        bool count_hw = false;
+        std::chrono::steady_clock::time_point raster_start;
+        std::atomic<int> next_tile{0};
+        std::atomic<int> jobs_left{0};
+    };
+
+    void transform_loop()
+    {
+        trace_thread_name("frame transform");
+        for (int index = 0;; index = (index + 1) % DEPTH)
+        {
+            slot &s = slots[index];
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&] { return stopping || s.stage == QUEUED; });
+                if (s.stage != QUEUED)
+                    return;
+            }
+
+            const bool counting = hardware;
+            hw_sample hwStart, hwEnd;
+            s.stats.transform_hw = s.stats.raster_hw = hw_sample();
+            if (counting)
+                hw_counters::local().read(hwStart);
+
+            const auto start = std::chrono::steady_clock::now();
+            s.cam.transform_scene(s.objects, s.geom);
+            {
+                TRACE_ZONE("frame_geometry::bin");
+                s.geom.bin(s.fb.width, s.fb.height, TILE_SIZE);
+            }
+            s.raster_start = std::chrono::steady_clock::now();
+            s.stats.transform_ms = std::chrono::duration<double, std::milli>(s.raster_start - start).count();
+            if (counting && hw_counters::local().read(hwEnd))
+                s.stats.transform_hw = hwEnd - hwStart;
+            s.count_hw = counting;
+            s.tiles = s.geom.tile_count();
+            s.next_tile = 0;
+            const int jobs = std::max(1, std::min(s.tiles, (int)pool.size()));
+            s.jobs_left = jobs;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                s.stage = RASTER;
+            }
+
+            for (int i = 0; i < jobs; i++)
+                pool.post([this, &s] { raster_tiles(s); });
+        }
+    }
+
+    /*  Each job pulls tiles until none are left. The last job to run out
+        publishes the frame, so no job touches the slot once it is DONE. */
+    void raster_tiles(slot &s)
+    {
+        hw_sample hwStart, hwEnd;
+        const bool counting = s.count_hw && hw_counters::local().read(hwStart);
+
+        int t;
+        while ((t = s.next_tile++) < s.tiles)
+        {
+            TRACE_ZONE("frame_pipeline::raster_tile");
+            const tile_rect rect = s.geom.tile(t, s.fb.width, s.fb.height);
+            s.fb.clear_rect(rect.minX, rect.minY, rect.maxX, rect.maxY);
+            rasterize(s.geom, t, s.fb, rect, s.cam.specialize);
+        }
+
+        const bool counted = counting && hw_counters::local().read(hwEnd);
+        if (counted)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            s.stats.raster_hw += hwEnd - hwStart;
+        }
+
+        if (--s.jobs_left == 0)
+        {
+            const auto end = std::chrono::steady_clock::now();
+            std::lock_guard<std::mutex> lock(mutex);
+            s.stats.raster_ms = std::chrono::duration<double, std::milli>(end - s.raster_start).count();
+            s.stage = DONE;
+            changed.notify_all();
+        }
+    }
+
+    slot slots[DEPTH];
+    int head = 0, tail = 0, in_flight = 0;
+    bool stopping = false;
+    std::atomic<bool> hardware{false};
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    thread_pool pool;
+    std::thread transformer;
+};
+
+#endif
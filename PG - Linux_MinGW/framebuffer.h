@@ -0,0 +1,49 @@
+#ifndef FRAMEBUFFERH
+#define FRAMEBUFFERH
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+/*  CPU render target. Color is 0xAARRGGBB (SDL_PIXELFORMAT_ARGB8888) and the
+    depth buffer stores 1/w, so bigger means closer and clearing to 0 is "far". */
+class framebuffer
+{
+public:
+    int width, height;
+    std::vector<uint32_t> color;
+    std::vector<float> depth;
+
+    framebuffer() : width(0), height(0) {}
+    framebuffer(int w, int h) { resize(w, h); }
+
+    void resize(int w, int h)
+    {
+        width = w;
+        height = h;
+        color.assign((size_t)w * h, 0xff000000u);
+        depth.assign((size_t)w * h, 0.0f);
+    }
+
+    void clear(uint32_t c = 0xff000000u)
+    {
+        std::fill(color.begin(), color.end(), c);
+        std::fill(depth.begin(), depth.end(), 0.0f);
+    }
+
+    // Clears only [x0, x1) x [y0, y1), so tiles can be cleared by the thread that draws them.
+    void clear_rect(int x0, int y0, int x1, int y1, uint32_t c = 0xff000000u)
+    {
+        for (int y = y0; y < y1; y++)
+        {
+            const size_t row = (size_t)y * width;
+            std::fill(color.begin() + row + x0, color.begin() + row + x1, c);
+            std::fill(depth.begin() + row + x0, depth.begin() + row + x1, 0.0f);
+        }
+    }
+
+    inline void set(int x, int y, uint32_t c) { color[(size_t)y * width + x] = c; }
+    inline uint32_t get(int x, int y) const { return color[(size_t)y * width + x]; }
+};
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef HEADLESSH
+#define HEADLESSH
+
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include "camera.h"
+#include "frame_pipeline.h"
+#include "image_writer.h"
+#include "video_stream.h"
+#include "trace.h"
+
+/*  Offscreen rendering without SDL: the scene is rendered into the CPU
+    framebuffer and each frame is written to disk, with no window, texture
+    upload or UI in the way, so throughput is bound by transform and raster.
+    Frames are encoded and written by an image_writer thread meanwhile, or
+    sent to a video_stream instead of files when one is given. */
+
+struct headless_options
+{
+    int frames = 1;
+    const char *output = "frame";   // files are <output>_0000.<ext>, ...; nullptr writes nothing
+    image_format format = IMAGE_PPM;
+    video_stream *stream = nullptr;  // when set, frames go here and output is ignored
+    bool pipelined = true;
+};
+
+struct headless_result
+{
+    int frames = 0, written = 0;
+    double total_ms = 0;
+};
+
+inline headless_result render_headless(const std::vector<Obj> &objects, const camera &cam, const headless_options &options)
+{
+    TRACE_ZONE("render_headless");
+    headless_result result;
+    image_writer writer;
+    char path[512];
+
+    // Called in frame order by both paths.
+    auto store = [&](const framebuffer &fb) {
+        if (options.stream)
+        {
+            if (&fb != &options.stream->frame())
+                options.stream->frame().color.assign(fb.color.begin(), fb.color.end());
+            options.stream->present();
+        }
+        else if (options.output)
+        {
+            snprintf(path, sizeof(path), "%s_%04d.%s", options.output, result.frames, IMAGE_EXTENSIONS[options.format]);
+            writer.write(fb, path, options.format);
+        }
+        result.frames++;
+    };
+
+    const auto start = std::chrono::steady_clock::now();
+    if (options.pipelined)
+    {
+        frame_pipeline pipeline;
+        for (int i = 0; i < options.frames; i++)
+        {
+            pipeline.submit(cam, objects);
+            if (const framebuffer *fb = pipeline.acquire())
+            {
+                store(*fb);
+                pipeline.release();
+            }
+        }
+        while (const framebuffer *fb = pipeline.acquire(true))
+        {
+            store(*fb);
+            pipeline.release();
+        }
+    }
+    else
+    {
+        framebuffer own(cam.imgWidth, cam.imgHeight);
+        frame_geometry geom;
+        for (int i = 0; i < options.frames; i++)
+        {
+            // a stream's back buffer is rendered into directly, with no copy
+            framebuffer &fb = options.stream ? options.stream->frame() : own;
+            fb.clear();
+            cam.render_scene(objects, fb, geom);
+            store(fb);
+        }
+    }
+    if (options.stream)
+    {
+        options.stream->flush();
+        result.written = (int)options.stream->frames_written();
+    }
+    else
+    {
+        writer.flush();
+        result.written = writer.written();
+    }
+    result.total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+#endif
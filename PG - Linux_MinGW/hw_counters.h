@@ -0,0 +1,159 @@
+#ifndef HWCOUNTERSH
+#define HWCOUNTERSH
+
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+/*  Hardware counters of the calling thread through perf_event_open (Linux).
+    The events are opened as one group so they cover exactly the same
+    instructions, user space only, which works with the default
+    perf_event_paranoid of 2. Events the CPU or hypervisor does not expose
+    are skipped; if even the cycle counter is missing the whole set reports
+    unavailable() with the reason in status(), and every read is a no-op.
+    Elsewhere the class compiles to the unavailable stub. */
+
+enum hw_event
+{
+    HW_CYCLES,
+    HW_INSTRUCTIONS,
+    HW_L1D_MISSES,
+    HW_LLC_MISSES,
+    HW_BRANCH_MISSES,
+    HW_EVENT_COUNT
+};
+
+const char *const HW_EVENT_NAMES[HW_EVENT_COUNT] = { "cycles", "instructions", "L1d misses", "LLC misses", "branch misses" };
+
+struct hw_sample
+{
+    uint64_t values[HW_EVENT_COUNT] = {};
+
+    hw_sample &operator+=(const hw_sample &o)
+    {
+        for (int i = 0; i < HW_EVENT_COUNT; i++)
+            values[i] += o.values[i];
+        return *this;
+    }
+
+    hw_sample operator-(const hw_sample &o) const
+    {
+        hw_sample d;
+        for (int i = 0; i < HW_EVENT_COUNT; i++)
+            d.values[i] = values[i] - o.values[i];
+        return d;
+    }
+
+    double ipc() const { return values[HW_CYCLES] ? (double)values[HW_INSTRUCTIONS] / values[HW_CYCLES] : 0.0; }
+};
+
+class hw_counters
+{
+public:
+    hw_counters()
+    {
+        for (int i = 0; i < HW_EVENT_COUNT; i++)
+            fds[i] = -1;
+        open_group();
+    }
+
+    ~hw_counters()
+    {
+#ifdef __linux__
+        for (int i = HW_EVENT_COUNT - 1; i >= 0; i--)
+            if (fds[i] >= 0)
+                close(fds[i]);
+#endif
+    }
+
+    hw_counters(const hw_counters &) = delete;
+    hw_counters &operator=(const hw_counters &) = delete;
+
+    // The counters of the calling thread, opened on first use.
+    static hw_counters &local()
+    {
+        static thread_local hw_counters counters;
+        return counters;
+    }
+
+    bool available() const { return fds[HW_CYCLES] >= 0; }
+    bool has(hw_event e) const { return fds[e] >= 0; }
+    const char *status() const { return reason; }
+
+    // Running totals since the group was opened, scaled if the kernel had to multiplex it.
+    bool read(hw_sample &out) const
+    {
+#ifdef __linux__
+        if (!available())
+            return false;
+
+        uint64_t data[3 + HW_EVENT_COUNT];  // nr, time enabled, time running, values in open order
+        if (::read(fds[HW_CYCLES], data, sizeof(data)) < (ssize_t)(3 * sizeof(uint64_t)) || data[2] == 0)
+            return false;
+
+        const double scale = (double)data[1] / data[2];
+        uint64_t slot = 3;
+        for (int i = 0; i < HW_EVENT_COUNT; i++)
+            out.values[i] = fds[i] >= 0 && slot < 3 + data[0] ? (uint64_t)(data[slot++] * scale) : 0;
+        return true;
+#else
+        (void)out;
+        return false;
+#endif
+    }
+
+private:
+    void open_group()
+    {
+#ifdef __linux__
+        const uint32_t types[HW_EVENT_COUNT] = { PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE };
+        const uint64_t configs[HW_EVENT_COUNT] = {
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+            PERF_COUNT_HW_CACHE_MISSES,
+            PERF_COUNT_HW_BRANCH_MISSES
+        };
+
+        for (int i = 0; i < HW_EVENT_COUNT; i++)
+        {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = types[i];
+            attr.config = configs[i];
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            attr.disabled = i == HW_CYCLES;   // the leader starts the whole group
+
+            const int leader = i == HW_CYCLES ? -1 : fds[HW_CYCLES];
+            fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+            if (fds[HW_CYCLES] < 0)
+            {
+                snprintf(reason, sizeof(reason), "perf_event_open: %s", strerror(errno));
+                return;
+            }
+        }
+
+        ioctl(fds[HW_CYCLES], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fds[HW_CYCLES], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        snprintf(reason, sizeof(reason), "ok");
+#else
+        snprintf(reason, sizeof(reason), "perf_event_open needs Linux");
+#endif
+    }
+
+    int fds[HW_EVENT_COUNT];
+    char reason[96];
+};
+
+#endif
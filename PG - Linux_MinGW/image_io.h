@@ -0,0 +1,430 @@
+#ifndef IMAGEIOH
+#define IMAGEIOH
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include "framebuffer.h"
+#include "deflate.h"
+#include "thread_pool.h"
+
+/*  Image encoders for saved frames, no outside libraries:
+
+        PPM   P6 RGB, a header and the pixels
+        PAM   P7 RGB_ALPHA, the same with the alpha channel
+        QOI   lossless, one pass, several times smaller than PPM; also read
+          back by decode_qoi(), for stored reference images
+        PNG   RGB, rows filtered per row and compressed in bands that
+              run in parallel on a thread_pool (see deflate.h)
+
+    encode_image() fills a memory buffer, so the same bytes can go to a
+    file, a socket or a pipe. */
+
+enum image_format
+{
+    IMAGE_PPM,
+    IMAGE_PAM,
+    IMAGE_QOI,
+    IMAGE_PNG,
+    IMAGE_FORMAT_COUNT
+};
+
+const char *const IMAGE_EXTENSIONS[IMAGE_FORMAT_COUNT] = { "ppm", "pam", "qoi", "png" };
+
+// By name or extension ("png", "out.png"); false if unknown.
+inline bool image_format_from_name(const char *name, image_format &format)
+{
+    const char *dot = strrchr(name, '.');
+    const char *ext = dot ? dot + 1 : name;
+    for (int f = 0; f < IMAGE_FORMAT_COUNT; f++)
+    {
+        if (strcmp(ext, IMAGE_EXTENSIONS[f]) == 0)
+        {
+            format = (image_format)f;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline void put_u32_be(std::vector<uint8_t> &out, uint32_t v)
+{
+    out.push_back((uint8_t)(v >> 24));
+    out.push_back((uint8_t)(v >> 16));
+    out.push_back((uint8_t)(v >> 8));
+    out.push_back((uint8_t)v);
+}
+
+inline void put_text(std::vector<uint8_t> &out, const char *text)
+{
+    out.insert(out.end(), text, text + strlen(text));
+}
+
+inline void encode_ppm(const framebuffer &fb, std::vector<uint8_t> &out)
+{
+    char header[64];
+    snprintf(header, sizeof(header), "P6\n%d %d\n255\n", fb.width, fb.height);
+    put_text(out, header);
+
+    size_t o = out.size();
+    out.resize(o + fb.color.size() * 3);
+    for (uint32_t c : fb.color)
+    {
+        out[o++] = (uint8_t)(c >> 16);
+        out[o++] = (uint8_t)(c >> 8);
+        out[o++] = (uint8_t)c;
+    }
+}
+
+inline void encode_pam(const framebuffer &fb, std::vector<uint8_t> &out)
+{
+    char header[128];
+    snprintf(header, sizeof(header), "P7\nWIDTH %d\nHEIGHT %d\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n", fb.width, fb.height);
+    put_text(out, header);
+
+    size_t o = out.size();
+    out.resize(o + fb.color.size() * 4);
+    for (uint32_t c : fb.color)
+    {
+        out[o++] = (uint8_t)(c >> 16);
+        out[o++] = (uint8_t)(c >> 8);
+        out[o++] = (uint8_t)c;
+        out[o++] = (uint8_t)(c >> 24);
+    }
+}
+
+// "The Quite OK Image Format" 1.0, written as 3 channels (alpha is always opaque in a frame).
+inline void encode_qoi(const framebuffer &fb, std::vector<uint8_t> &out)
+{
+    put_text(out, "qoif");
+    put_u32_be(out, (uint32_t)fb.width);
+    put_u32_be(out, (uint32_t)fb.height);
+    out.push_back(3);   // channels
+    out.push_back(0);   // sRGB with linear alpha
+
+    uint32_t index[64] = {};
+    uint32_t previous = 0xff000000u;    // r, g, b = 0, a = 255, packed like the framebuffer
+    int run = 0;
+    const size_t count = fb.color.size();
+    for (size_t i = 0; i < count; i++)
+    {
+        const uint32_t c = fb.color[i] | 0xff000000u;
+        if (c == previous)
+        {
+            if (++run == 62 || i + 1 == count)
+            {
+                out.push_back((uint8_t)(0xc0 | (run - 1)));     // QOI_OP_RUN
+                run = 0;
+            }
+            continue;
+        }
+        if (run > 0)
+        {
+            out.push_back((uint8_t)(0xc0 | (run - 1)));
+            run = 0;
+        }
+
+        const int r = (c >> 16) & 0xff, g = (c >> 8) & 0xff, b = c & 0xff;
+        const int slot = (r * 3 + g * 5 + b * 7 + 255 * 11) % 64;
+        if (index[slot] == c)
+            out.push_back((uint8_t)slot);                       // QOI_OP_INDEX
+        else
+        {
+            index[slot] = c;
+            const int8_t dr = (int8_t)(r - (int)((previous >> 16) & 0xff));
+            const int8_t dg = (int8_t)(g - (int)((previous >> 8) & 0xff));
+            const int8_t db = (int8_t)(b - (int)(previous & 0xff));
+            const int drg = dr - dg, dbg = db - dg;
+            if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                out.push_back((uint8_t)(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));     // QOI_OP_DIFF
+            else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7)
+            {
+                out.push_back((uint8_t)(0x80 | (dg + 32)));                                     // QOI_OP_LUMA
+                out.push_back((uint8_t)((drg + 8) << 4 | (dbg + 8)));
+            }
+            else
+            {
+                out.push_back(0xfe);                                                            // QOI_OP_RGB
+                out.push_back((uint8_t)r);
+                out.push_back((uint8_t)g);
+                out.push_back((uint8_t)b);
+            }
+        }
+        previous = c;
+    }
+    static const uint8_t end[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    out.insert(out.end(), end, end + 8);
+}
+
+// Any QOI 1.0 image into fb (resized to fit); false if data is not one.
+inline bool decode_qoi(const uint8_t *data, size_t size, framebuffer &fb)
+{
+    if (size < 22 || memcmp(data, "qoif", 4) != 0)
+        return false;
+    const uint32_t width = (uint32_t)data[4] << 24 | data[5] << 16 | data[6] << 8 | data[7];
+    const uint32_t height = (uint32_t)data[8] << 24 | data[9] << 16 | data[10] << 8 | data[11];
+    if (width == 0 || height == 0 || width > 16384 || height > 16384)
+        return false;
+    fb.resize((int)width, (int)height);
+
+    uint32_t index[64] = {};
+    uint32_t c = 0xff000000u;
+    size_t p = 14;
+    const size_t end = size - 8;
+    int run = 0;
+    for (uint32_t &pixel : fb.color)
+    {
+        if (run > 0)
+            run--;
+        else
+        {
+            if (p >= end)
+                return false;
+            const uint8_t op = data[p++];
+            int r = (c >> 16) & 0xff, g = (c >> 8) & 0xff, b = c & 0xff, a = c >> 24;
+            if (op == 0xfe || op == 0xff)
+            {
+                if (p + (op == 0xff ? 4 : 3) > end)
+                    return false;
+                r = data[p++];
+                g = data[p++];
+                b = data[p++];
+                if (op == 0xff)
+                    a = data[p++];
+            }
+            else if ((op >> 6) == 0)
+            {
+                pixel = c = index[op];
+                continue;
+            }
+            else if ((op >> 6) == 1)
+            {
+                r += ((op >> 4) & 3) - 2;
+                g += ((op >> 2) & 3) - 2;
+                b += (op & 3) - 2;
+            }
+            else if ((op >> 6) == 2)
+            {
+                if (p >= end)
+                    return false;
+                const int dg = (op & 0x3f) - 32;
+                r += dg - 8 + (data[p] >> 4);
+                g += dg;
+                b += dg - 8 + (data[p] & 0x0f);
+                p++;
+            }
+            else
+                run = op & 0x3f;    // this pixel plus run more
+            c = (uint32_t)(a & 0xff) << 24 | (uint32_t)(r & 0xff) << 16 | (uint32_t)(g & 0xff) << 8 | (uint32_t)(b & 0xff);
+            index[(((c >> 16) & 0xff) * 3 + ((c >> 8) & 0xff) * 5 + (c & 0xff) * 7 + (c >> 24) * 11) % 64] = c;
+        }
+        pixel = c;
+    }
+    return true;
+}
+
+inline uint32_t crc32(const uint8_t *data, size_t size, uint32_t crc = 0)
+{
+    struct table
+    {
+        uint32_t values[256];
+        table()
+        {
+            for (uint32_t n = 0; n < 256; n++)
+            {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++)
+                    c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                values[n] = c;
+            }
+        }
+    };
+    static const table t;
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = t.values[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+// Length, type, data and CRC; the data is whatever was appended to out after begin.
+inline void png_chunk_end(std::vector<uint8_t> &out, size_t begin)
+{
+    const uint32_t length = (uint32_t)(out.size() - begin - 8);
+    out[begin + 0] = (uint8_t)(length >> 24);
+    out[begin + 1] = (uint8_t)(length >> 16);
+    out[begin + 2] = (uint8_t)(length >> 8);
+    out[begin + 3] = (uint8_t)length;
+    put_u32_be(out, crc32(out.data() + begin + 4, length + 4));
+}
+
+inline size_t png_chunk_begin(std::vector<uint8_t> &out, const char *type)
+{
+    const size_t begin = out.size();
+    put_u32_be(out, 0);
+    put_text(out, type);
+    return begin;
+}
+
+/*  One filtered scanline (filter byte + RGB) of row y into dst, picking the
+    filter with the smallest sum of absolute values, as libpng does. */
+inline void png_filter_row(const framebuffer &fb, int y, uint8_t *dst, std::vector<uint8_t> &scratch)
+{
+    const int stride = fb.width * 3;
+    scratch.resize((size_t)stride * 2 + 6);
+    uint8_t *row = scratch.data() + 3, *above = row + stride + 3;   // 3 zero bytes before each, for "left"
+    memset(scratch.data(), 0, 3);
+    memset(above - 3, 0, 3);
+    for (int x = 0; x < fb.width; x++)
+    {
+        const uint32_t c = fb.get(x, y);
+        row[x * 3 + 0] = (uint8_t)(c >> 16);
+        row[x * 3 + 1] = (uint8_t)(c >> 8);
+        row[x * 3 + 2] = (uint8_t)c;
+        const uint32_t u = y > 0 ? fb.get(x, y - 1) : 0;
+        above[x * 3 + 0] = (uint8_t)(u >> 16);
+        above[x * 3 + 1] = (uint8_t)(u >> 8);
+        above[x * 3 + 2] = (uint8_t)u;
+    }
+
+    auto predict = [&](int filter, int i) -> uint8_t {
+        const int a = row[i - 3], b = above[i], c = above[i - 3];
+        switch (filter)
+        {
+        case 1: return (uint8_t)a;
+        case 2: return (uint8_t)b;
+        case 3: return (uint8_t)((a + b) >> 1);
+        case 4:
+        {
+            const int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+            return (uint8_t)(pa <= pb && pa <= pc ? a : pb <= pc ? b : c);
+        }
+        default: return 0;
+        }
+    };
+
+    int best = 0;
+    long bestCost = -1;
+    for (int filter = 0; filter < 5; filter++)
+    {
+        long cost = 0;
+        for (int i = 0; i < stride; i++)
+            cost += abs((int)(int8_t)(uint8_t)(row[i] - predict(filter, i)));
+        if (bestCost < 0 || cost < bestCost)
+        {
+            best = filter;
+            bestCost = cost;
+        }
+    }
+    dst[0] = (uint8_t)best;
+    for (int i = 0; i < stride; i++)
+        dst[i + 1] = (uint8_t)(row[i] - predict(best, i));
+}
+
+/*  PNG, 8-bit RGB. With a pool the rows are split in bands that are
+    filtered and deflated in parallel, one independent piece each, then
+    stitched into a single zlib stream. */
+inline void encode_png(const framebuffer &fb, std::vector<uint8_t> &out, thread_pool *pool = nullptr)
+{
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    out.insert(out.end(), signature, signature + 8);
+
+    size_t chunk = png_chunk_begin(out, "IHDR");
+    put_u32_be(out, (uint32_t)fb.width);
+    put_u32_be(out, (uint32_t)fb.height);
+    const uint8_t format[5] = { 8, 2, 0, 0, 0 };    // depth, RGB, deflate, adaptive filters, no interlace
+    out.insert(out.end(), format, format + 5);
+    png_chunk_end(out, chunk);
+
+    const size_t rowBytes = (size_t)fb.width * 3 + 1;
+    const int bands = pool ? std::max(1, std::min(fb.height / 16, (int)pool->size() + 1)) : 1;
+    const int rowsPerBand = (fb.height + bands - 1) / bands;
+    struct band
+    {
+        std::vector<uint8_t> filtered, compressed, scratch;
+        uint32_t adler = 1;
+    };
+    std::vector<band> pieces(bands);
+
+    auto run = [&](size_t b) {
+        band &p = pieces[b];
+        const int y0 = (int)b * rowsPerBand, y1 = std::min(fb.height, y0 + rowsPerBand);
+        p.filtered.resize(rowBytes * std::max(0, y1 - y0));
+        for (int y = y0; y < y1; y++)
+            png_filter_row(fb, y, &p.filtered[(y - y0) * rowBytes], p.scratch);
+        deflate_band(p.filtered.data(), p.filtered.size(), b + 1 == (size_t)bands, p.compressed);
+        p.adler = adler32(p.filtered.data(), p.filtered.size());
+    };
+    if (pool && bands > 1)
+        pool->parallel_for(bands, run);
+    else
+        for (int b = 0; b < bands; b++)
+            run(b);
+
+    chunk = png_chunk_begin(out, "IDAT");
+    out.push_back(0x78);    // zlib: deflate, 32K window
+    out.push_back(0x01);    // fastest compression level, header check
+    uint32_t adler = 1;
+    for (const band &p : pieces)
+    {
+        out.insert(out.end(), p.compressed.begin(), p.compressed.end());
+        adler = adler32_combine(adler, p.adler, p.filtered.size());
+    }
+    put_u32_be(out, adler);
+    png_chunk_end(out, chunk);
+
+    png_chunk_end(out, png_chunk_begin(out, "IEND"));
+}
+
+// Appends the encoded image to out; pool only speeds up PNG.
+inline void encode_image(const framebuffer &fb, image_format format, std::vector<uint8_t> &out, thread_pool *pool = nullptr)
+{
+    switch (format)
+    {
+    case IMAGE_PAM: encode_pam(fb, out); break;
+    case IMAGE_QOI: encode_qoi(fb, out); break;
+    case IMAGE_PNG: encode_png(fb, out, pool); break;
+    default: encode_ppm(fb, out); break;
+    }
+}
+
+inline bool write_file(const char *path, const std::vector<uint8_t> &data)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+    const bool written = fwrite(data.data(), 1, data.size(), f) == data.size();
+    return fclose(f) == 0 && written;
+}
+
+inline bool read_file(const char *path, std::vector<uint8_t> &data)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+    data.clear();
+    uint8_t chunk[65536];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+        data.insert(data.end(), chunk, chunk + n);
+    const bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+// Encodes and writes in the calling thread; returns false if the file cannot be written.
+inline bool write_image(const char *path, const framebuffer &fb, image_format format, thread_pool *pool = nullptr)
+{
+    std::vector<uint8_t> data;
+    encode_image(fb, format, data, pool);
+    return write_file(path, data);
+}
+
+inline bool write_ppm(const char *path, const framebuffer &fb)
+{
+    return write_image(path, fb, IMAGE_PPM);
+}
+
+#endif
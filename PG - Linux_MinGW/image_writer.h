@@ -0,0 +1,120 @@
+#ifndef IMAGEWRITERH
+#define IMAGEWRITERH
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "image_io.h"
+#include "trace.h"
+
+/*  Saves frames on a background I/O thread. write() copies the pixels into
+    one of capacity preallocated slots and returns; the thread encodes and
+    writes the slots in order. When every slot is taken write() waits, so a
+    slow disk throttles the producer instead of growing memory without
+    bound. PNG bands are compressed on the writer's own pool. */
+class image_writer
+{
+public:
+    explicit image_writer(size_t capacity = 4, unsigned encodeThreads = 0) : slots(capacity), pool(encodeThreads)
+    {
+        worker = std::thread([this] { run(); });
+    }
+
+    ~image_writer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        changed.notify_all();
+        worker.join();
+    }
+
+    image_writer(const image_writer &) = delete;
+    image_writer &operator=(const image_writer &) = delete;
+
+    // Queues fb to be written to path; may be called from several threads.
+    void write(const framebuffer &fb, const std::string &path, image_format format)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return queued < slots.size(); });
+        slot &s = slots[(first + queued) % slots.size()];
+        s.image.width = fb.width;
+        s.image.height = fb.height;
+        s.image.color.assign(fb.color.begin(), fb.color.end());
+        s.path = path;
+        s.format = format;
+        queued++;
+        changed.notify_all();
+    }
+
+    // Waits until every queued image is on disk.
+    void flush()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return queued == 0; });
+    }
+
+    int written() const { return succeeded; }
+    int failed() const { return failures; }
+
+private:
+    struct slot
+    {
+        framebuffer image;      // depth stays empty, only color is copied
+        std::string path;
+        image_format format = IMAGE_PPM;
+    };
+
+    void run()
+    {
+        trace_thread_name("image writer");
+        std::vector<uint8_t> encoded;
+        while (true)
+        {
+            slot *s;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&] { return stopping || queued > 0; });
+                if (queued == 0)
+                    return;
+                s = &slots[first];  // stays ours: write() only fills slots past the queued ones
+            }
+
+            {
+                TRACE_ZONE("image_writer::encode");
+                encoded.clear();
+                encode_image(s->image, s->format, encoded, &pool);
+            }
+            if (write_file(s->path.c_str(), encoded))
+                succeeded++;
+            else
+            {
+                fprintf(stderr, "cannot write %s\n", s->path.c_str());
+                failures++;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                first = (first + 1) % slots.size();
+                queued--;
+            }
+            changed.notify_all();
+        }
+    }
+
+    std::vector<slot> slots;    // ring of queued images starting at first
+    size_t first = 0, queued = 0;
+    bool stopping = false;
+    std::atomic<int> succeeded{0}, failures{0};
+
+    thread_pool pool;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::thread worker;
+};
+
+#endif
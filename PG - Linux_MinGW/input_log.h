@@ -0,0 +1,273 @@
+#ifndef INPUTLOGH
+#define INPUTLOGH
+
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+/*  Input of an interactive session, frame by frame, so it can be played
+    back with the same camera moves and UI clicks for comparable profiles.
+
+    The log is a header followed by one record per frame:
+        "INPL" u32 version
+        frame:  f32 delta seconds, i16 mouse x, i16 mouse y, u8 buttons,
+                u16 event count, then the events
+        event:  u8 type, then per type
+                key down/up     i32 key, u8 repeat
+                button down/up  u8 button, i16 x, i16 y
+                motion          i16 x, i16 y, i16 xrel, i16 yrel
+                wheel           i16 x, i16 y
+                quit            -
+    All little endian. The mouse state is what the frame read before
+    building the UI; the events are the ones handled at its end. Events
+    are our own copy of the SDL fields the loop uses, so the format does
+    not depend on SDL's struct layout. */
+
+enum input_event_type
+{
+    INPUT_KEY_DOWN = 1,
+    INPUT_KEY_UP,
+    INPUT_BUTTON_DOWN,
+    INPUT_BUTTON_UP,
+    INPUT_MOTION,
+    INPUT_WHEEL,
+    INPUT_QUIT,
+};
+
+struct input_event
+{
+    uint8_t type = 0;
+    int32_t key = 0;
+    uint8_t repeat = 0, button = 0;
+    int16_t x = 0, y = 0, xrel = 0, yrel = 0;
+};
+
+struct input_frame
+{
+    float delta = 0;
+    int16_t mouse_x = 0, mouse_y = 0;
+    uint8_t buttons = 0;
+};
+
+const uint32_t INPUT_LOG_VERSION = 1;
+
+class input_recorder
+{
+public:
+    ~input_recorder() { close(); }
+
+    bool open(const char *path)
+    {
+        file = fopen(path, "wb");
+        if (!file)
+            return false;
+        fwrite("INPL", 1, 4, file);
+        record.clear();
+        put_u32(INPUT_LOG_VERSION);
+        flush_record();
+        return true;
+    }
+
+    void close()
+    {
+        if (file)
+            fclose(file);
+        file = nullptr;
+    }
+
+    bool is_open() const { return file != nullptr; }
+
+    void begin_frame(const input_frame &frame)
+    {
+        record.clear();
+        put_f32(frame.delta);
+        put_u16((uint16_t)frame.mouse_x);
+        put_u16((uint16_t)frame.mouse_y);
+        record.push_back(frame.buttons);
+        count_at = record.size();
+        put_u16(0);     // patched by end_frame
+        events = 0;
+    }
+
+    void add(const input_event &e)
+    {
+        if (events == 0xffff)
+            return;
+        events++;
+        record.push_back(e.type);
+        switch (e.type)
+        {
+        case INPUT_KEY_DOWN:
+        case INPUT_KEY_UP:
+            put_u32((uint32_t)e.key);
+            record.push_back(e.repeat);
+            break;
+        case INPUT_BUTTON_DOWN:
+        case INPUT_BUTTON_UP:
+            record.push_back(e.button);
+            put_u16((uint16_t)e.x);
+            put_u16((uint16_t)e.y);
+            break;
+        case INPUT_MOTION:
+            put_u16((uint16_t)e.x);
+            put_u16((uint16_t)e.y);
+            put_u16((uint16_t)e.xrel);
+            put_u16((uint16_t)e.yrel);
+            break;
+        case INPUT_WHEEL:
+            put_u16((uint16_t)e.x);
+            put_u16((uint16_t)e.y);
+            break;
+        }
+    }
+
+    void end_frame()
+    {
+        record[count_at] = (uint8_t)events;
+        record[count_at + 1] = (uint8_t)(events >> 8);
+        flush_record();
+    }
+
+private:
+    void put_u16(uint16_t v)
+    {
+        record.push_back((uint8_t)v);
+        record.push_back((uint8_t)(v >> 8));
+    }
+
+    void put_u32(uint32_t v)
+    {
+        put_u16((uint16_t)v);
+        put_u16((uint16_t)(v >> 16));
+    }
+
+    void put_f32(float f)
+    {
+        uint32_t v;
+        memcpy(&v, &f, 4);
+        put_u32(v);
+    }
+
+    void flush_record()
+    {
+        if (file)
+            fwrite(record.data(), 1, record.size(), file);
+    }
+
+    FILE *file = nullptr;
+    std::vector<uint8_t> record;    // the frame being built; keeps its capacity
+    size_t count_at = 0;
+    unsigned events = 0;
+};
+
+// Reads a whole log up front and hands it back frame by frame.
+class input_replay
+{
+public:
+    bool open(const char *path)
+    {
+        FILE *f = fopen(path, "rb");
+        if (!f)
+            return false;
+        data.clear();
+        uint8_t chunk[65536];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+            data.insert(data.end(), chunk, chunk + n);
+        fclose(f);
+        at = 8;
+        remaining = 0;
+        return data.size() >= 8 && memcmp(data.data(), "INPL", 4) == 0 && read_u32(4) == INPUT_LOG_VERSION;
+    }
+
+    bool is_open() const { return !data.empty(); }
+
+    // Moves to the next frame; false at the end of the log (or at a truncated frame).
+    bool next_frame(input_frame &frame)
+    {
+        while (remaining > 0)   // skip events the caller did not take
+        {
+            input_event e;
+            if (!next_event(e))
+                return false;
+        }
+        if (at + 11 > data.size())
+            return false;
+        uint32_t delta = read_u32(at);
+        memcpy(&frame.delta, &delta, 4);
+        frame.mouse_x = (int16_t)read_u16(at + 4);
+        frame.mouse_y = (int16_t)read_u16(at + 6);
+        frame.buttons = data[at + 8];
+        remaining = read_u16(at + 9);
+        at += 11;
+        frames++;
+        return true;
+    }
+
+    // The next event of the current frame; false when the frame has no more.
+    bool next_event(input_event &e)
+    {
+        if (remaining == 0 || at >= data.size())
+            return false;
+        e = input_event();
+        e.type = data[at];
+        size_t size = 0;
+        switch (e.type)
+        {
+        case INPUT_KEY_DOWN: case INPUT_KEY_UP: size = 5; break;
+        case INPUT_BUTTON_DOWN: case INPUT_BUTTON_UP: size = 5; break;
+        case INPUT_MOTION: size = 8; break;
+        case INPUT_WHEEL: size = 4; break;
+        case INPUT_QUIT: size = 0; break;
+        default: remaining = 0; at = data.size(); return false;     // corrupt, stop here
+        }
+        if (at + 1 + size > data.size())
+        {
+            remaining = 0;
+            at = data.size();
+            return false;
+        }
+        const size_t p = at + 1;
+        switch (e.type)
+        {
+        case INPUT_KEY_DOWN:
+        case INPUT_KEY_UP:
+            e.key = (int32_t)read_u32(p);
+            e.repeat = data[p + 4];
+            break;
+        case INPUT_BUTTON_DOWN:
+        case INPUT_BUTTON_UP:
+            e.button = data[p];
+            e.x = (int16_t)read_u16(p + 1);
+            e.y = (int16_t)read_u16(p + 3);
+            break;
+        case INPUT_MOTION:
+            e.x = (int16_t)read_u16(p);
+            e.y = (int16_t)read_u16(p + 2);
+            e.xrel = (int16_t)read_u16(p + 4);
+            e.yrel = (int16_t)read_u16(p + 6);
+            break;
+        case INPUT_WHEEL:
+            e.x = (int16_t)read_u16(p);
+            e.y = (int16_t)read_u16(p + 2);
+            break;
+        }
+        at = p + size;
+        remaining--;
+        return true;
+    }
+
+    uint64_t frames_read() const { return frames; }
+
+private:
+    uint16_t read_u16(size_t p) const { return (uint16_t)(data[p] | data[p + 1] << 8); }
+    uint32_t read_u32(size_t p) const { return read_u16(p) | (uint32_t)read_u16(p + 2) << 16; }
+
+    std::vector<uint8_t> data;
+    size_t at = 0;
+    unsigned remaining = 0;     // events left in the current frame
+    uint64_t frames = 0;
+};
+
+#endif
@@ -0,0 +1,387 @@
+#ifndef LODH
+#define LODH
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "object.h"
+#include "mesh_optimize.h"
+#include "trace.h"
+
+/*  Level of detail chain for an indexed mesh, built at load time:
+
+        simplify()      quadric error edge collapse (Garland and Heckbert
+                        1997) down to a triangle budget; a vertex always
+                        collapses onto a neighbour, so the coarser index
+                        list reuses the vertices it started from
+        build_lods()    about 4 levels, each near half the triangles of
+                        the one before, in Mesh::lods
+
+    Vertices where uvs split (seams), on open borders or on non-manifold
+    edges never move, so silhouettes of holes and texture seams hold.
+    Collapses are made in passes: every candidate edge is costed and
+    sorted, then taken cheapest first as long as no triangle around the
+    moving vertex was changed earlier in the pass or would flip. A pass
+    ends once the next candidate costs well over one it had to skip, which
+    may be cheap again after the re-costing of the next pass.
+
+    After the chain is built the vertex buffer is ordered coarsest level
+    first, so level k only uses vertices [0, lods[k - 1].vertex_count) and
+    the camera transforms just that prefix. The error of a level bounds
+    how far (in object units) its surface is from the input: a collapse
+    adds how far it moved the faces around its vertex off their planes to
+    what earlier collapses had moved them there. The camera turns it into
+    pixels to pick a level. */
+
+namespace lod_detail
+{
+    // Symmetric 4x4 plane quadric: a2 ab ac ad b2 bc bd c2 cd d2.
+    struct quadric
+    {
+        double q[10] = {};
+
+        void add_plane(double a, double b, double c, double d)
+        {
+            q[0] += a * a; q[1] += a * b; q[2] += a * c; q[3] += a * d;
+            q[4] += b * b; q[5] += b * c; q[6] += b * d;
+            q[7] += c * c; q[8] += c * d;
+            q[9] += d * d;
+        }
+
+        void add(const quadric &o)
+        {
+            for (int i = 0; i < 10; i++)
+                q[i] += o.q[i];
+        }
+
+        // Sum of squared distances of p to the planes.
+        double error(const vec3 &p) const
+        {
+            const double x = p.x(), y = p.y(), z = p.z();
+            const double e = q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x +
+                             q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y +
+                             q[7] * z * z + 2 * q[8] * z + q[9];
+            return std::max(e, 0.0);
+        }
+    };
+
+    struct position_hash
+    {
+        size_t operator()(const vec3 &p) const
+        {
+            uint32_t b[3];
+            memcpy(b, &p, sizeof(b));
+            return (size_t)(b[0] * 73856093u ^ b[1] * 19349663u ^ b[2] * 83492791u);
+        }
+    };
+
+    struct position_equal
+    {
+        bool operator()(const vec3 &a, const vec3 &b) const { return a.x() == b.x() && a.y() == b.y() && a.z() == b.z(); }
+    };
+
+    struct collapse
+    {
+        double cost;
+        uint32_t from, to;
+        bool operator<(const collapse &o) const
+        {
+            return cost != o.cost ? cost < o.cost : from != o.from ? from < o.from : to < o.to;
+        }
+    };
+}
+
+struct simplify_result
+{
+    std::vector<uint32_t> indices;
+    float error = 0;    // bound on the distance from the input surface
+};
+
+/*  Collapses edges of the triangles in indices until at most targetTris
+    remain, or until nothing more can collapse. previousError carries the
+    error of the level the indices came from. */
+inline simplify_result simplify(const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices, size_t targetTris,
+                                float previousError = 0)
+{
+    using namespace lod_detail;
+    TRACE_ZONE("simplify");
+    const size_t n = vertices.size();
+    simplify_result result;
+    result.indices = indices;
+    result.error = previousError;
+    if (n == 0 || indices.empty())
+        return result;
+
+    // vertices at one position form a class; more than one member means a uv seam
+    std::vector<uint32_t> klass(n);
+    std::vector<uint32_t> classSize;
+    {
+        std::unordered_map<vec3, uint32_t, position_hash, position_equal> byPosition;
+        byPosition.reserve(n);
+        for (size_t v = 0; v < n; v++)
+        {
+            // + 0 folds -0 onto 0 before hashing the bits
+            auto found = byPosition.emplace(vertices[v].pos + vec3(0, 0, 0), (uint32_t)classSize.size());
+            if (found.second)
+                classSize.push_back(0);
+            klass[v] = found.first->second;
+            classSize[klass[v]]++;
+        }
+    }
+    const size_t classes = classSize.size();
+
+    // plane quadrics per class, and the edges of each class pair to find borders
+    std::vector<quadric> quadrics(classes);
+    std::vector<uint8_t> locked(classes, 0);
+    std::unordered_map<uint64_t, uint32_t> edgeUse;
+    edgeUse.reserve(indices.size());
+    for (size_t t = 0; t < indices.size(); t += 3)
+    {
+        const vec3 &p0 = vertices[indices[t]].pos, &p1 = vertices[indices[t + 1]].pos, &p2 = vertices[indices[t + 2]].pos;
+        vec3 normal = cross(p1 - p0, p2 - p0);
+        const float length = normal.length();
+        if (length > 0)
+        {
+            normal /= length;
+            const double d = -dot(normal, p0);
+            for (int c = 0; c < 3; c++)
+                quadrics[klass[indices[t + c]]].add_plane(normal.x(), normal.y(), normal.z(), d);
+        }
+        for (int c = 0; c < 3; c++)
+        {
+            uint64_t a = klass[indices[t + c]], b = klass[indices[t + (c + 1) % 3]];
+            if (a > b)
+                std::swap(a, b);
+            edgeUse[a << 32 | b]++;
+        }
+    }
+    for (const auto &e : edgeUse)
+    {
+        if (e.second != 2)
+        {
+            locked[e.first >> 32] = 1;
+            locked[e.first & 0xffffffffu] = 1;
+        }
+    }
+    for (size_t c = 0; c < classes; c++)
+        if (classSize[c] > 1)
+            locked[c] = 1;
+    std::unordered_map<uint64_t, uint32_t>().swap(edgeUse);
+
+    std::vector<uint32_t> remap(n), first(n + 1), around, touched(n);
+    std::vector<collapse> candidates;
+    size_t triCount = result.indices.size() / 3;
+    uint32_t pass = 0;
+    // how far the surface around each vertex may be from the input; starts at the level the indices came from
+    std::vector<float> moved(n, previousError);
+    float worst = previousError;
+
+    // quadric costs are squared distances; below this they are rounding noise
+    vec3 lo = vertices[0].pos, hi = lo;
+    for (const Vertex &v : vertices)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            lo[k] = std::min(lo[k], v.pos[k]);
+            hi[k] = std::max(hi[k], v.pos[k]);
+        }
+    }
+    const float extent = std::max(hi[0] - lo[0], std::max(hi[1] - lo[1], hi[2] - lo[2]));
+    const double noise = 1e-10 * extent * extent;
+
+    while (triCount > targetTris)
+    {
+        pass++;
+        std::vector<uint32_t> &ix = result.indices;
+
+        // triangles around each vertex
+        std::fill(first.begin(), first.end(), 0);
+        for (uint32_t v : ix)
+            first[v + 1]++;
+        for (size_t v = 0; v < n; v++)
+            first[v + 1] += first[v];
+        around.resize(ix.size());
+        {
+            std::vector<uint32_t> cursor(first.begin(), first.end() - 1);
+            for (size_t i = 0; i < ix.size(); i++)
+                around[cursor[ix[i]]++] = (uint32_t)(i / 3);
+        }
+
+        candidates.clear();
+        for (size_t t = 0; t < ix.size(); t += 3)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                const uint32_t a = ix[t + c], b = ix[t + (c + 1) % 3];
+                quadric q = quadrics[klass[a]];
+                q.add(quadrics[klass[b]]);
+                if (!locked[klass[a]])
+                    candidates.push_back(collapse{ q.error(vertices[b].pos), a, b });
+                if (!locked[klass[b]])
+                    candidates.push_back(collapse{ q.error(vertices[a].pos), b, a });
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+
+        for (size_t v = 0; v < n; v++)
+            remap[v] = (uint32_t)v;
+        size_t removed = 0;
+        const size_t wanted = triCount - targetTris;
+        double blocked = -1;    // cost of the cheapest collapse this pass had to pass over
+        for (const collapse &c : candidates)
+        {
+            if (removed >= wanted)
+                break;
+            // much dearer than one waiting for the next pass: leave it for a later pass too
+            if (blocked >= 0 && c.cost > 4 * blocked + noise)
+                break;
+            if (c.from == c.to)
+                continue;
+            if (touched[c.from] == pass || touched[c.to] == pass)
+            {
+                if (blocked < 0)
+                    blocked = c.cost;
+                continue;
+            }
+
+            // moving from onto to must not turn any remaining triangle around
+            const vec3 &target = vertices[c.to].pos;
+            bool flips = false;
+            size_t dropped = 0;
+            float distance = 0;     // farthest the move takes a kept triangle off its plane
+            for (uint32_t k = first[c.from]; k < first[c.from + 1] && !flips; k++)
+            {
+                const uint32_t *tri = &ix[3 * around[k]];
+                if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to)
+                {
+                    dropped++;
+                    continue;
+                }
+                vec3 p[3], q[3];
+                for (int i = 0; i < 3; i++)
+                {
+                    p[i] = vertices[tri[i]].pos;
+                    q[i] = tri[i] == c.from ? target : p[i];
+                }
+                const vec3 before = cross(p[1] - p[0], p[2] - p[0]), after = cross(q[1] - q[0], q[2] - q[0]);
+                flips = dot(before, after) <= 0.25f * before.length() * after.length();
+                // a sliver's normal is noise; the faces around it hold the plane
+                const float longest = std::max((p[1] - p[0]).length(), std::max((p[2] - p[1]).length(), (p[0] - p[2]).length()));
+                if (before.length() > 1e-4f * longest * longest)
+                    distance = std::max(distance, std::fabs(dot(before, target - vertices[c.from].pos)) / before.length());
+            }
+            if (flips || dropped == 0)
+                continue;
+
+            remap[c.from] = c.to;
+            quadrics[klass[c.to]].add(quadrics[klass[c.from]]);
+            removed += dropped;
+            // every vertex of the triangles that moved now borders surface up to this far from the input
+            const float reach = moved[c.from] + distance;
+            worst = std::max(worst, reach);
+            touched[c.from] = touched[c.to] = pass;
+            moved[c.to] = std::max(moved[c.to], reach);
+            for (uint32_t k = first[c.from]; k < first[c.from + 1]; k++)
+            {
+                for (int i = 0; i < 3; i++)
+                {
+                    const uint32_t v = ix[3 * around[k] + i];
+                    touched[v] = pass;
+                    moved[v] = std::max(moved[v], reach);
+                }
+            }
+        }
+        if (removed == 0)
+            break;
+
+        size_t kept = 0;
+        for (size_t t = 0; t < ix.size(); t += 3)
+        {
+            const uint32_t a = remap[ix[t]], b = remap[ix[t + 1]], c = remap[ix[t + 2]];
+            if (a == b || b == c || a == c)
+                continue;
+            ix[kept++] = a;
+            ix[kept++] = b;
+            ix[kept++] = c;
+        }
+        ix.resize(kept);
+        if (kept / 3 == triCount)
+            break;
+        triCount = kept / 3;
+    }
+    result.error = worst;
+    return result;
+}
+
+const int LOD_LEVELS = 4;
+
+/*  Fills mesh.lods with up to levels coarser index lists, each aiming at
+    ratio times the triangles of the one before; stops early when a level
+    cannot get below 90% of the previous one. Run after weld() and
+    optimize_mesh(), before Mesh::quantize(). */
+inline void build_lods(Mesh &mesh, int levels = LOD_LEVELS, float ratio = 0.5f)
+{
+    TRACE_ZONE("build_lods");
+    mesh.lods.clear();
+    if (!mesh.indexed() || mesh.vertices.empty())
+        return;
+
+    const std::vector<uint32_t> *previous = &mesh.indices;
+    float error = 0;
+    for (int level = 0; level < levels; level++)
+    {
+        const size_t tris = previous->size() / 3;
+        simplify_result simplified = simplify(mesh.vertices, *previous, (size_t)(tris * ratio), error);
+        if (simplified.indices.size() / 3 > tris * 9 / 10 || simplified.indices.empty())
+            break;
+        mesh_lod lod;
+        const std::vector<uint32_t> order = tipsify(simplified.indices, mesh.vertices.size());
+        lod.indices.resize(simplified.indices.size());
+        for (size_t t = 0; t < order.size(); t++)
+            std::copy(&simplified.indices[3 * order[t]], &simplified.indices[3 * order[t]] + 3, &lod.indices[3 * t]);
+        lod.error = error = simplified.error;
+        mesh.lods.push_back(std::move(lod));
+        previous = &mesh.lods.back().indices;
+    }
+
+    // coarsest level's vertices first, keeping the first-use order inside each band
+    const size_t n = mesh.vertices.size();
+    std::vector<uint8_t> coarsest(n, 0);
+    for (size_t level = 0; level < mesh.lods.size(); level++)
+        for (uint32_t v : mesh.lods[level].indices)
+            coarsest[v] = (uint8_t)(level + 1);
+    std::vector<uint32_t> order(n);
+    for (size_t v = 0; v < n; v++)
+        order[v] = (uint32_t)v;
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return coarsest[a] > coarsest[b]; });
+
+    std::vector<uint32_t> remap(n);
+    std::vector<Vertex> vertices(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        remap[order[i]] = (uint32_t)i;
+        vertices[i] = mesh.vertices[order[i]];
+    }
+    mesh.vertices.swap(vertices);
+    for (uint32_t &v : mesh.indices)
+        v = remap[v];
+    for (uint32_t &v : mesh.meshlet_vertices)
+        v = remap[v];
+    for (size_t level = 0; level < mesh.lods.size(); level++)
+    {
+        uint32_t used = 0;
+        for (uint32_t &v : mesh.lods[level].indices)
+        {
+            v = remap[v];
+            used = std::max(used, v + 1);
+        }
+        mesh.lods[level].vertex_count = used;
+    }
+    if (mesh.quantized())
+        mesh.quantize(true);    // packed follows the new order
+}
+
+#endif
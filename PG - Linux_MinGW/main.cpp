@@ -1,14 +1,347 @@
 
 #include <string>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <thread>
 #include <math.h>
 #include "camera.h" 
+#include "frame_pipeline.h"
+#include "resolution_scaler.h"
+#include "upscale.h"
+#include "profiler.h"
+#include "trace.h"
+#include "counters.h"
+#include "headless.h"
+#include "video_stream.h"
+#include "input_log.h"
+#include "weld.h"
+#include "mesh_optimize.h"
+#include "lod.h"
+#include "meshlet.h"
+#include "mesh_registry.h"
+#include "scene_loader.h"
+#include "scene_generator.h"
+#define ALLOC_HOOK_IMPLEMENTATION
+#include "alloc_hook.h"
+
+#ifdef _WIN32 || WIN32
+#include <SDL.h>
+#elif defined(__unix__)
+#include <SDL2/SDL.h>
+#endif
 
 #include "ImGUI/imgui_sdl.h"
 #include "ImGUI/imgui.h"
 
 
+// frames rendered before --alloc-assert arms, enough for every buffer to reach its working size;
+// counted again from the last mesh swapped in, which grows them
+const uint64_t ALLOC_WARMUP_FRAMES = 120;
+
+// SDL events the loop reacts to, as kept in an input log; false for the others.
+static bool to_input_event(const SDL_Event& e, input_event& in)
+{
+	switch (e.type) {
+	case SDL_KEYDOWN:
+	case SDL_KEYUP:
+		in.type = e.type == SDL_KEYDOWN ? INPUT_KEY_DOWN : INPUT_KEY_UP;
+		in.key = e.key.keysym.sym;
+		in.repeat = e.key.repeat;
+		return true;
+	case SDL_MOUSEBUTTONDOWN:
+	case SDL_MOUSEBUTTONUP:
+		in.type = e.type == SDL_MOUSEBUTTONDOWN ? INPUT_BUTTON_DOWN : INPUT_BUTTON_UP;
+		in.button = e.button.button;
+		in.x = (int16_t)e.button.x;
+		in.y = (int16_t)e.button.y;
+		return true;
+	case SDL_MOUSEMOTION:
+		in.type = INPUT_MOTION;
+		in.x = (int16_t)e.motion.x;
+		in.y = (int16_t)e.motion.y;
+		in.xrel = (int16_t)e.motion.xrel;
+		in.yrel = (int16_t)e.motion.yrel;
+		return true;
+	case SDL_MOUSEWHEEL:
+		in.type = INPUT_WHEEL;
+		in.x = (int16_t)e.wheel.x;
+		in.y = (int16_t)e.wheel.y;
+		return true;
+	case SDL_QUIT:
+		in.type = INPUT_QUIT;
+		return true;
+	}
+	return false;
+}
+
+static void to_sdl_event(const input_event& in, SDL_Event& e)
+{
+	memset(&e, 0, sizeof(e));
+	switch (in.type) {
+	case INPUT_KEY_DOWN:
+	case INPUT_KEY_UP:
+		e.type = in.type == INPUT_KEY_DOWN ? SDL_KEYDOWN : SDL_KEYUP;
+		e.key.state = in.type == INPUT_KEY_DOWN ? SDL_PRESSED : SDL_RELEASED;
+		e.key.repeat = in.repeat;
+		e.key.keysym.sym = in.key;
+		break;
+	case INPUT_BUTTON_DOWN:
+	case INPUT_BUTTON_UP:
+		e.type = in.type == INPUT_BUTTON_DOWN ? SDL_MOUSEBUTTONDOWN : SDL_MOUSEBUTTONUP;
+		e.button.state = in.type == INPUT_BUTTON_DOWN ? SDL_PRESSED : SDL_RELEASED;
+		e.button.button = in.button;
+		e.button.x = in.x;
+		e.button.y = in.y;
+		break;
+	case INPUT_MOTION:
+		e.type = SDL_MOUSEMOTION;
+		e.motion.x = in.x;
+		e.motion.y = in.y;
+		e.motion.xrel = in.xrel;
+		e.motion.yrel = in.yrel;
+		break;
+	case INPUT_WHEEL:
+		e.type = SDL_MOUSEWHEEL;
+		e.wheel.x = in.x;
+		e.wheel.y = in.y;
+		break;
+	default:
+		e.type = SDL_QUIT;
+		break;
+	}
+}
+
+/*  --weld [EPS] merges the duplicate corners of the loaded meshes into
+    shared vertices (weld.h), positions within EPS (1e-6) and matching uvs,
+    so each vertex is transformed once per frame. --optimize also reorders
+    them for vertex reuse (mesh_optimize.h), --lod [PIXELS] builds levels
+    of detail (lod.h) drawn while their error stays under PIXELS (1),
+    --meshlets splits them into clusters the camera culls on their own
+    (meshlet.h), and --quantize keeps only 16-bit vertices (quantize.h);
+    all weld first. --mesh PATH adds a mesh to the scene in place of the
+    default monkey, and may be repeated; --instances N places N copies of
+    each on a grid, sharing one prepared mesh (mesh_registry.h). */
+static float parse_lod_pixels(int argc, char* argv[])
+{
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--lod") == 0)
+			return i + 1 < argc && argv[i + 1][0] != '-' ? (float)atof(argv[i + 1]) : 1.0f;
+	}
+	return 0.0f;
+}
+
+/*  The meshes load on loader's threads (scene_loader.h); objects gets
+    boxes at once and the meshes as loader.poll() swaps them in. The grid
+    is laid out on the first mesh's box. */
+static void load_scene(int argc, char* argv[], scene_loader& loader, std::vector<Obj>& objects)
+{
+	// no texture assets ship with the project, so use a procedural checkerboard
+	std::shared_ptr<texture> checker = texture::checkerboard(256, 16, 0xffe0e0e0, 0xff3070c0);
+
+	bool welding = false, optimizing = false, quantizing = false, clustering = false;
+	size_t instances = 1;
+	std::vector<std::string> paths;
+	weld_options options;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--weld") == 0) {
+			welding = true;
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				options.epsilon = options.uv_epsilon = (float)atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--optimize") == 0)
+			optimizing = true;
+		else if (strcmp(argv[i], "--quantize") == 0)
+			quantizing = true;
+		else if (strcmp(argv[i], "--meshlets") == 0)
+			clustering = true;
+		else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc)
+			instances = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--mesh") == 0 && i + 1 < argc)
+			paths.push_back(argv[++i]);
+	}
+	if (paths.empty())
+		paths.push_back("./objects/monkey_smooth.obj");
+	const bool lod = parse_lod_pixels(argc, argv) > 0;
+
+	// runs on a loader thread, one job per mesh, so the meshes are welded and their LODs built in parallel;
+	// a job may not wait on its own pool, so each mesh's passes run serially
+	auto prepare = [=](Mesh& mesh) {
+		const weld_stats stats = weld(mesh, options);
+		fprintf(stderr, "welded %zu corners into %zu vertices\n", stats.corners, stats.vertices);
+		if (optimizing || lod) {
+			const mesh_optimize_stats reorder = optimize_mesh(mesh);
+			fprintf(stderr, "vertex reuse: acmr %.3f -> %.3f (cache of %d)\n", reorder.acmr_before, reorder.acmr_after, reorder.cache_size);
+		}
+		if (lod) {
+			build_lods(mesh);
+			for (size_t k = 0; k < mesh.lods.size(); k++)
+				fprintf(stderr, "lod %zu: %zu triangles, %u vertices, error %g\n", k + 1, mesh.lods[k].indices.size() / 3,
+					mesh.lods[k].vertex_count, mesh.lods[k].error);
+		}
+		if (clustering) {
+			build_meshlets(mesh);
+			fprintf(stderr, "meshlets: %zu for %zu triangles\n", mesh.meshlets.size(), mesh.triangle_count());
+		}
+		if (quantizing) {
+			const size_t before = mesh.memory_bytes();
+			mesh.quantize();
+			fprintf(stderr, "quantized: %zu -> %zu bytes\n", before, mesh.memory_bytes());
+		}
+	};
+	const bool preparing = welding || optimizing || quantizing || lod || clustering;
+
+	const mesh_handle cell = loader.placeholder(paths[0]);
+	const size_t count = paths.size() * instances;
+	for (size_t k = 0; k < count; k++) {
+		matrix44 model;
+		const vec3 offset = count > 1 ? grid_offset(*cell, count, 1.5f, k) : vec3(0, 0, 0);
+		for (int axis = 0; axis < 3; axis++)
+			model[3][axis] = offset[axis];
+		loader.add(objects, paths[k % paths.size()], model, checker, preparing ? mesh_registry::prepare_fn(prepare) : nullptr);
+	}
+}
+
+/*  --stream PATH sends every frame to an encoder through stdout ("-") or a
+    FIFO, in either mode:
+        --stream-format F   raw (framebuffer bytes, BGRA) or y4m (raw)
+        --fps N             frame rate in the y4m header (30)
+        --stream-blocking   wait for a slow consumer instead of dropping frames */
+struct stream_options
+{
+	const char* path = nullptr;
+	video_format format = VIDEO_RAW;
+	int fps = 30;
+	bool blocking = false;
+};
+
+static bool parse_stream_options(int argc, char* argv[], stream_options& options)
+{
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--stream") == 0 && i + 1 < argc)
+			options.path = argv[++i];
+		else if (strcmp(argv[i], "--stream-format") == 0 && i + 1 < argc) {
+			if (!video_format_from_name(argv[++i], options.format)) {
+				fprintf(stderr, "unknown stream format %s\n", argv[i]);
+				return false;
+			}
+		}
+		else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc)
+			options.fps = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--stream-blocking") == 0)
+			options.blocking = true;
+	}
+	return true;
+}
+
+/*  --headless renders the scene with the startup camera straight to image
+    files, without initializing SDL:
+        --frames N        frames to render (1)
+        --size WxH        image size (the window size)
+        --output PREFIX   writes PREFIX_0000.ppm, ... (frame)
+        --format FORMAT   ppm, pam, qoi or png (ppm)
+        --no-write        render only, to measure throughput
+        --immediate       one frame at a time instead of frame_pipeline
+    With --stream, frames go to the stream instead of image files. */
+static int run_headless(int argc, char* argv[])
+{
+	headless_options options;
+	int width = WIDTH, height = HEIGHT;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			options.frames = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+			sscanf(argv[++i], "%dx%d", &width, &height);
+		else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+			options.output = argv[++i];
+		else if (strcmp(argv[i], "--no-write") == 0)
+			options.output = nullptr;
+		else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+			if (!image_format_from_name(argv[++i], options.format)) {
+				fprintf(stderr, "unknown format %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--immediate") == 0)
+			options.pipelined = false;
+	}
+	if (width <= 0 || height <= 0) {
+		fprintf(stderr, "bad --size\n");
+		return 1;
+	}
+	stream_options streamOptions;
+	if (!parse_stream_options(argc, argv, streamOptions))
+		return 1;
+
+	trace_thread_name("main");
+	// the frames written are the same however fast the meshes load
+	mesh_registry registry;
+	std::vector<Obj> objects;
+	{
+		// nothing is drawn before the meshes are in, so each core can prepare one (weld, LODs, ...)
+		scene_loader loader(registry, std::max(2u, std::thread::hardware_concurrency()));
+		load_scene(argc, argv, loader, objects);
+		loader.wait(objects);
+	}
+	if (objects.size() > 1)
+		fprintf(stderr, "%zu objects of %zu meshes, %zu bytes of mesh data\n", objects.size(), registry.size(), registry.memory_bytes());
+	camera cam(vec3(0, 0, 5), vec3(0, 0, -1), vec3(0, 1, 0), 90.0f, 1.f, 50.0f, width, height);
+	lod_history lods;
+	cam.lod_pixels = parse_lod_pixels(argc, argv);
+	cam.lod_memory = &lods;
+
+	std::unique_ptr<video_stream> stream;
+	if (streamOptions.path) {
+		stream.reset(new video_stream(streamOptions.path, streamOptions.format, width, height, streamOptions.fps, streamOptions.blocking));
+		if (!stream->ok())
+			return 1;
+		options.stream = stream.get();
+	}
+
+	const headless_result result = render_headless(objects, cam, options);
+	const double perFrame = result.frames ? result.total_ms / result.frames : 0.0;
+	// stdout may be carrying the video
+	fprintf(stream ? stderr : stdout, "%d frames %dx%d, %d written: %.3f ms/frame, %.1f frames/s\n", result.frames, width, height,
+		result.written, perFrame, perFrame > 0 ? 1000.0 / perFrame : 0.0);
+	if (stream)
+		return stream->ok() ? 0 : 1;
+	return options.output && result.written != result.frames ? 1 : 0;
+}
+
 int main(int argc, char* argv[])
 {
+	bool allocAssert = false; // abort on any allocation once warmed up; needs -DALLOC_HOOK
+	// --record FILE logs the session's input; --replay FILE plays one back with a fixed
+	// time step of 1/--replay-fps (60) seconds, as fast as it renders, then quits
+	const char* recordPath = nullptr;
+	const char* replayPath = nullptr;
+	float replayStep = 1.0f / 60.0f;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--headless") == 0)
+			return run_headless(argc, argv);
+		if (strcmp(argv[i], "--alloc-assert") == 0)
+			allocAssert = true;
+		else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+			recordPath = argv[++i];
+		else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+			replayPath = argv[++i];
+		else if (strcmp(argv[i], "--replay-fps") == 0 && i + 1 < argc)
+			replayStep = 1.0f / std::max(1, atoi(argv[++i]));
+	}
+	input_recorder recorder;
+	input_replay replay;
+	if (replayPath && !replay.open(replayPath)) {
+		fprintf(stderr, "cannot read input log %s\n", replayPath);
+		return 1;
+	}
+	if (recordPath && !replay.is_open() && !recorder.open(recordPath)) {
+		fprintf(stderr, "cannot write input log %s\n", recordPath);
+		return 1;
+	}
+	stream_options streamOptions;
+	if (!parse_stream_options(argc, argv, streamOptions))
+		return 1;
+
     if (SDL_Init(SDL_INIT_EVERYTHING) == 0) {
 
 		SDL_Window* window = SDL_CreateWindow("Projeto PG - Grupo X", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WIDTH, HEIGHT, SDL_WINDOW_ALLOW_HIGHDPI);
@@ -18,30 +351,113 @@ int main(int argc, char* argv[])
             SDL_bool done = SDL_FALSE;
 			SDL_SetRelativeMouseMode(SDL_FALSE);
             
+			// drawn from the first frame, boxes standing in for the meshes still loading
+			mesh_registry registry;
 			std::vector<Obj> objects;
-            objects.push_back( Obj("./objects/monkey_smooth.obj") );
+			// a recorded session replays frame for frame only if no mesh arrives at a load-speed-dependent frame,
+			// so it waits for them with a core per mesh; otherwise two loader threads leave the rest to the frames
+			const bool waitForMeshes = replay.is_open() || recorder.is_open();
+			scene_loader loader(registry, waitForMeshes ? std::max(2u, std::thread::hardware_concurrency()) : 2);
+			load_scene(argc, argv, loader, objects);
+			if (waitForMeshes)
+				loader.wait(objects);
+
+			framebuffer fb(WIDTH, HEIGHT);
+			frame_pipeline pipeline; // transform and raster threads for the pipelined mode
+			bool pipelined = true;
+
+			// internal resolution follows the frame time budget, the window stays WIDTH x HEIGHT
+			resolution_scaler scaler;
+			bool dynamicResolution = false;
+			double renderMs = 0;
+
+			frame_profiler profiler;
+			frame_geometry geometry; // transform output of the immediate path
+			int plotted = frame_profiler::FRAME;
+			bool hardwareCounters = false;
+			float deltaTime = 1.0f / 60.0f;
+			const char* traceStatus = "";
+
+			frame_counters counters;
+			uint64_t warmupStart = 0; // frame the allocation warmup counts from
+			FILE* counterDump = nullptr; // counters.jsonl, one line per frame while open
+			bool dumpCounters = false;
+			trace_thread_name("main");
+
+			// records what the window shows, at window size
+			std::unique_ptr<video_stream> stream;
+			if (streamOptions.path)
+				stream.reset(new video_stream(streamOptions.path, streamOptions.format, WIDTH, HEIGHT, streamOptions.fps, streamOptions.blocking));
+			SDL_Texture* screen = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, WIDTH, HEIGHT);
 
+#ifdef ALLOC_HOOK
+			ImGui::SetAllocatorFunctions(alloc_tracked, alloc_release);
+#endif
 			ImGui::CreateContext();
 			ImGuiSDL::Initialize(renderer, WIDTH, HEIGHT);
+			// a saved layout would move the widgets a log clicks on
+			if (recorder.is_open() || replay.is_open())
+				ImGui::GetIO().IniFilename = nullptr;
 
             camera cam(vec3(0, 0, 5), vec3(0, 0, -1), vec3(0, 1, 0), 90.0f, 1.f, 50.0f, WIDTH, HEIGHT);
+			lod_history lods;
+			cam.lod_pixels = parse_lod_pixels(argc, argv);
+			cam.lod_memory = &lods;
 
-			float my_color[4];
+			float my_color[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
 			bool my_tool_active;
 
+			// input comes from SDL, and goes to the log when recording, or from the log being replayed
+			auto poll_event = [&](SDL_Event& e) {
+				input_event in;
+				if (replay.is_open()) {
+					if (!replay.next_event(in))
+						return false;
+					to_sdl_event(in, e);
+					return true;
+				}
+				if (!SDL_PollEvent(&e))
+					return false;
+				if (recorder.is_open() && to_input_event(e, in))
+					recorder.add(in);
+				return true;
+			};
+			const auto loopStart = std::chrono::steady_clock::now();
+
             while (!done) {
+				TRACE_ZONE("main::frame");
                 SDL_Event event;
 				ImGuiIO& io = ImGui::GetIO();
-                std::clock_t then = std::clock();
 
-				int mouseX, mouseY;
-				const int buttons = SDL_GetMouseState(&mouseX, &mouseY);
+				{
+					frame_profiler::scope zone(profiler, STAGE_INPUT);
+					int mouseX, mouseY, buttons;
+					input_frame frame;
+					if (replay.is_open()) {
+						if (!replay.next_frame(frame))
+							break; // the log has played out
+						mouseX = frame.mouse_x;
+						mouseY = frame.mouse_y;
+						buttons = frame.buttons;
+					}
+					else {
+						buttons = SDL_GetMouseState(&mouseX, &mouseY);
+						if (recorder.is_open()) {
+							frame.delta = deltaTime;
+							frame.mouse_x = (int16_t)mouseX;
+							frame.mouse_y = (int16_t)mouseY;
+							frame.buttons = (uint8_t)buttons;
+							recorder.begin_frame(frame);
+						}
+					}
 
-				io.DeltaTime = 1.0f / 60.0f;
-				io.MousePos = ImVec2(static_cast<float>(mouseX), static_cast<float>(mouseY));
-				io.MouseDown[0] = buttons & SDL_BUTTON(SDL_BUTTON_LEFT);
-				io.MouseDown[1] = buttons & SDL_BUTTON(SDL_BUTTON_RIGHT);
+					io.DeltaTime = deltaTime;
+					io.MousePos = ImVec2(static_cast<float>(mouseX), static_cast<float>(mouseY));
+					io.MouseDown[0] = buttons & SDL_BUTTON(SDL_BUTTON_LEFT);
+					io.MouseDown[1] = buttons & SDL_BUTTON(SDL_BUTTON_RIGHT);
+				}
 
+				profiler.begin(STAGE_UI_BUILD);
 				ImGui::NewFrame();
 			
 				// Create a window called "My First Tool", with a menu bar.
@@ -60,9 +476,104 @@ int main(int argc, char* argv[])
 
 				// Edit a color (stored as ~4 floats)
 				ImGui::ColorEdit4("Color", my_color);
-				// Plot some values
-				const float my_values[] = { 0.2f, 0.1f, 1.0f, 0.5f, 0.9f, 2.2f };
-				ImGui::PlotLines("Frame Times", my_values, IM_ARRAYSIZE(my_values));
+				// Frame times of the last frames, whole frame or a single stage
+				char overlay[32];
+				snprintf(overlay, sizeof(overlay), "%.2f ms", profiler.last(plotted));
+				ImGui::PlotLines("Frame Times", profiler.history(plotted), frame_profiler::HISTORY, profiler.offset(), overlay, 0.0f, FLT_MAX, ImVec2(0, 60));
+				ImGui::Combo("Plot", &plotted, "Input\0UI build\0Clear\0Transform\0Raster\0UI render\0Present\0Frame\0");
+
+				ImGui::Columns(5, "stages");
+				ImGui::Text("ms"); ImGui::NextColumn();
+				ImGui::Text("last"); ImGui::NextColumn();
+				ImGui::Text("p50"); ImGui::NextColumn();
+				ImGui::Text("p95"); ImGui::NextColumn();
+				ImGui::Text("p99"); ImGui::NextColumn();
+				for (int i = 0; i <= STAGE_COUNT; i++) {
+					ImGui::Text("%s", i < STAGE_COUNT ? STAGE_NAMES[i] : "frame"); ImGui::NextColumn();
+					ImGui::Text("%.2f", profiler.last(i)); ImGui::NextColumn();
+					ImGui::Text("%.2f", profiler.percentile(i, 50)); ImGui::NextColumn();
+					ImGui::Text("%.2f", profiler.percentile(i, 95)); ImGui::NextColumn();
+					ImGui::Text("%.2f", profiler.percentile(i, 99)); ImGui::NextColumn();
+				}
+				ImGui::Columns(1);
+
+				// cycles, IPC and misses per stage of the last frame, from perf_event_open
+				if (ImGui::Checkbox("Hardware counters", &hardwareCounters)) {
+					hardwareCounters = profiler.enable_hardware(hardwareCounters) && hardwareCounters;
+					pipeline.enable_hardware(hardwareCounters);
+				}
+				if (!hw_counters::local().available()) {
+					ImGui::SameLine();
+					ImGui::TextDisabled("(%s)", hw_counters::local().status());
+				}
+				if (profiler.hardware_enabled()) {
+					ImGui::Columns(6, "hardware");
+					ImGui::Text("stage"); ImGui::NextColumn();
+					ImGui::Text("Mcycles"); ImGui::NextColumn();
+					ImGui::Text("IPC"); ImGui::NextColumn();
+					ImGui::Text("L1d miss"); ImGui::NextColumn();
+					ImGui::Text("LLC miss"); ImGui::NextColumn();
+					ImGui::Text("br miss"); ImGui::NextColumn();
+					for (int i = 0; i <= STAGE_COUNT; i++) {
+						const hw_sample& hw = profiler.hardware_counts(i);
+						ImGui::Text("%s", i < STAGE_COUNT ? STAGE_NAMES[i] : "frame"); ImGui::NextColumn();
+						ImGui::Text("%.2f", hw.values[HW_CYCLES] / 1e6); ImGui::NextColumn();
+						if (hw_counters::local().has(HW_INSTRUCTIONS)) ImGui::Text("%.2f", hw.ipc()); else ImGui::TextDisabled("n/a");
+						ImGui::NextColumn();
+						for (int e = HW_L1D_MISSES; e < HW_EVENT_COUNT; e++) {
+							if (hw_counters::local().has((hw_event)e)) ImGui::Text("%llu", (unsigned long long)hw.values[e]); else ImGui::TextDisabled("n/a");
+							ImGui::NextColumn();
+						}
+					}
+					ImGui::Columns(1);
+				}
+				// Work done by the previous frame, summed over every thread
+				for (int i = 0; i < COUNTER_COUNT; i++)
+					ImGui::Text("%-26s %10llu", COUNTER_NAMES[i], (unsigned long long)counters[i]);
+				if (ImGui::Checkbox("Dump counters to counters.jsonl", &dumpCounters)) {
+					if (dumpCounters)
+						counterDump = fopen("counters.jsonl", "a");
+					else if (counterDump) {
+						fclose(counterDump);
+						counterDump = nullptr;
+					}
+					dumpCounters = counterDump != nullptr;
+				}
+
+				// switching modes allocates the new path's buffers, so do it before this arms
+				if (ALLOC_HOOK_ENABLED)
+					ImGui::Checkbox("Fail on frame allocations", &allocAssert);
+
+				if (ImGui::Button("Save trace")) {
+					alloc_permit permit;
+					traceStatus = trace_export("trace.json") ? "wrote trace.json" : "trace not written";
+				}
+				ImGui::SameLine();
+				ImGui::Text("%s", traceStatus);
+				if (stream)
+					ImGui::Text("Stream %s: %llu written, %llu dropped", stream->ok() ? "open" : "closed",
+						(unsigned long long)stream->frames_written(), (unsigned long long)stream->frames_dropped());
+
+				// Pipeline state; each combination maps to its own specialized draw
+				ImGui::Combo("Cull", &cam.state.cull, "None\0Back\0Front\0");
+				ImGui::Combo("Shading", &cam.state.shade, "Flat\0Lambert\0Textured\0");
+				ImGui::Checkbox("Depth test", &cam.state.depth_test);
+				ImGui::SameLine();
+				ImGui::Checkbox("Blend", &cam.state.blend);
+				ImGui::SameLine();
+				ImGui::Checkbox("Wireframe", &cam.state.wireframe);
+				ImGui::Checkbox("Specialized pipeline", &cam.specialize);
+				ImGui::SliderFloat("LOD error px", &cam.lod_pixels, 0.0f, 8.0f);
+				if (loader.pending())
+					ImGui::Text("Loading %zu of %zu objects", loader.pending(), objects.size());
+				if (ImGui::Checkbox("Pipelined frames", &pipelined) && !pipelined)
+					pipeline.flush();
+				if (ImGui::Checkbox("Dynamic resolution", &dynamicResolution))
+					scaler.reset();
+				ImGui::SliderFloat("Target ms", &scaler.target_ms, 2.0f, 33.0f);
+				ImGui::Text("Scale %.2f (%dx%d)  render %.2f ms", scaler.scale(), cam.imgWidth, cam.imgHeight, renderMs);
+				cam.state.color = ((uint32_t)(my_color[3] * 255) << 24) | ((uint32_t)(my_color[0] * 255) << 16)
+								| ((uint32_t)(my_color[1] * 255) << 8) | (uint32_t)(my_color[2] * 255);
 
 				// Display contents in a scrolling region
 				ImGui::TextColored(ImVec4(1,1,0,1), "Important Stuff");
@@ -70,31 +581,108 @@ int main(int argc, char* argv[])
 				ImGui::Text("Random Message\n");
 				ImGui::EndChild();
 				ImGui::End();
+				profiler.end(STAGE_UI_BUILD);
+
+				// meshes that finished loading replace their boxes from this frame on
+				if (loader.poll(objects))
+					warmupStart = counters.index();
 
-				SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
-				SDL_RenderClear(renderer); // clear previous frame generated image
+				int renderWidth = WIDTH, renderHeight = HEIGHT;
+				if (dynamicResolution)
+					scaler.size(WIDTH, HEIGHT, renderWidth, renderHeight);
+				if (cam.imgWidth != renderWidth || cam.imgHeight != renderHeight) {
+					cam.imgWidth = renderWidth;
+					cam.imgHeight = renderHeight;
+					cam.update_frustum();
+				}
+
+				const framebuffer* shown = nullptr;
+				if (pipelined) {
+					// queue this frame and show the previous one once it is rasterized
+					pipeline.submit(cam, objects);
+					shown = pipeline.acquire();
+					if (shown) {
+						// measured on the pipeline threads; clearing is part of each raster tile
+						renderMs = std::max(pipeline.stats().transform_ms, pipeline.stats().raster_ms);
+						profiler.add(STAGE_TRANSFORM, (float)pipeline.stats().transform_ms);
+						profiler.add(STAGE_RASTER, (float)pipeline.stats().raster_ms);
+						profiler.add(STAGE_TRANSFORM, pipeline.stats().transform_hw);
+						profiler.add(STAGE_RASTER, pipeline.stats().raster_hw);
+					}
+				}
+				else {
+					if (fb.width != renderWidth || fb.height != renderHeight)
+						fb.resize(renderWidth, renderHeight);
+					auto start = std::chrono::steady_clock::now();
+					{
+						frame_profiler::scope zone(profiler, STAGE_CLEAR);
+						fb.clear(); // clear previous frame generated image
+					}
+					{
+						frame_profiler::scope zone(profiler, STAGE_TRANSFORM);
+						cam.transform_scene(objects, geometry);
+					}
+					{
+						frame_profiler::scope zone(profiler, STAGE_RASTER);
+						cam.rasterize_scene(geometry, fb); // rasterize triangle data onto the framebuffer
+					}
+					renderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+					shown = &fb;
+				}
 
-                cam.render_scene(objects, renderer); // feed triangle data onto renderer
+				profiler.begin(STAGE_PRESENT);
+				if (shown) {
+					// stretch the internal resolution over the window texture
+					void* pixels;
+					int pitch;
+					if (SDL_LockTexture(screen, nullptr, &pixels, &pitch) == 0) {
+						upscale_bilinear(*shown, pixels, WIDTH, HEIGHT, pitch);
+						SDL_UnlockTexture(screen);
+					}
+					if (stream && stream->ok()) {
+						upscale_bilinear(*shown, stream->frame().color.data(), WIDTH, HEIGHT, WIDTH * sizeof(uint32_t));
+						stream->present();
+					}
+					if (pipelined)
+						pipeline.release();
+					if (dynamicResolution)
+						scaler.update(renderMs, (float)shown->width / WIDTH);
+				}
+				SDL_RenderCopy(renderer, screen, nullptr, nullptr);
+				profiler.end(STAGE_PRESENT);
 
-				ImGui::Render();
-				ImGuiSDL::Render(ImGui::GetDrawData());
-                SDL_RenderPresent(renderer); // present the generated triangle data onto screen
+				{
+					frame_profiler::scope zone(profiler, STAGE_UI_RENDER);
+					ImGui::Render();
+					ImGuiSDL::Render(ImGui::GetDrawData());
+				}
+				{
+					frame_profiler::scope zone(profiler, STAGE_PRESENT);
+					SDL_RenderPresent(renderer); // present the generated triangle data onto screen
+				}
 
-                while (SDL_PollEvent(&event)) {
+				profiler.begin(STAGE_INPUT);
+				if (replay.is_open()) {
+					// the window still has to answer; only closing it counts
+					while (SDL_PollEvent(&event))
+						if (event.type == SDL_QUIT)
+							done = SDL_TRUE;
+				}
+                while (poll_event(event)) {
 
 					if( event.type == SDL_KEYDOWN){
 						if( event.key.keysym.sym == SDLK_d ) {
-							cam._from.e[0] -= 0.01;
-							cam._at.e[0] -=0.01;
-							cam.camToWorld.x[3][0] -=0.01;
-							cam.worldToCamera = cam.camToWorld.inverse();
-						}
-						else if( event.key.keysym.sym == SDLK_a ){
 							cam._from.e[0] += 0.01;
 							cam._at.e[0] +=0.01;
 							cam.camToWorld.x[3][0] +=0.01;
 							cam.worldToCamera = cam.camToWorld.inverse();
 						}
+						else if( event.key.keysym.sym == SDLK_a ){
+							cam._from.e[0] -= 0.01;
+							cam._at.e[0] -=0.01;
+							cam.camToWorld.x[3][0] -=0.01;
+							cam.worldToCamera = cam.camToWorld.inverse();
+						}
 						if( event.key.keysym.sym == SDLK_s ){
 							cam._from.e[2] += 0.01;
 							cam._at.e[2] +=  0.01;
@@ -158,7 +746,31 @@ int main(int argc, char* argv[])
                         done = SDL_TRUE;
 					
                 }
+				if (recorder.is_open())
+					recorder.end_frame();
+				profiler.end(STAGE_INPUT);
+				deltaTime = profiler.end_frame();
+				if (replay.is_open())
+					deltaTime = replayStep;
+				counters.end_frame();
+				if (counterDump)
+					counters.write_json(counterDump);
+				if (allocAssert != alloc_forbidden() && loader.pending() == 0 && counters.index() - warmupStart >= ALLOC_WARMUP_FRAMES)
+					alloc_forbid(allocAssert);
             }
+			alloc_forbid(false);
+
+			if (replay.is_open()) {
+				const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - loopStart).count();
+				const uint64_t frames = replay.frames_read();
+				fprintf(stderr, "replayed %llu frames in %.3f s, %.3f ms/frame; frame ms p50 %.3f p95 %.3f p99 %.3f (last %d)\n",
+					(unsigned long long)frames, seconds, frames ? 1000.0 * seconds / frames : 0.0, profiler.percentile(frame_profiler::FRAME, 50),
+					profiler.percentile(frame_profiler::FRAME, 95), profiler.percentile(frame_profiler::FRAME, 99), frame_profiler::HISTORY);
+			}
+
+			if (counterDump)
+				fclose(counterDump);
+			SDL_DestroyTexture(screen);
         }
 
         if (renderer) {
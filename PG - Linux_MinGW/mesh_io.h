@@ -0,0 +1,189 @@
+#ifndef MESHIOH
+#define MESHIOH
+
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include "object.h"
+
+/*  Writes meshes one triangle at a time, so generated scenes larger than
+    memory can be saved (scene_generator.h). Two formats:
+
+        obj     v / vt / f lines, three new vertices per triangle; readable
+                anywhere, but slow to write and load past a few million
+        mesh    the native format read by Mesh::load_mesh_binary:
+                "MESH" u32 version, u64 triangle count, f32 bounds[6], then
+                per triangle 3 x (f32 x, y, z, u, v), all little endian
+
+    The native count and bounds are only known at the end, so close()
+    seeks back and fills them in. */
+
+enum mesh_file_format
+{
+    MESH_FILE_OBJ,
+    MESH_FILE_NATIVE,
+};
+
+// From the extension: .mesh is native, anything else OBJ.
+inline mesh_file_format mesh_file_format_for(const char *path)
+{
+    const char *dot = strrchr(path, '.');
+    return dot && strcmp(dot, ".mesh") == 0 ? MESH_FILE_NATIVE : MESH_FILE_OBJ;
+}
+
+class mesh_writer
+{
+public:
+    ~mesh_writer() { close(); }
+
+    bool open(const char *path, mesh_file_format fmt)
+    {
+        close();
+        file = fopen(path, "wb");
+        if (!file)
+            return false;
+        format = fmt;
+        count = 0;
+        good = true;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            bounds[2 * axis] = 1e30f;
+            bounds[2 * axis + 1] = -1e30f;
+        }
+        buffer.clear();
+        if (format == MESH_FILE_NATIVE)
+            buffer.resize(MESH_FILE_HEADER);    // placeholder, rewritten by close()
+        else
+            put("# generated by scene_gen\n");
+        return true;
+    }
+
+    void add(const Triangle &t)
+    {
+        for (const Vertex &v : t.vertex)
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                bounds[2 * axis] = std::min(bounds[2 * axis], v.pos[axis]);
+                bounds[2 * axis + 1] = std::max(bounds[2 * axis + 1], v.pos[axis]);
+            }
+        }
+        if (format == MESH_FILE_NATIVE)
+        {
+            for (const Vertex &v : t.vertex)
+            {
+                const float f[5] = { v.pos[0], v.pos[1], v.pos[2], v.uv[0], v.uv[1] };
+                put_bytes(f, sizeof(f));
+            }
+        }
+        else
+        {
+            // %.9g round-trips a float; the loader flips v back
+            char line[160];
+            for (const Vertex &v : t.vertex)
+                put(line, snprintf(line, sizeof(line), "v %.9g %.9g %.9g\n", v.pos[0], v.pos[1], v.pos[2]));
+            for (const Vertex &v : t.vertex)
+                put(line, snprintf(line, sizeof(line), "vt %.9g %.9g\n", v.uv[0], 1.0f - v.uv[1]));
+            const unsigned long long base = 3 * count;
+            put(line, snprintf(line, sizeof(line), "f %llu/%llu %llu/%llu %llu/%llu\n", base + 1, base + 1, base + 2, base + 2,
+                base + 3, base + 3));
+        }
+        count++;
+        if (buffer.size() >= FLUSH_AT)
+            flush();
+    }
+
+    // Finishes the file; false if any write failed.
+    bool close()
+    {
+        if (!file)
+            return good;
+        flush();
+        if (format == MESH_FILE_NATIVE)
+        {
+            if (count == 0)
+                std::fill(bounds, bounds + 6, 0.0f);
+            uint8_t header[MESH_FILE_HEADER];
+            memcpy(header, "MESH", 4);
+            const uint32_t version = MESH_FILE_VERSION;
+            memcpy(header + 4, &version, 4);
+            memcpy(header + 8, &count, 8);
+            memcpy(header + 16, bounds, 24);
+            good = good && fseek(file, 0, SEEK_SET) == 0 && fwrite(header, 1, sizeof(header), file) == sizeof(header);
+        }
+        good = fclose(file) == 0 && good;
+        file = nullptr;
+        return good;
+    }
+
+    uint64_t triangles() const { return count; }
+    const float *written_bounds() const { return bounds; }
+
+    static const size_t MESH_FILE_HEADER = 40;
+    static const uint32_t MESH_FILE_VERSION = 1;
+
+private:
+    static const size_t FLUSH_AT = 1 << 20;
+
+    void put(const char *text) { put_bytes(text, strlen(text)); }
+    void put(const char *text, int size) { put_bytes(text, (size_t)std::max(size, 0)); }
+    void put_bytes(const void *data, size_t size)
+    {
+        const uint8_t *p = (const uint8_t *)data;
+        buffer.insert(buffer.end(), p, p + size);
+    }
+
+    void flush()
+    {
+        if (!buffer.empty() && fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size())
+            good = false;
+        buffer.clear();
+    }
+
+    FILE *file = nullptr;
+    mesh_file_format format = MESH_FILE_OBJ;
+    uint64_t count = 0;
+    float bounds[6];
+    bool good = true;
+    std::vector<uint8_t> buffer;
+};
+
+// Saves a mesh in memory, in the format its extension names.
+inline bool save_mesh(const Mesh &mesh, const char *path)
+{
+    mesh_writer writer;
+    if (!writer.open(path, mesh_file_format_for(path)))
+        return false;
+    for (const Triangle &t : mesh.tris)
+        writer.add(t);
+    if (mesh.tris.empty())  // welded without keeping the soup
+        for (size_t i = 0; i + 2 < mesh.indices.size() && !mesh.vertices.empty(); i += 3)
+            writer.add(Triangle(mesh.vertices[mesh.indices[i]], mesh.vertices[mesh.indices[i + 1]], mesh.vertices[mesh.indices[i + 2]]));
+    return writer.close();
+}
+
+// Bounds from the header of a native mesh file, without reading the triangles.
+inline bool read_mesh_bounds(const char *path, float bounds[6])
+{
+    if (mesh_file_format_for(path) != MESH_FILE_NATIVE)
+        return false;
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+    uint8_t header[mesh_writer::MESH_FILE_HEADER];
+    uint32_t version = 0;
+    bool ok = fread(header, 1, sizeof(header), f) == sizeof(header) && memcmp(header, "MESH", 4) == 0;
+    fclose(f);
+    if (ok)
+    {
+        memcpy(&version, header + 4, 4);
+        ok = version == mesh_writer::MESH_FILE_VERSION;
+    }
+    if (ok)
+        memcpy(bounds, header + 16, 24);
+    return ok;
+}
+
+#endif
@@ -0,0 +1,182 @@
+#ifndef MESHOPTIMIZEH
+#define MESHOPTIMIZEH
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include "object.h"
+#include "trace.h"
+
+/*  Reorders an indexed mesh (weld.h) for vertex reuse:
+
+        triangles   Tipsify (Sander, Nehab and Barczak 2007): fans around
+                    a vertex while it is still in a cache of cache_size
+                    entries, then jumps to the most recently touched vertex
+                    with triangles left; linear in the triangles
+        vertices    renumbered in order of first use, so the transformed
+                    vertex buffer is written and read front to back
+
+    The quality is reported as the average cache miss ratio, transforms
+    per triangle with a FIFO cache of cache_size vertices: 3 for a
+    triangle soup, about 0.5 at best for a regular grid. Mesh::tris, if
+    weld() kept it, is permuted along, so triangle t of tris stays
+    triangle t of indices. */
+
+const int VERTEX_CACHE_SIZE = 16;
+
+// Transforms per triangle with a FIFO post-transform cache of cacheSize entries.
+inline float acmr(const std::vector<uint32_t> &indices, size_t vertexCount, int cacheSize = VERTEX_CACHE_SIZE)
+{
+    if (indices.empty())
+        return 0.0f;
+    // a vertex is cached while fewer than cacheSize misses happened since it was loaded
+    std::vector<uint64_t> loaded(vertexCount, 0);
+    uint64_t misses = 0;
+    for (uint32_t v : indices)
+    {
+        if (loaded[v] == 0 || misses - loaded[v] >= (uint64_t)cacheSize)
+            loaded[v] = ++misses;
+    }
+    return (float)misses / (indices.size() / 3);
+}
+
+// Triangle order from Tipsify; returns triangle indices.
+inline std::vector<uint32_t> tipsify(const std::vector<uint32_t> &indices, size_t vertexCount, int cacheSize = VERTEX_CACHE_SIZE)
+{
+    const size_t triCount = indices.size() / 3;
+
+    // triangles around each vertex, in CSR form
+    std::vector<uint32_t> live(vertexCount, 0), first(vertexCount + 1, 0), around(indices.size());
+    for (uint32_t v : indices)
+        live[v]++;
+    for (size_t v = 0; v < vertexCount; v++)
+        first[v + 1] = first[v] + live[v];
+    {
+        std::vector<uint32_t> cursor(first.begin(), first.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++)
+            around[cursor[indices[i]]++] = (uint32_t)(i / 3);
+    }
+
+    std::vector<uint32_t> order;
+    order.reserve(triCount);
+    std::vector<uint8_t> emitted(triCount, 0);
+    std::vector<int64_t> cacheTime(vertexCount, 0);
+    std::vector<uint32_t> deadEnd, candidates;
+    int64_t stamp = cacheSize + 1;
+    size_t cursor = 0;     // vertices below this have no triangles left
+
+    int64_t fan = vertexCount ? 0 : -1;
+    while (fan >= 0)
+    {
+        candidates.clear();
+        for (uint32_t k = first[fan]; k < first[fan + 1]; k++)
+        {
+            const uint32_t t = around[k];
+            if (emitted[t])
+                continue;
+            emitted[t] = 1;
+            order.push_back(t);
+            for (int c = 0; c < 3; c++)
+            {
+                const uint32_t v = indices[3 * t + c];
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (stamp - cacheTime[v] > cacheSize)
+                    cacheTime[v] = stamp++;
+            }
+        }
+
+        // the candidate that stays in the cache longest while its fan is drawn
+        fan = -1;
+        int64_t best = -1;
+        for (uint32_t v : candidates)
+        {
+            if (live[v] == 0)
+                continue;
+            int64_t priority = 0;
+            if (stamp - cacheTime[v] + 2 * (int64_t)live[v] <= cacheSize)
+                priority = stamp - cacheTime[v];
+            if (priority > best)
+            {
+                best = priority;
+                fan = v;
+            }
+        }
+        if (fan >= 0)
+            continue;
+
+        // dead end: most recent vertex with triangles left, else the next one in input order
+        while (!deadEnd.empty() && fan < 0)
+        {
+            const uint32_t v = deadEnd.back();
+            deadEnd.pop_back();
+            if (live[v] > 0)
+                fan = v;
+        }
+        while (fan < 0 && cursor < vertexCount)
+        {
+            if (live[cursor] > 0)
+                fan = (int64_t)cursor;
+            cursor++;
+        }
+    }
+    return order;
+}
+
+struct mesh_optimize_stats
+{
+    float acmr_before = 0, acmr_after = 0;
+    int cache_size = VERTEX_CACHE_SIZE;
+};
+
+// Tipsify, then first-use vertex order; the mesh must be indexed and still have its float vertices.
+inline mesh_optimize_stats optimize_mesh(Mesh &mesh, int cacheSize = VERTEX_CACHE_SIZE)
+{
+    TRACE_ZONE("optimize_mesh");
+    mesh_optimize_stats stats;
+    stats.cache_size = cacheSize;
+    if (!mesh.indexed() || mesh.vertices.empty())
+        return stats;
+    stats.acmr_before = acmr(mesh.indices, mesh.vertices.size(), cacheSize);
+
+    const std::vector<uint32_t> order = tipsify(mesh.indices, mesh.vertices.size(), cacheSize);
+    std::vector<uint32_t> indices(mesh.indices.size());
+    std::vector<Triangle> tris;
+    const bool soup = mesh.tris.size() == order.size();
+    if (soup)
+        tris.reserve(order.size());
+    for (size_t t = 0; t < order.size(); t++)
+    {
+        std::copy(&mesh.indices[3 * order[t]], &mesh.indices[3 * order[t]] + 3, &indices[3 * t]);
+        if (soup)
+            tris.push_back(mesh.tris[order[t]]);
+    }
+
+    const uint32_t unused = 0xffffffffu;
+    std::vector<uint32_t> remap(mesh.vertices.size(), unused);
+    std::vector<Vertex> vertices;
+    vertices.reserve(mesh.vertices.size());
+    for (uint32_t &v : indices)
+    {
+        if (remap[v] == unused)
+        {
+            remap[v] = (uint32_t)vertices.size();
+            vertices.push_back(mesh.vertices[v]);
+        }
+        v = remap[v];
+    }
+
+    mesh.indices.swap(indices);
+    mesh.vertices.swap(vertices);
+    if (soup)
+        mesh.tris.swap(tris);
+    mesh.lods.clear();      // built against the old numbering; build_lods() again
+    mesh.clear_meshlets();  // and build_meshlets()
+    if (mesh.quantized())
+        mesh.quantize(true);    // packed follows the new order
+    stats.acmr_after = acmr(mesh.indices, mesh.vertices.size(), cacheSize);
+    return stats;
+}
+
+#endif
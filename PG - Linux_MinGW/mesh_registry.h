@@ -0,0 +1,135 @@
+#ifndef MESHREGISTRYH
+#define MESHREGISTRYH
+
+#include <string>
+#include <memory>
+#include <future>
+#include <mutex>
+#include <functional>
+#include <chrono>
+#include <unordered_map>
+#include "object.h"
+#include "thread_pool.h"
+#include "alloc_hook.h"
+#include "trace.h"
+
+/*  Meshes by path, each loaded and prepared once and then shared by every
+    Obj that places it. A handle is a shared_ptr to a const Mesh, so any
+    number of instances, frames in flight and threads can read it without
+    locking, and the memory of a scene grows with its distinct meshes, not
+    its instances.
+
+    The map holds futures, like mesh_cache in render_server.h: the first
+    caller of a path loads it outside the lock and later callers wait for
+    that load instead of starting their own; load_async() hands the load to
+    a pool and returns the future at once. A path that fails to load is
+    forgotten, so it can be retried. Entries are kept until clear(); a
+    handle outlives both. */
+class mesh_registry
+{
+public:
+    // Runs on the new mesh after it loads and before it is shared (weld, quantize, ...).
+    typedef std::function<void(Mesh &)> prepare_fn;
+
+    // path's mesh, null if it cannot be loaded or is empty.
+    mesh_handle load(const std::string &path, const prepare_fn &prepare = prepare_fn())
+    {
+        auto loading = std::make_shared<std::promise<mesh_handle>>();
+        bool claimed;
+        std::shared_future<mesh_handle> result = claim(path, *loading, claimed);
+        if (claimed)
+            finish(path, *loading, prepare);
+        return result.get();    // waits, without the lock, if another thread is loading it
+    }
+
+    /*  Same, loading on pool instead of the calling thread. The job owns a
+        copy of prepare; whatever that captures by reference, and the
+        registry, must outlive the load. */
+    std::shared_future<mesh_handle> load_async(const std::string &path, thread_pool &pool, const prepare_fn &prepare = prepare_fn())
+    {
+        auto loading = std::make_shared<std::promise<mesh_handle>>();
+        bool claimed;
+        std::shared_future<mesh_handle> result = claim(path, *loading, claimed);
+        if (claimed)
+            pool.post([this, path, loading, prepare] { finish(path, *loading, prepare); });
+        return result;
+    }
+
+    // Registers a mesh built in memory (scene_generator.h) under name, replacing any before it.
+    mesh_handle add(const std::string &name, Mesh mesh)
+    {
+        mesh_handle handle = std::make_shared<const Mesh>(std::move(mesh));
+        std::promise<mesh_handle> ready;
+        ready.set_value(handle);
+        std::lock_guard<std::mutex> lock(mutex);
+        meshes[name] = ready.get_future().share();
+        return handle;
+    }
+
+    // Distinct meshes loaded or loading.
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return meshes.size();
+    }
+
+    // Bytes held by the meshes that finished loading; instances add nothing.
+    size_t memory_bytes() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t bytes = 0;
+        for (const auto &entry : meshes)
+        {
+            if (entry.second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                continue;
+            if (const mesh_handle &mesh = entry.second.get())
+                bytes += mesh->memory_bytes();
+        }
+        return bytes;
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        meshes.clear();
+    }
+
+private:
+    // The entry for path; claimed when it is new and the caller must fulfil loading.
+    std::shared_future<mesh_handle> claim(const std::string &path, std::promise<mesh_handle> &loading, bool &claimed)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = meshes.find(path);
+        claimed = found == meshes.end();
+        if (!claimed)
+            return found->second;
+        std::shared_future<mesh_handle> result = loading.get_future().share();
+        meshes.emplace(path, result);
+        return result;
+    }
+
+    // Loading allocates by nature, so it is exempt from alloc_forbid() on whatever thread it runs.
+    void finish(const std::string &path, std::promise<mesh_handle> &loading, const prepare_fn &prepare)
+    {
+        alloc_permit permit;    // first, the zone may register the thread's trace buffer
+        TRACE_ZONE("mesh_registry::load");
+        std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>();
+        if (mesh->load_mesh_from_file(path.c_str()) && !mesh->tris.empty())
+        {
+            if (prepare)
+                prepare(*mesh);
+            loading.set_value(std::move(mesh));
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            meshes.erase(path);
+        }
+        loading.set_value(nullptr);
+    }
+
+    std::unordered_map<std::string, std::shared_future<mesh_handle>> meshes;
+    mutable std::mutex mutex;
+};
+
+#endif
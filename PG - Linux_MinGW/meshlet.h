@@ -0,0 +1,279 @@
+#ifndef MESHLETH
+#define MESHLETH
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include "object.h"
+#include "trace.h"
+
+/*  Splits an indexed mesh into meshlets of at most MESHLET_MAX_VERTICES
+    vertices and MESHLET_MAX_TRIANGLES triangles, so the camera can reject
+    whole clusters before transforming their vertices:
+
+        growth      a meshlet starts from a triangle left on the border of
+                    the previous one and keeps taking the neighbouring
+                    triangle that adds the fewest new vertices, preferring
+                    ones that use up a vertex so no triangles are left
+                    stranded; the spread of its normal from the meshlet's
+                    weighs as much as a new vertex, since flat clusters
+                    have narrow cones, and distance breaks the ties
+        sphere      centered on the vertices' AABB, radius to the farthest
+        cone        average of the unit face normals and the largest angle
+                    any face makes with it; clusters spreading past about
+                    84 degrees keep a cutoff of 1 and are never cone culled
+
+    Every face of a meshlet points away from any eye for which
+        dot(center - eye, axis) >= cone_cutoff * |center - eye| + radius
+    (Barczak 2015, as in meshoptimizer). Mesh::indices, and Mesh::tris if
+    weld() kept it, are permuted so each meshlet owns a contiguous run of
+    triangles; 124
+    triangles rather than 128 keeps the 3-byte local corners of a meshlet
+    in a multiple of 4 bytes. */
+
+namespace meshlet_detail
+{
+    inline void compute_bounds(const Mesh &mesh, meshlet &m)
+    {
+        const uint32_t *global = &mesh.meshlet_vertices[m.vertex_offset];
+        vec3 lo = mesh.vertices[global[0]].pos, hi = lo;
+        for (int i = 1; i < m.vertex_count; i++)
+        {
+            const vec3 &p = mesh.vertices[global[i]].pos;
+            for (int k = 0; k < 3; k++)
+            {
+                lo[k] = std::min(lo[k], p[k]);
+                hi[k] = std::max(hi[k], p[k]);
+            }
+        }
+        const vec3 center = 0.5f * (lo + hi);
+        float radius = 0;
+        for (int i = 0; i < m.vertex_count; i++)
+            radius = std::max(radius, (mesh.vertices[global[i]].pos - center).length());
+
+        vec3 axis(0, 0, 0);
+        std::vector<vec3> normals;
+        normals.reserve(m.triangle_count);
+        const uint32_t *index = &mesh.indices[3 * (size_t)m.triangle_offset];
+        for (int t = 0; t < m.triangle_count; t++, index += 3)
+        {
+            const vec3 &p0 = mesh.vertices[index[0]].pos;
+            vec3 n = cross(mesh.vertices[index[1]].pos - p0, mesh.vertices[index[2]].pos - p0);
+            const float len = n.length();
+            if (len == 0)
+                continue;   // degenerate faces are never drawn, any cone holds them
+            n /= len;
+            normals.push_back(n);
+            axis += n;
+        }
+
+        float cutoff = 1;
+        const float len = axis.length();
+        if (len > 0)
+        {
+            axis /= len;
+            float minDot = 1;
+            for (const vec3 &n : normals)
+                minDot = std::min(minDot, dot(n, axis));
+            if (minDot > 0.1f)
+                cutoff = std::sqrt(1 - minDot * minDot);
+        }
+
+        for (int k = 0; k < 3; k++)
+        {
+            m.center[k] = center[k];
+            m.cone_axis[k] = cutoff < 1 ? axis[k] : 0;
+        }
+        m.radius = radius;
+        m.cone_cutoff = cutoff;
+    }
+}
+
+/*  Fills mesh.meshlets, reordering the triangles of the indexed mesh. Run
+    after weld() and optimize_mesh(), since those rebuild the indices;
+    build_lods() may run before or after. Returns the meshlet count. */
+inline size_t build_meshlets(Mesh &mesh, int maxVertices = MESHLET_MAX_VERTICES, int maxTriangles = MESHLET_MAX_TRIANGLES)
+{
+    using namespace meshlet_detail;
+    TRACE_ZONE("build_meshlets");
+    mesh.clear_meshlets();
+    if (!mesh.indexed() || mesh.vertices.empty())
+        return 0;
+    maxVertices = std::min(std::max(maxVertices, 3), MESHLET_MAX_VERTICES);
+    maxTriangles = std::min(std::max(maxTriangles, 1), 255);
+
+    const size_t triCount = mesh.indices.size() / 3, vertexCount = mesh.vertices.size();
+    const std::vector<uint32_t> &indices = mesh.indices;
+
+    // triangles around each vertex, in CSR form
+    std::vector<uint32_t> first(vertexCount + 1, 0), around(indices.size());
+    for (uint32_t v : indices)
+        first[v + 1]++;
+    for (size_t v = 0; v < vertexCount; v++)
+        first[v + 1] += first[v];
+    {
+        std::vector<uint32_t> cursor(first.begin(), first.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++)
+            around[cursor[indices[i]]++] = (uint32_t)(i / 3);
+    }
+
+    std::vector<vec3> normals(triCount), centroids(triCount);
+    double area = 0;
+    for (size_t t = 0; t < triCount; t++)
+    {
+        const vec3 &p0 = mesh.vertices[indices[3 * t]].pos, &p1 = mesh.vertices[indices[3 * t + 1]].pos, &p2 = mesh.vertices[indices[3 * t + 2]].pos;
+        normals[t] = cross(p1 - p0, p2 - p0);
+        centroids[t] = (p0 + p1 + p2) / 3.0f;
+        const float len = normals[t].length();
+        area += 0.5 * len;
+        if (len > 0)
+            normals[t] /= len;
+    }
+    // radius of a round patch of maxTriangles average triangles, the yardstick for distances
+    const float expectedRadius = std::max((float)std::sqrt(area / triCount * maxTriangles / M_PI), 1e-20f);
+    std::vector<uint32_t> live(first.size() - 1);     // triangles not yet emitted around each vertex
+    for (size_t v = 0; v < vertexCount; v++)
+        live[v] = first[v + 1] - first[v];
+
+    const uint32_t NONE = 0xffffffffu;
+    std::vector<uint32_t> order;        // triangles in meshlet order
+    order.reserve(triCount);
+    std::vector<uint8_t> emitted(triCount, 0);
+    std::vector<uint32_t> queued(triCount, NONE);     // meshlet that last listed the triangle as a candidate
+    std::vector<int> slot(vertexCount, -1);             // local index in the open meshlet
+    std::vector<uint32_t> candidates, local;
+    size_t cursor = 0;      // triangles below this are emitted
+
+    while (order.size() < triCount)
+    {
+        meshlet m;
+        m.vertex_offset = (uint32_t)mesh.meshlet_vertices.size();
+        m.triangle_offset = (uint32_t)order.size();
+        const uint32_t id = (uint32_t)mesh.meshlets.size();
+        local.clear();
+        vec3 normalSum(0, 0, 0), centroidSum(0, 0, 0);
+
+        // seed: a triangle left on the border of the last meshlet, else the next in index order
+        uint32_t seed = NONE;
+        while (!candidates.empty() && seed == NONE)
+        {
+            if (!emitted[candidates.back()])
+                seed = candidates.back();
+            candidates.pop_back();
+        }
+        candidates.clear();
+        while (seed == NONE)
+        {
+            if (!emitted[cursor])
+                seed = (uint32_t)cursor;
+            cursor++;
+        }
+
+        uint32_t next = seed;
+        while (next != NONE)
+        {
+            emitted[next] = 1;
+            order.push_back(next);
+            m.triangle_count++;
+            normalSum += normals[next];
+            centroidSum += centroids[next];
+            for (int c = 0; c < 3; c++)
+            {
+                const uint32_t v = indices[3 * next + c];
+                live[v]--;
+                if (slot[v] >= 0)
+                    continue;
+                slot[v] = (int)local.size();
+                local.push_back(v);
+                for (uint32_t k = first[v]; k < first[v + 1]; k++)
+                {
+                    const uint32_t t = around[k];
+                    if (!emitted[t] && queued[t] != id)
+                    {
+                        queued[t] = id;
+                        candidates.push_back(t);
+                    }
+                }
+            }
+            if (m.triangle_count == maxTriangles)
+                break;
+
+            /* best candidate: no new vertex, then one that is the last triangle left
+               around some vertex (so none get stranded), then the fewest new
+               vertices, each step traded against the spread of the normals */
+            next = NONE;
+            float best = 0;
+            const vec3 center = centroidSum / (float)m.triangle_count;
+            const float normalLength = std::max(normalSum.length(), 1e-20f);
+            for (size_t i = 0; i < candidates.size();)
+            {
+                const uint32_t t = candidates[i];
+                if (emitted[t])
+                {
+                    candidates[i] = candidates.back();
+                    candidates.pop_back();
+                    continue;
+                }
+                i++;
+                const uint32_t *corner = &indices[3 * t];
+                int extra = 0;
+                for (int c = 0; c < 3; c++)
+                    extra += slot[corner[c]] < 0;
+                if ((int)local.size() + extra > maxVertices)
+                    continue;
+                const bool closes = live[corner[0]] == 1 || live[corner[1]] == 1 || live[corner[2]] == 1;
+                const int priority = extra == 0 ? 0 : closes ? 1 : 1 + extra;
+                const float distance = std::min((centroids[t] - center).length() / expectedRadius, 1.0f);
+                const float spread = 0.5f * (1.0f - dot(normals[t], normalSum) / normalLength);
+                const float score = priority + 0.25f * distance + 2.0f * spread;
+                if (next == NONE || score < best)
+                {
+                    best = score;
+                    next = t;
+                }
+            }
+        }
+
+        for (uint32_t v : local)
+            slot[v] = -1;
+        m.vertex_count = (uint8_t)local.size();
+        mesh.meshlet_vertices.insert(mesh.meshlet_vertices.end(), local.begin(), local.end());
+        mesh.meshlets.push_back(m);
+    }
+
+    // triangles in meshlet order, with local corners alongside
+    std::vector<uint32_t> reordered(indices.size());
+    std::vector<Triangle> tris;
+    const bool soup = mesh.tris.size() == triCount;
+    if (soup)
+        tris.reserve(triCount);
+    for (size_t t = 0; t < triCount; t++)
+    {
+        std::copy(&indices[3 * order[t]], &indices[3 * order[t]] + 3, &reordered[3 * t]);
+        if (soup)
+            tris.push_back(mesh.tris[order[t]]);
+    }
+    mesh.indices.swap(reordered);
+    if (soup)
+        mesh.tris.swap(tris);
+
+    mesh.meshlet_triangles.resize(mesh.indices.size());
+    for (meshlet &m : mesh.meshlets)
+    {
+        const uint32_t *global = &mesh.meshlet_vertices[m.vertex_offset];
+        for (int i = 0; i < m.vertex_count; i++)
+            slot[global[i]] = i;
+        for (size_t c = 3 * (size_t)m.triangle_offset; c < 3 * ((size_t)m.triangle_offset + m.triangle_count); c++)
+            mesh.meshlet_triangles[c] = (uint8_t)slot[mesh.indices[c]];
+        for (int i = 0; i < m.vertex_count; i++)
+            slot[global[i]] = -1;
+        compute_bounds(mesh, m);
+    }
+
+    if (mesh.quantized())
+        mesh.quantize(true);    // normals follow the new triangle order
+    return mesh.meshlets.size();
+}
+
+#endif
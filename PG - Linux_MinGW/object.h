@@ -1,13 +1,22 @@
+#ifndef OBJECTH
+#define OBJECTH
+
 #include <vector>
+#include <memory>
 #include <stdio.h>
 #include <iostream>
 #include <sstream>
 #include <fstream>
 #include <string>
 #include <cstring>
+#include <algorithm>
+#include <cstdint>
 #include "vec3.h"
 #include "vec2.h"
 #include "matrix44.h"
+#include "quantize.h"
+#include "texture.h"
+#include "trace.h"
 
 #define min_x 0
 #define max_x 1
@@ -16,48 +25,125 @@
 #define min_z 4
 #define max_z 5
 
+#ifndef M_PI
 #define M_PI 3.141592653589793
+#endif
 
 struct Vertex{
 	vec3 pos;
+	vec2 uv;
 };
 
 struct Triangle {
 
 	Vertex vertex[3];
 
-	Triangle( const std::vector<vec3> v )
+	Triangle( const vec3 &p0, const vec3 &p1, const vec3 &p2 )
+	{
+		vertex[0].pos = p0;
+		vertex[1].pos = p1;
+		vertex[2].pos = p2;
+		vertex[0].uv = vertex[1].uv = vertex[2].uv = vec2(0, 0);
+	}
+
+	Triangle( const Vertex &v0, const Vertex &v1, const Vertex &v2 )
 	{
-		vertex[0].pos = v[0];
-		vertex[1].pos = v[1];
-		vertex[2].pos = v[2];
+		vertex[0] = v0;
+		vertex[1] = v1;
+		vertex[2] = v2;
 	}
 
 	~Triangle(){}
 };
 
+// A coarser index list over the same vertices, built by build_lods() (lod.h).
+struct mesh_lod
+{
+	std::vector<uint32_t> indices;
+	uint32_t vertex_count = 0;	// uses only vertices [0, vertex_count)
+	float error = 0;			// object space distance the surface moved
+	std::vector<oct_normal> normals;	// per triangle, when the mesh is quantized
+};
+
+const int MESHLET_MAX_VERTICES = 64;
+const int MESHLET_MAX_TRIANGLES = 124;
+
+// A cluster of triangles sharing at most 64 vertices, built by build_meshlets() (meshlet.h).
+struct meshlet
+{
+	uint32_t vertex_offset = 0;		// first entry in Mesh::meshlet_vertices
+	uint32_t triangle_offset = 0;	// first triangle in Mesh::indices and Mesh::meshlet_triangles
+	uint8_t vertex_count = 0, triangle_count = 0;
+	float center[3] = { 0, 0, 0 }, radius = 0;		// object space bounding sphere
+	float cone_axis[3] = { 0, 0, 0 }, cone_cutoff = 1;	// sine of the normal spread; 1 never culls
+};
+
 class Mesh 
 {
 public:
 	std::vector<Triangle> tris;
+	float bounds[6] = { 0, 0, 0, 0, 0, 0 };	// object space AABB, indexed by min_x .. max_z
+
+	// Indexed form of tris, filled by weld() (weld.h), which then frees tris unless told to keep
+	// it: unique vertices and three indices per triangle. When present the camera transforms
+	// each vertex once instead of every corner.
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+
+	// 16-bit copy of the indexed mesh, filled by quantize(); see quantize.h
+	quantized_mesh packed;
+
+	// Coarser levels of indices, finest first; empty unless build_lods() ran.
+	std::vector<mesh_lod> lods;
+
+	// Clusters over indices, filled by build_meshlets(). The triangles of a meshlet are
+	// contiguous in indices, and meshlet_triangles holds the same corners as slots into
+	// its run of meshlet_vertices, so the camera can cull and transform it on its own.
+	std::vector<meshlet> meshlets;
+	std::vector<uint32_t> meshlet_vertices;
+	std::vector<uint8_t> meshlet_triangles;
+
+	bool indexed() const { return !indices.empty(); }
+	bool quantized() const { return !packed.vertices.empty(); }
+	size_t triangle_count() const { return indexed() ? indices.size() / 3 : tris.size(); }
+
+	size_t memory_bytes() const
+	{
+		size_t bytes = tris.size() * sizeof(Triangle) + vertices.size() * sizeof(Vertex) + indices.size() * sizeof(uint32_t) + packed.bytes();
+		for (const mesh_lod& lod : lods)
+			bytes += lod.indices.size() * sizeof(uint32_t) + lod.normals.size() * sizeof(oct_normal);
+		bytes += meshlets.size() * sizeof(meshlet) + meshlet_vertices.size() * sizeof(uint32_t) + meshlet_triangles.size();
+		return bytes;
+	}
 
 	Mesh() {}
 	~Mesh() {}
 
 	bool load_mesh_from_file(const char* path) 
 	{
+		TRACE_ZONE("Mesh::load_mesh_from_file");
+		vertices.clear();
+		indices.clear();
+		packed = quantized_mesh();
+		lods.clear();
+		clear_meshlets();
+		const char* dot = strrchr(path, '.');
+		if (dot && strcmp(dot, ".mesh") == 0)
+			return load_mesh_binary(path);
+
 		tris.clear();
-		std::vector< unsigned int > vertexIndices;
+		std::vector< unsigned int > vertexIndices, uvIndices;
 		std::vector< vec3 > temp_vertices;
+		std::vector< vec2 > temp_uvs;
 
 		std::ifstream f(path);
 		if (!f.is_open())
 		{
-			std::cout << "File cannot be oppened or does not exist\n";
+			std::cerr << "File cannot be oppened or does not exist\n";
 			return false;
 		}
 
-		std::cout << "file was  oppened!\n";
+		std::cerr << "file was  oppened!\n";
 
 		
 		while (!f.eof())
@@ -74,6 +160,11 @@ public:
 			{
 				if (line[1] == 't') 
 				{
+					// OBJ puts v = 0 at the bottom of the image, texels are stored top-down
+					vec2 uv;
+					s >> junk >> junk >> uv[0] >> uv[1];
+					uv[1] = 1.0f - uv[1];
+					temp_uvs.push_back(uv);
 				}
 				else if (line[1] == 'n') 
 				{
@@ -91,53 +182,237 @@ public:
 				unsigned int vertexIndex[3];
 
 				s >> junk >> vertex1 >> vertex2 >> vertex3;
-				int fstslash = vertex1.find("/");
-				std::string fst = vertex1.substr(0, fstslash);
-				vertexIndex[0] = atoi( fst.c_str() );
+				const std::string* corners[3] = { &vertex1, &vertex2, &vertex3 };
 
-				fstslash = vertex2.find("/");
-				fst = vertex2.substr(0, fstslash);
-				vertexIndex[1] = atoi(fst.c_str());
+				for (int c = 0; c < 3; c++)
+				{
+					// v, v/vt, v/vt/vn or v//vn; a missing vt is stored as 0
+					const std::string& corner = *corners[c];
+					size_t fstslash = corner.find("/");
+					std::string fst = corner.substr(0, fstslash);
+					vertexIndex[c] = atoi( fst.c_str() );
 
-				fstslash = vertex3.find("/");
-				fst = vertex3.substr(0, fstslash);
-				vertexIndex[2] = atoi(fst.c_str());
+					unsigned int uvIndex = 0;
+					if (fstslash != std::string::npos)
+						uvIndex = atoi( corner.c_str() + fstslash + 1 );
 
-				vertexIndices.push_back(vertexIndex[0]);
-				vertexIndices.push_back(vertexIndex[1]);
-				vertexIndices.push_back(vertexIndex[2]);
+					vertexIndices.push_back(vertexIndex[c]);
+					uvIndices.push_back(uvIndex);
+				}
 			}
 		}
 
 		for (unsigned int i = 0; i < vertexIndices.size(); i+=3)
 		{
-			unsigned int v1 = vertexIndices[i];
-			unsigned int v2 = vertexIndices[i+1];
-			unsigned int v3 = vertexIndices[i+2];
+			Vertex corners[3];
+			for (int c = 0; c < 3; c++)
+			{
+				corners[c].pos = temp_vertices[vertexIndices[i+c] - 1];
+				const unsigned int uvIndex = uvIndices[i+c];
+				corners[c].uv = (uvIndex > 0 && uvIndex <= temp_uvs.size()) ? temp_uvs[uvIndex - 1] : vec2(0, 0);
+			}
+
+			tris.push_back(Triangle(corners[0], corners[1], corners[2]));
+		}
+
+		compute_bounds();
+		std::cerr << "vertSize = " << vertexIndices.size() << "\n";
+		return true;
+	}
+
+	// The native format written by mesh_writer (mesh_io.h): "MESH", u32 version 1,
+	// u64 triangle count, f32 bounds[6], then x y z u v per corner, little endian.
+	bool load_mesh_binary(const char* path)
+	{
+		TRACE_ZONE("Mesh::load_mesh_binary");
+		tris.clear();
+		vertices.clear();
+		indices.clear();
+		packed = quantized_mesh();
+		FILE* f = fopen(path, "rb");
+		if (!f)
+		{
+			std::cerr << "File cannot be oppened or does not exist\n";
+			return false;
+		}
+
+		unsigned char header[40];
+		uint32_t version = 0;
+		uint64_t count = 0;
+		bool ok = fread(header, 1, sizeof(header), f) == sizeof(header) && memcmp(header, "MESH", 4) == 0;
+		if (ok)
+		{
+			memcpy(&version, header + 4, 4);
+			memcpy(&count, header + 8, 8);
+			memcpy(bounds, header + 16, 24);
+			ok = version == 1;
+		}
+		if (!ok)
+		{
+			std::cerr << path << " is not a version 1 mesh file\n";
+			fclose(f);
+			return false;
+		}
+		// the header's count is only trusted as far as the file can hold it
+		long size = -1;
+		if (fseek(f, 0, SEEK_END) == 0)
+			size = ftell(f);
+		if (size < (long)sizeof(header) || fseek(f, sizeof(header), SEEK_SET) != 0 ||
+			count > (uint64_t)(size - sizeof(header)) / (15 * sizeof(float)))
+		{
+			std::cerr << path << " is truncated: it cannot hold " << count << " triangles\n";
+			fclose(f);
+			return false;
+		}
+
+		tris.reserve(count);
+		std::vector<float> chunk(15 * 4096);
+		while (tris.size() < count)
+		{
+			const size_t want = std::min<uint64_t>(4096, count - tris.size());
+			if (fread(chunk.data(), 15 * sizeof(float), want, f) != want)
+			{
+				std::cerr << path << " is truncated after " << tris.size() << " of " << count << " triangles\n";
+				tris.clear();
+				fclose(f);
+				return false;
+			}
+			for (size_t i = 0; i < want; i++)
+			{
+				const float* c = &chunk[15 * i];
+				Vertex corners[3];
+				for (int k = 0; k < 3; k++, c += 5)
+				{
+					corners[k].pos = vec3(c[0], c[1], c[2]);
+					corners[k].uv = vec2(c[3], c[4]);
+				}
+				tris.push_back(Triangle(corners[0], corners[1], corners[2]));
+			}
+		}
+		fclose(f);
+		return true;
+	}
+
+	/*  Builds packed from the indexed mesh (weld() first). Without keepSource the
+		float vertices and the triangle soup are released, leaving the mesh to the
+		renderer: bounds, indices and packed. False if the mesh is not indexed. */
+	bool quantize(bool keepSource = false)
+	{
+		TRACE_ZONE("Mesh::quantize");
+		if (!indexed() || vertices.empty())
+			return false;
+
+		float lo[5], hi[5];
+		for (int k = 0; k < 5; k++)
+		{
+			lo[k] = k < 3 ? vertices[0].pos[k] : vertices[0].uv[k - 3];
+			hi[k] = lo[k];
+		}
+		for (const Vertex& v : vertices)
+		{
+			for (int k = 0; k < 5; k++)
+			{
+				const float value = k < 3 ? v.pos[k] : v.uv[k - 3];
+				lo[k] = std::min(lo[k], value);
+				hi[k] = std::max(hi[k], value);
+			}
+		}
 
-			std::vector<vec3> vertices;
-			vertices.push_back(temp_vertices[v1 - 1]);
-			vertices.push_back(temp_vertices[v2 - 1]);
-			vertices.push_back(temp_vertices[v3 - 1]);
+		packed = quantized_mesh();
+		for (int k = 0; k < 3; k++)
+		{
+			packed.origin[k] = lo[k];
+			packed.scale[k] = (hi[k] - lo[k]) / 65535.0f;
+		}
+		for (int k = 0; k < 2; k++)
+		{
+			packed.uv_origin[k] = lo[3 + k];
+			packed.uv_scale[k] = (hi[3 + k] - lo[3 + k]) / 65535.0f;
+		}
 
-			Triangle t(vertices);
-			tris.push_back(t);
+		packed.vertices.resize(vertices.size());
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			quantized_vertex& q = packed.vertices[i];
+			for (int k = 0; k < 3; k++)
+				q.pos[k] = quantize_unorm16(vertices[i].pos[k], lo[k], hi[k] - lo[k]);
+			for (int k = 0; k < 2; k++)
+				q.uv[k] = quantize_unorm16(vertices[i].uv[k], lo[3 + k], hi[3 + k] - lo[3 + k]);
 		}
 
-		std::cout << "vertSize = " << vertexIndices.size() << "\n";
+		// normals from the float positions, so shading does not see the rounding
+		auto encode_normals = [&](const std::vector<uint32_t>& ix, std::vector<oct_normal>& normals)
+		{
+			normals.resize(ix.size() / 3);
+			for (size_t t = 0; t < normals.size(); t++)
+			{
+				const vec3& p0 = vertices[ix[3 * t]].pos;
+				normals[t] = oct_encode(cross(vertices[ix[3 * t + 1]].pos - p0, vertices[ix[3 * t + 2]].pos - p0));
+			}
+		};
+		encode_normals(indices, packed.normals);
+		for (mesh_lod& lod : lods)
+			encode_normals(lod.indices, lod.normals);
+
+		if (!keepSource)
+		{
+			std::vector<Triangle>().swap(tris);
+			std::vector<Vertex>().swap(vertices);
+		}
 		return true;
 	}
+
+	void clear_meshlets()
+	{
+		meshlets.clear();
+		meshlet_vertices.clear();
+		meshlet_triangles.clear();
+	}
+
+	void compute_bounds()
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			bounds[2 * axis] = tris.empty() ? 0.0f : tris[0].vertex[0].pos[axis];
+			bounds[2 * axis + 1] = bounds[2 * axis];
+		}
+		for (const Triangle& tri : tris)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				for (int axis = 0; axis < 3; axis++)
+				{
+					bounds[2 * axis] = std::min(bounds[2 * axis], tri.vertex[c].pos[axis]);
+					bounds[2 * axis + 1] = std::max(bounds[2 * axis + 1], tri.vertex[c].pos[axis]);
+				}
+			}
+		}
+	}
 };
 
+// Meshes are immutable once shared: prepare them (weld, quantize, ...) before handing one out.
+typedef std::shared_ptr<const Mesh> mesh_handle;
+
+// An instance: a shared mesh placed in the world by its model matrix.
 class Obj 
 {
 public:
-	Mesh mesh;
+	mesh_handle mesh;				// see mesh_registry.h; never null
+	matrix44 model;					// object to world, row vectors like camera::worldToCamera
+	std::shared_ptr<texture> tex;	// optional, shared between copies of the object
+	bool placeholder = false;		// a box standing in for a mesh still loading (scene_loader.h)
+
+	Obj() : mesh(std::make_shared<const Mesh>()) {}
+	Obj( mesh_handle m, const matrix44& toWorld = matrix44(), std::shared_ptr<texture> t = nullptr ) : mesh(std::move(m)), model(toWorld), tex(t) {}
 
-	Obj(){}
-	Obj( const char* file_path ){
-		mesh.load_mesh_from_file(file_path); 
+	// A mesh of its own, loaded as is.
+	Obj( const char* file_path, std::shared_ptr<texture> t = nullptr ) : tex(t) {
+		std::shared_ptr<Mesh> loaded = std::make_shared<Mesh>();
+		loaded->load_mesh_from_file(file_path); 
+		mesh = loaded;
 	}
 	
 	~Obj(){}
-};
\ No newline at end of file
+};
+
+#endif
\ No newline at end of file
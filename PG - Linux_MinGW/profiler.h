@@ -0,0 +1,154 @@
+#ifndef PROFILERH
+#define PROFILERH
+
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "hw_counters.h"
+
+/*  Per-stage frame timings on the main thread. Each frame accumulates the
+    time spent in every stage (a stage may be entered more than once), and
+    end_frame() pushes the totals into a ring of the last HISTORY frames that
+    can be plotted directly and queried for percentiles.
+
+    With hardware counters enabled, begin()/end() also read the calling
+    thread's hw_counters, and the last frame's counts are kept per stage. */
+
+enum frame_stage
+{
+    STAGE_INPUT,
+    STAGE_UI_BUILD,
+    STAGE_CLEAR,
+    STAGE_TRANSFORM,
+    STAGE_RASTER,
+    STAGE_UI_RENDER,
+    STAGE_PRESENT,
+    STAGE_COUNT
+};
+
+const char *const STAGE_NAMES[STAGE_COUNT] = { "input", "ui build", "clear", "transform", "raster", "ui render", "present" };
+
+class frame_profiler
+{
+public:
+    typedef std::chrono::steady_clock clock;
+
+    static const int HISTORY = 240;
+    static const int FRAME = STAGE_COUNT;   // series index of the whole frame, start to start
+
+    // Times the enclosing block into a stage.
+    class scope
+    {
+    public:
+        scope(frame_profiler &p, frame_stage s) : profiler(p), stage(s) { profiler.begin(stage); }
+        ~scope() { profiler.end(stage); }
+
+    private:
+        frame_profiler &profiler;
+        frame_stage stage;
+    };
+
+    frame_profiler() : frame_start(clock::now())
+    {
+        std::fill(&series[0][0], &series[0][0] + (STAGE_COUNT + 1) * HISTORY, 0.0f);
+        std::fill(current, current + STAGE_COUNT, 0.0f);
+    }
+
+    // Stages may not nest with themselves; on the main thread only.
+    void begin(frame_stage s)
+    {
+        if (hardware)
+            hw_counters::local().read(hw_start[s]);
+        stage_start[s] = clock::now();
+    }
+
+    void end(frame_stage s)
+    {
+        add(s, std::chrono::duration<float, std::milli>(clock::now() - stage_start[s]).count());
+        hw_sample now;
+        if (hardware && hw_counters::local().read(now))
+            add(s, now - hw_start[s]);
+    }
+
+    // For stages measured elsewhere, e.g. on the frame_pipeline threads.
+    void add(frame_stage s, float ms) { current[s] += ms; }
+    void add(frame_stage s, const hw_sample &counts) { hw_current[s] += counts; }
+
+    /*  Turns hardware counter reads on or off; returns false (and stays off)
+        when the counters cannot be opened on this thread. */
+    bool enable_hardware(bool on)
+    {
+        hardware = on && hw_counters::local().available();
+        if (hardware)
+            hw_counters::local().read(hw_frame_start);
+        return hardware == on;
+    }
+
+    bool hardware_enabled() const { return hardware; }
+
+    // Counts of the last finished frame; FRAME is the main thread over the whole frame.
+    const hw_sample &hardware_counts(int series_index) const { return hw_last[series_index]; }
+
+    /*  Closes the frame started by the previous call and returns its length
+        in seconds, which is what ImGui wants as DeltaTime. */
+    float end_frame()
+    {
+        const clock::time_point now = clock::now();
+        const float frameMs = std::chrono::duration<float, std::milli>(now - frame_start).count();
+        frame_start = now;
+
+        for (int s = 0; s < STAGE_COUNT; s++)
+        {
+            series[s][next] = current[s];
+            current[s] = 0.0f;
+        }
+        series[FRAME][next] = frameMs;
+
+        for (int s = 0; s < STAGE_COUNT; s++)
+        {
+            hw_last[s] = hw_current[s];
+            hw_current[s] = hw_sample();
+        }
+        hw_sample frameEnd;
+        if (hardware && hw_counters::local().read(frameEnd))
+        {
+            hw_last[FRAME] = frameEnd - hw_frame_start;
+            hw_frame_start = frameEnd;
+        }
+        next = (next + 1) % HISTORY;
+        count = count < HISTORY ? count + 1 : HISTORY;
+        return frameMs / 1000.0f;
+    }
+
+    // Ring of the last HISTORY values; pass offset() as values_offset to ImGui::PlotLines.
+    const float *history(int series_index) const { return series[series_index]; }
+    int offset() const { return next; }
+    int frames() const { return count; }
+
+    float last(int series_index) const { return count ? series[series_index][(next + HISTORY - 1) % HISTORY] : 0.0f; }
+
+    // Nearest-rank percentile (p in [0, 100]) over the frames in the ring.
+    float percentile(int series_index, float p) const
+    {
+        if (count == 0)
+            return 0.0f;
+        scratch.assign(series[series_index], series[series_index] + HISTORY);
+        scratch.resize(count);  // before the ring wraps only the first count entries are filled
+        const int rank = std::min(count - 1, (int)(p / 100.0f * count));
+        std::nth_element(scratch.begin(), scratch.begin() + rank, scratch.end());
+        return scratch[rank];
+    }
+
+private:
+    float series[STAGE_COUNT + 1][HISTORY];
+    float current[STAGE_COUNT];
+    int next = 0, count = 0;
+    clock::time_point frame_start;
+    clock::time_point stage_start[STAGE_COUNT];
+
+    bool hardware = false;
+    hw_sample hw_start[STAGE_COUNT], hw_current[STAGE_COUNT], hw_last[STAGE_COUNT + 1], hw_frame_start;
+    mutable std::vector<float> scratch;
+};
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef QUANTIZEH
+#define QUANTIZEH
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include "vec3.h"
+#include "vec2.h"
+#include "matrix44.h"
+
+/*  Compact vertex format for large scenes, built by Mesh::quantize():
+
+        position    3 x u16, the mesh AABB mapped onto 0 .. 65535
+        uv          2 x u16, the range of the mesh uvs mapped the same way
+        normal      per triangle, octahedral, 2 x snorm16
+
+    10 bytes per vertex instead of the 20 of Vertex, and with the triangle
+    soup released a triangle costs its three indices and a normal instead
+    of three full vertices. The renderer never decodes positions on their
+    own: dequantize() is a matrix, and the camera multiplies it into its
+    world to camera matrix once per object, so the transform stage does
+    the same work as for floats. Normals are per face because that is
+    what the Lambert shading reads; OBJ vertex normals are not loaded. */
+
+struct quantized_vertex
+{
+    uint16_t pos[3];
+    uint16_t uv[2];
+};
+
+struct oct_normal
+{
+    int16_t x, y;
+};
+
+inline uint16_t quantize_unorm16(float value, float origin, float extent)
+{
+    if (extent <= 0)
+        return 0;
+    const float t = (value - origin) / extent;
+    return (uint16_t)std::lround(std::min(1.0f, std::max(0.0f, t)) * 65535.0f);
+}
+
+// Folds the lower hemisphere of the L1-normalized direction over the diamond's edges.
+inline oct_normal oct_encode(const vec3 &n)
+{
+    const float l1 = std::fabs(n.x()) + std::fabs(n.y()) + std::fabs(n.z());
+    if (l1 == 0)
+        return oct_normal{ 0, 0 };
+    float x = n.x() / l1, y = n.y() / l1;
+    if (n.z() < 0)
+    {
+        const float fx = (1.0f - std::fabs(y)) * (x >= 0 ? 1.0f : -1.0f);
+        const float fy = (1.0f - std::fabs(x)) * (y >= 0 ? 1.0f : -1.0f);
+        x = fx;
+        y = fy;
+    }
+    return oct_normal{ (int16_t)std::lround(x * 32767.0f), (int16_t)std::lround(y * 32767.0f) };
+}
+
+// The direction only; callers that need unit length normalize it.
+inline vec3 oct_decode(const oct_normal &o)
+{
+    float x = o.x / 32767.0f, y = o.y / 32767.0f;
+    const float z = 1.0f - std::fabs(x) - std::fabs(y);
+    if (z < 0)
+    {
+        const float fx = (1.0f - std::fabs(y)) * (x >= 0 ? 1.0f : -1.0f);
+        const float fy = (1.0f - std::fabs(x)) * (y >= 0 ? 1.0f : -1.0f);
+        x = fx;
+        y = fy;
+    }
+    return vec3(x, y, z);
+}
+
+struct quantized_mesh
+{
+    std::vector<quantized_vertex> vertices;     // indexed by Mesh::indices
+    std::vector<oct_normal> normals;            // one per triangle
+    float origin[3] = { 0, 0, 0 }, scale[3] = { 0, 0, 0 };  // position = origin + q * scale
+    float uv_origin[2] = { 0, 0 }, uv_scale[2] = { 0, 0 };
+
+    // Quantized position to object space, as a row-vector matrix like worldToCamera.
+    matrix44 dequantize() const
+    {
+        return matrix44(scale[0], 0, 0, 0,
+                        0, scale[1], 0, 0,
+                        0, 0, scale[2], 0,
+                        origin[0], origin[1], origin[2], 1);
+    }
+
+    vec2 uv(uint32_t v) const
+    {
+        return vec2(uv_origin[0] + vertices[v].uv[0] * uv_scale[0], uv_origin[1] + vertices[v].uv[1] * uv_scale[1]);
+    }
+
+    size_t bytes() const { return vertices.size() * sizeof(quantized_vertex) + normals.size() * sizeof(oct_normal); }
+};
+
+#endif
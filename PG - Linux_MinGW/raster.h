@@ -0,0 +1,583 @@
+#ifndef RASTERH
+#define RASTERH
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include "vec3.h"
+#include "framebuffer.h"
+#include "counters.h"
+#include "texture.h"
+#include "trace.h"
+
+struct raster_vertex
+{
+    float x, y;     // raster position
+    float inv_w;    // 1/w, linear in raster space
+    float u, v;     // texture coordinates pre-divided by w
+};
+
+// Scales the RGB channels of an ARGB color by intensity/256, alpha is kept.
+inline uint32_t modulate(uint32_t c, int intensity)
+{
+    const uint32_t rb = (((c & 0x00ff00ffu) * intensity) >> 8) & 0x00ff00ffu;
+    const uint32_t g = (((c & 0x0000ff00u) * intensity) >> 8) & 0x0000ff00u;
+    return (c & 0xff000000u) | rb | g;
+}
+
+enum cull_mode { CULL_NONE, CULL_BACK, CULL_FRONT };
+enum shade_mode { SHADE_FLAT, SHADE_LAMBERT, SHADE_TEXTURED };
+
+// Everything that changes how a draw is rasterized.
+struct pipeline_state
+{
+    int cull = CULL_BACK;
+    int shade = SHADE_TEXTURED;
+    bool depth_test = true;
+    bool blend = false;
+    bool wireframe = false;
+    uint32_t color = 0xffffffffu;   // base color, its alpha is used when blending
+};
+
+// src over dst with alpha in [0, 256].
+inline uint32_t blend_over(uint32_t src, uint32_t dst, int alpha)
+{
+    const uint32_t rb = (((src & 0x00ff00ffu) * alpha + (dst & 0x00ff00ffu) * (256 - alpha)) >> 8) & 0x00ff00ffu;
+    const uint32_t g = (((src & 0x0000ff00u) * alpha + (dst & 0x0000ff00u) * (256 - alpha)) >> 8) & 0x0000ff00u;
+    return 0xff000000u | rb | g;
+}
+
+inline float edge_function(const raster_vertex &a, const raster_vertex &b, float px, float py)
+{
+    return (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+}
+
+// Half-open pixel rectangle [minX, maxX) x [minY, maxY) a draw is scissored to.
+struct tile_rect
+{
+    int minX, minY, maxX, maxY;
+};
+
+// Per-triangle values shared by all fragments.
+struct fragment_params
+{
+    uint32_t color;         // already lit for flat/lambert
+    const mip_level *tex;
+    int intensity;          // lambert term for textured fragments
+    int alpha;
+};
+
+/*  Raster setup is done in 28.4 fixed point. Vertices inside the guard band
+    (GUARD_BAND_SCALE viewports wide and tall, centered on the viewport) go
+    straight to setup and are only scissored by the bounding box; the edge
+    products there stay far inside int64 range. Anything reaching past it is
+    cut by clip_guard_band first. */
+const int SUBPIXEL_BITS = 4;
+const int SUBPIXEL_ONE = 1 << SUBPIXEL_BITS;
+const float GUARD_BAND_SCALE = 4.0f;
+const int MAX_CLIP_VERTS = 9;   // triangle + near plane + 4 guard band planes
+
+struct guard_band
+{
+    float minX, maxX, minY, maxY;
+
+    guard_band(int width, int height)
+    {
+        const float marginX = (GUARD_BAND_SCALE - 1) * 0.5f * width;
+        const float marginY = (GUARD_BAND_SCALE - 1) * 0.5f * height;
+        minX = -marginX; maxX = width + marginX;
+        minY = -marginY; maxY = height + marginY;
+    }
+
+    bool contains(float x, float y) const { return x >= minX && x <= maxX && y >= minY && y <= maxY; }
+};
+
+inline int64_t to_fixed(float v) { return (int64_t)std::lrint(v * SUBPIXEL_ONE); }
+
+/*  Sutherland-Hodgman against the guard band rectangle. Every raster_vertex
+    attribute is linear in raster space, so they are interpolated directly. */
+inline int clip_guard_band(const guard_band &g, const raster_vertex *in, int count, raster_vertex *out)
+{
+    raster_vertex tmp[MAX_CLIP_VERTS];
+    const raster_vertex *src = in;
+    raster_vertex *dst = tmp;
+
+    for (int plane = 0; plane < 4 && count > 0; plane++)
+    {
+        int n = 0;
+        for (int i = 0; i < count; i++)
+        {
+            const raster_vertex &a = src[i], &b = src[(i + 1) % count];
+            float da, db;
+            switch (plane)
+            {
+            case 0: da = a.x - g.minX; db = b.x - g.minX; break;
+            case 1: da = g.maxX - a.x; db = g.maxX - b.x; break;
+            case 2: da = a.y - g.minY; db = b.y - g.minY; break;
+            default: da = g.maxY - a.y; db = g.maxY - b.y; break;
+            }
+
+            if (da >= 0)
+                dst[n++] = a;
+            if ((da >= 0) != (db >= 0))
+            {
+                const float t = da / (da - db);
+                raster_vertex &v = dst[n++];
+                v.x = a.x + t * (b.x - a.x);
+                v.y = a.y + t * (b.y - a.y);
+                v.inv_w = a.inv_w + t * (b.inv_w - a.inv_w);
+                v.u = a.u + t * (b.u - a.u);
+                v.v = a.v + t * (b.v - a.v);
+            }
+        }
+        count = n;
+        src = dst;
+        dst = (dst == tmp) ? out : tmp;
+    }
+
+    if (src != out)
+        std::copy(src, src + count, out);
+    return count;
+}
+
+// Top-left fill rule for edges of a positive-area triangle with Y down.
+inline bool is_top_left(int64_t ax, int64_t ay, int64_t bx, int64_t by)
+{
+    return by - ay < 0 || (by == ay && bx - ax > 0);
+}
+
+/*  Half-space setup: pixel bounding box scissored to the clip rect, 24.8
+    edge functions at the first pixel center with their per-pixel steps, and
+    plane equations for 1/w, u/w and v/w. The planes are anchored at the
+    unclipped bounding box corner and evaluated per pixel rather than
+    accumulated, so a triangle split over several tiles shades exactly as if
+    it was drawn in one piece. */
+struct triangle_setup
+{
+    int minX, maxX, minY, maxY;
+    int originX, originY;       // pixel the attribute planes are evaluated from
+    int64_t row0, row1, row2;
+    int64_t dx0, dx1, dx2, dy0, dy1, dy2;
+    float iw, u, v;
+    float iwdx, iwdy, udx, udy, vdx, vdy;
+
+    bool init(const tile_rect &clip, const raster_vertex &a, raster_vertex b, raster_vertex c)
+    {
+        int64_t x0 = to_fixed(a.x), y0 = to_fixed(a.y);
+        int64_t x1 = to_fixed(b.x), y1 = to_fixed(b.y);
+        int64_t x2 = to_fixed(c.x), y2 = to_fixed(c.y);
+
+        int64_t area = (x1 - x0) * (y2 - y0) - (y1 - y0) * (x2 - x0);
+        if (area == 0)
+            return false;
+        if (area < 0)
+        {
+            std::swap(b, c);
+            std::swap(x1, x2);
+            std::swap(y1, y2);
+            area = -area;
+        }
+
+        // pixel x is covered when its center (x << 4) + 8 is inside
+        const int half = SUBPIXEL_ONE / 2;
+        originX = (int)((std::min({x0, x1, x2}) - half + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS);
+        originY = (int)((std::min({y0, y1, y2}) - half + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS);
+        minX = std::max(clip.minX, originX);
+        maxX = std::min(clip.maxX - 1, (int)((std::max({x0, x1, x2}) - half) >> SUBPIXEL_BITS));
+        minY = std::max(clip.minY, originY);
+        maxY = std::min(clip.maxY - 1, (int)((std::max({y0, y1, y2}) - half) >> SUBPIXEL_BITS));
+        if (minX > maxX || minY > maxY)
+            return false;
+
+        const int64_t px = ((int64_t)minX << SUBPIXEL_BITS) + half;
+        const int64_t py = ((int64_t)minY << SUBPIXEL_BITS) + half;
+
+        row0 = (x2 - x1) * (py - y1) - (y2 - y1) * (px - x1) - (is_top_left(x1, y1, x2, y2) ? 0 : 1);
+        row1 = (x0 - x2) * (py - y2) - (y0 - y2) * (px - x2) - (is_top_left(x2, y2, x0, y0) ? 0 : 1);
+        row2 = (x1 - x0) * (py - y0) - (y1 - y0) * (px - x0) - (is_top_left(x0, y0, x1, y1) ? 0 : 1);
+
+        dx0 = -(y2 - y1) * SUBPIXEL_ONE; dy0 = (x2 - x1) * SUBPIXEL_ONE;
+        dx1 = -(y0 - y2) * SUBPIXEL_ONE; dy1 = (x0 - x2) * SUBPIXEL_ONE;
+        dx2 = -(y1 - y0) * SUBPIXEL_ONE; dy2 = (x1 - x0) * SUBPIXEL_ONE;
+
+        // attribute planes in pixel units, from the snapped positions
+        const float scale = 1.0f / SUBPIXEL_ONE;
+        const float ex1 = (x1 - x0) * scale, ey1 = (y1 - y0) * scale;
+        const float ex2 = (x2 - x0) * scale, ey2 = (y2 - y0) * scale;
+        const float invArea = 1.0f / (area * scale * scale);
+        const float ox = ((int64_t)originX * SUBPIXEL_ONE + half - x0) * scale;
+        const float oy = ((int64_t)originY * SUBPIXEL_ONE + half - y0) * scale;
+
+        plane(a.inv_w, b.inv_w, c.inv_w, ex1, ey1, ex2, ey2, invArea, ox, oy, iw, iwdx, iwdy);
+        plane(a.u, b.u, c.u, ex1, ey1, ex2, ey2, invArea, ox, oy, u, udx, udy);
+        plane(a.v, b.v, c.v, ex1, ey1, ex2, ey2, invArea, ox, oy, v, vdx, vdy);
+        return true;
+    }
+
+    static void plane(float a0, float a1, float a2, float ex1, float ey1, float ex2, float ey2,
+                      float invArea, float ox, float oy, float &start, float &ddx, float &ddy)
+    {
+        ddx = ((a1 - a0) * ey2 - (a2 - a0) * ey1) * invArea;
+        ddy = ((a2 - a0) * ex1 - (a1 - a0) * ex2) * invArea;
+        start = a0 + ddx * ox + ddy * oy;
+    }
+};
+
+/*  Specialized fill: Shade, Depth and Blend are compile time constants, so the
+    pixel loop carries no branch on the pipeline configuration. When shading is
+    textured, u/w, v/w and 1/w are stepped linearly and divided per pixel
+    (perspective correct). Vertices must already be inside the guard band. */
+template <int Shade, bool Depth, bool Blend>
+inline void fill_triangle(framebuffer &fb, const tile_rect &clip, const raster_vertex &v0, const raster_vertex &v1, const raster_vertex &v2,
+                          const fragment_params &frag)
+{
+    triangle_setup t;
+    if (!t.init(clip, v0, v1, v2))
+        return;
+
+    const mip_level *tex = frag.tex;
+    const uint32_t color = frag.color;
+    const int intensity = frag.intensity, alpha = frag.alpha;
+    uint32_t written = 0;
+
+    for (int y = t.minY; y <= t.maxY; y++)
+    {
+        int64_t e0 = t.row0, e1 = t.row1, e2 = t.row2;
+        const float fy = (float)(y - t.originY);
+        const float iwRow = t.iw + t.iwdy * fy, uRow = t.u + t.udy * fy, vRow = t.v + t.vdy * fy;
+        float fx = (float)(t.minX - t.originX);
+        size_t idx = (size_t)y * fb.width + t.minX;
+
+        for (int x = t.minX; x <= t.maxX; x++, idx++, fx += 1.0f)
+        {
+            if ((e0 | e1 | e2) >= 0)
+            {
+                const float iw = iwRow + t.iwdx * fx;
+                if (!Depth || iw > fb.depth[idx])
+                {
+                    if (Depth)
+                        fb.depth[idx] = iw;
+
+                    uint32_t c = color;
+                    if (Shade == SHADE_TEXTURED)
+                    {
+                        const float w = 1.0f / iw;
+                        const float u = (uRow + t.udx * fx) * w;
+                        const float v = (vRow + t.vdx * fx) * w;
+                        c = modulate(tex->sample(u, v), intensity);
+                    }
+                    if (Blend)
+                        c = blend_over(c, fb.color[idx], alpha);
+                    fb.color[idx] = c;
+                    written++;
+                }
+            }
+            e0 += t.dx0;
+            e1 += t.dx1;
+            e2 += t.dx2;
+        }
+        t.row0 += t.dy0;
+        t.row1 += t.dy1;
+        t.row2 += t.dy2;
+    }
+    counter_add(COUNTER_PIXELS_WRITTEN, written);
+}
+
+/*  Same fill, reading the pipeline configuration at run time for every pixel.
+    Kept as the reference the specialized instances are benchmarked against. */
+inline void fill_triangle_generic(framebuffer &fb, const tile_rect &clip, const raster_vertex &v0, const raster_vertex &v1, const raster_vertex &v2,
+                                  const fragment_params &frag, const pipeline_state &state)
+{
+    triangle_setup t;
+    if (!t.init(clip, v0, v1, v2))
+        return;
+    uint32_t written = 0;
+
+    for (int y = t.minY; y <= t.maxY; y++)
+    {
+        int64_t e0 = t.row0, e1 = t.row1, e2 = t.row2;
+        const float fy = (float)(y - t.originY);
+        const float iwRow = t.iw + t.iwdy * fy, uRow = t.u + t.udy * fy, vRow = t.v + t.vdy * fy;
+        float fx = (float)(t.minX - t.originX);
+        size_t idx = (size_t)y * fb.width + t.minX;
+
+        for (int x = t.minX; x <= t.maxX; x++, idx++, fx += 1.0f)
+        {
+            if ((e0 | e1 | e2) >= 0)
+            {
+                const float iw = iwRow + t.iwdx * fx;
+                if (!state.depth_test || iw > fb.depth[idx])
+                {
+                    if (state.depth_test)
+                        fb.depth[idx] = iw;
+
+                    uint32_t c = frag.color;
+                    if (state.shade == SHADE_TEXTURED && frag.tex)
+                    {
+                        const float w = 1.0f / iw;
+                        const float u = (uRow + t.udx * fx) * w;
+                        const float v = (vRow + t.vdx * fx) * w;
+                        c = modulate(frag.tex->sample(u, v), frag.intensity);
+                    }
+                    if (state.blend)
+                        c = blend_over(c, fb.color[idx], frag.alpha);
+                    fb.color[idx] = c;
+                    written++;
+                }
+            }
+            e0 += t.dx0;
+            e1 += t.dx1;
+            e2 += t.dx2;
+        }
+        t.row0 += t.dy0;
+        t.row1 += t.dy1;
+        t.row2 += t.dy2;
+    }
+    counter_add(COUNTER_PIXELS_WRITTEN, written);
+}
+
+// Narrows [first, last] to the DDA steps whose 16.16 coordinate start + i * step may fall in [lo, hi).
+inline void range_in(int start, int step, int lo, int hi, int &first, int &last)
+{
+    const double a = (double)lo * 65536 - start, b = (double)hi * 65536 - start;
+    if (step == 0)
+    {
+        if (a > 0 || b <= 0)
+            last = -1;
+        return;
+    }
+    const double t0 = (step > 0 ? a : b) / step, t1 = (step > 0 ? b : a) / step;
+    first = std::max(first, (int)std::max(-1.0, std::floor(t0)));
+    last = std::min(last, (int)std::min(1e9, std::ceil(t1)));
+}
+
+/*  16.16 DDA seeded from 28.4 endpoints. Both ends must be inside the guard
+    band; every pixel is scissored against clip. */
+inline void draw_line(framebuffer &fb, const tile_rect &clip, float ax, float ay, float bx, float by, uint32_t color)
+{
+    const int x0 = (int)to_fixed(ax), y0 = (int)to_fixed(ay);
+    const int dx = (int)to_fixed(bx) - x0, dy = (int)to_fixed(by) - y0;
+    const int iterations = std::max(std::abs(dx), std::abs(dy)) >> SUBPIXEL_BITS;
+
+    const int scale = 1 << (16 - SUBPIXEL_BITS);
+    int x = x0 * scale, y = y0 * scale;
+    const int stepX = iterations > 0 ? dx * scale / iterations : 0;
+    const int stepY = iterations > 0 ? dy * scale / iterations : 0;
+
+    // skip the steps that cannot land in clip (lines are binned to several tiles); the scissor stays exact
+    int first = 0, last = iterations;
+    range_in(x, stepX, clip.minX, clip.maxX, first, last);
+    range_in(y, stepY, clip.minY, clip.maxY, first, last);
+    x += first * stepX;
+    y += first * stepY;
+
+    uint32_t written = 0;
+    for (int i = first; i <= last; i++)
+    {
+        const int px = x >> 16, py = y >> 16;
+        if (px >= clip.minX && px < clip.maxX && py >= clip.minY && py < clip.maxY)
+        {
+            fb.set(px, py, color);
+            written++;
+        }
+        x += stepX;
+        y += stepY;
+    }
+    counter_add(COUNTER_PIXELS_WRITTEN, written);
+}
+
+/*  Output of the transform stage: screen-space triangles ready for setup,
+    tagged with the draw (object) they came from, and binned per tile so the
+    raster stage can work on tiles independently. Vectors are only cleared
+    between frames, never shrunk. */
+struct raster_triangle
+{
+    raster_vertex v[3];
+    fragment_params frag;
+    uint32_t draw;
+    uint8_t edges;      // wireframe: bit i set if edge v[i] v[i+1] belongs to the source polygon
+};
+
+struct frame_geometry
+{
+    std::vector<pipeline_state> draws;
+    std::vector<raster_triangle> tris;
+    std::vector<vec3> view_positions;   // camera space vertices of the indexed mesh being transformed
+    std::vector<uint32_t> object_order; // draw order of the scene's objects, instances grouped by mesh
+    std::vector<uint32_t> object_group; // per object, the first object sharing its mesh
+
+    int tile_size = 0, tiles_x = 0, tiles_y = 0;
+    std::vector<uint32_t> bin_start;    // tile t owns bin_tris[bin_start[t], bin_start[t + 1])
+    std::vector<uint32_t> bin_tris;     // triangle indices grouped by tile
+    std::vector<uint32_t> bin_cursor;
+
+    void clear()
+    {
+        draws.clear();
+        tris.clear();
+    }
+
+    tile_rect tile(int index, int width, int height) const
+    {
+        const int tx = index % tiles_x, ty = index / tiles_x;
+        return tile_rect{ tx * tile_size, ty * tile_size,
+                          std::min(width, (tx + 1) * tile_size), std::min(height, (ty + 1) * tile_size) };
+    }
+
+    int tile_count() const { return tiles_x * tiles_y; }
+    const uint32_t *bin(int t) const { return bin_tris.data() + bin_start[t]; }
+    size_t bin_size(int t) const { return bin_start[t + 1] - bin_start[t]; }
+
+    /*  Buckets every triangle into the tiles its bounding box touches, keeping
+        submission order. A counting sort into one flat array: the bins are
+        counted, turned into offsets and filled, so a change of tile count
+        (the resolution) does not give back memory that the next frame has to
+        allocate again. */
+    void bin(int width, int height, int tileSize)
+    {
+        tile_size = tileSize;
+        tiles_x = (width + tileSize - 1) / tileSize;
+        tiles_y = (height + tileSize - 1) / tileSize;
+        const int tiles = tile_count();
+
+        bin_start.assign(tiles + 1, 0);
+        for (uint32_t i = 0; i < tris.size(); i++)
+        {
+            int tx0, ty0, tx1, ty1;
+            if (tile_span(tris[i], width, height, tx0, ty0, tx1, ty1))
+                for (int ty = ty0; ty <= ty1; ty++)
+                    for (int tx = tx0; tx <= tx1; tx++)
+                        bin_start[ty * tiles_x + tx + 1]++;
+        }
+        for (int t = 0; t < tiles; t++)
+            bin_start[t + 1] += bin_start[t];
+
+        bin_tris.resize(bin_start[tiles]);
+        bin_cursor.assign(bin_start.begin(), bin_start.end() - 1);
+        for (uint32_t i = 0; i < tris.size(); i++)
+        {
+            int tx0, ty0, tx1, ty1;
+            if (tile_span(tris[i], width, height, tx0, ty0, tx1, ty1))
+                for (int ty = ty0; ty <= ty1; ty++)
+                    for (int tx = tx0; tx <= tx1; tx++)
+                        bin_tris[bin_cursor[ty * tiles_x + tx]++] = i;
+        }
+    }
+
+private:
+    // Inclusive tile range of the triangle's bounding box; false if it is off screen.
+    bool tile_span(const raster_triangle &t, int width, int height, int &tx0, int &ty0, int &tx1, int &ty1) const
+    {
+        const raster_vertex *v = t.v;
+        const int minX = std::max(0, (int)std::floor(std::min({v[0].x, v[1].x, v[2].x})));
+        const int maxX = std::min(width - 1, (int)std::ceil(std::max({v[0].x, v[1].x, v[2].x})));
+        const int minY = std::max(0, (int)std::floor(std::min({v[0].y, v[1].y, v[2].y})));
+        const int maxY = std::min(height - 1, (int)std::ceil(std::max({v[0].y, v[1].y, v[2].y})));
+        if (minX > maxX || minY > maxY)
+            return false;
+        tx0 = minX / tile_size;
+        ty0 = minY / tile_size;
+        tx1 = maxX / tile_size;
+        ty1 = maxY / tile_size;
+        return true;
+    }
+};
+
+inline void draw_edges(framebuffer &fb, const tile_rect &clip, const raster_triangle &t)
+{
+    for (int e = 0; e < 3; e++)
+    {
+        if (t.edges & (1 << e))
+        {
+            const raster_vertex &a = t.v[e], &b = t.v[(e + 1) % 3];
+            draw_line(fb, clip, a.x, a.y, b.x, b.y, t.frag.color);
+        }
+    }
+}
+
+/*  Raster stage for a run of triangles from the same draw. One instance per
+    valid (Shade, Depth, Blend, Wire) combination. */
+template <int Shade, bool Depth, bool Blend, bool Wire>
+void raster_draw(const frame_geometry &g, const uint32_t *order, size_t count, framebuffer &fb, const tile_rect &clip)
+{
+    if (Wire)
+    {
+        TRACE_ZONE("raster::draw_edges");
+        for (size_t i = 0; i < count; i++)
+            draw_edges(fb, clip, g.tris[order[i]]);
+        return;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        const raster_triangle &t = g.tris[order[i]];
+        fill_triangle<Shade, Depth, Blend>(fb, clip, t.v[0], t.v[1], t.v[2], t.frag);
+    }
+}
+
+inline void raster_draw_generic(const frame_geometry &g, const uint32_t *order, size_t count, framebuffer &fb, const tile_rect &clip,
+                                const pipeline_state &s)
+{
+    if (s.wireframe)
+    {
+        TRACE_ZONE("raster::draw_edges");
+        for (size_t i = 0; i < count; i++)
+            draw_edges(fb, clip, g.tris[order[i]]);
+        return;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        const raster_triangle &t = g.tris[order[i]];
+        fill_triangle_generic(fb, clip, t.v[0], t.v[1], t.v[2], t.frag, s);
+    }
+}
+
+typedef void (*raster_fn)(const frame_geometry &, const uint32_t *, size_t, framebuffer &, const tile_rect &);
+
+const int RASTER_STATE_COUNT = 3 * 2 * 2 * 2;
+
+// Wireframe neither samples nor tests depth nor blends: those combinations collapse onto the plain wire instance.
+template <int I>
+constexpr raster_fn raster_table_entry()
+{
+    return &raster_draw<(I % 2) ? SHADE_FLAT : I / 8, (I / 4) % 2 && !(I % 2), (I / 2) % 2 && !(I % 2), I % 2>;
+}
+
+template <std::size_t... I>
+const raster_fn *make_raster_table(std::index_sequence<I...>)
+{
+    static const raster_fn table[] = { raster_table_entry<I>()... };
+    return table;
+}
+
+inline raster_fn select_raster(const pipeline_state &s)
+{
+    static const raster_fn *table = make_raster_table(std::make_index_sequence<RASTER_STATE_COUNT>());
+    return table[((s.shade * 2 + s.depth_test) * 2 + s.blend) * 2 + s.wireframe];
+}
+
+/*  Rasterizes the bin of tile t into clip. The instance is selected once
+    per run of triangles sharing a draw. */
+inline void rasterize(const frame_geometry &g, int t, framebuffer &fb, const tile_rect &clip, bool specialize)
+{
+    const uint32_t *order = g.bin(t);
+    const size_t count = g.bin_size(t);
+    size_t i = 0;
+    while (i < count)
+    {
+        const uint32_t draw = g.tris[order[i]].draw;
+        size_t end = i + 1;
+        while (end < count && g.tris[order[end]].draw == draw)
+            end++;
+
+        const pipeline_state &s = g.draws[draw];
+        if (specialize)
+            select_raster(s)(g, order + i, end - i, fb, clip);
+        else
+            raster_draw_generic(g, order + i, end - i, fb, clip, s);
+        i = end;
+    }
+}
+
+#endif
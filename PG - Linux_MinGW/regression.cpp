@@ -0,0 +1,329 @@
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include "camera.h"
+#include "camera_path.h"
+#include "frame_pipeline.h"
+#include "image_io.h"
+#include "scene_generator.h"
+#include "weld.h"
+#include "mesh_optimize.h"
+#include "meshlet.h"
+
+// Golden-image regression and frame-time benchmark. Each scene is rendered
+// along a fixed orbit and every frame is compared with the reference image
+// stored in golden/ (per channel, with a tolerance); then the path is timed
+// after a warmup over several repetitions. Results go to stdout as JSON, a
+// summary to stderr; the exit code is non-zero if any image fails.
+//
+// Run from this directory. --update rewrites the golden images after an
+// intended change in the output.
+//
+// Scenes that draw the same picture another way (welded, clustered,
+// quantized or instanced meshes) are checked against the images of the
+// scene they stand for, and --update leaves those images alone.
+
+static void usage()
+{
+	fprintf(stderr,
+		"usage: regression [options]\n"
+		"  --golden DIR        reference images (golden)\n"
+		"  --update            write the current frames as the new references\n"
+		"  --tolerance N       largest per-channel difference that still matches (2)\n"
+		"  --max-bad F         fraction of pixels allowed over the tolerance (0.001)\n"
+		"  --frames N          views per orbit (8, as in the golden images)\n"
+		"  --warmup N          untimed passes over the path before timing (2)\n"
+		"  --reps N            timed passes over the path (10)\n"
+		"  --pipelined         render through frame_pipeline instead of immediately\n"
+		"  --scene NAME        only this scene, repeatable\n");
+}
+
+struct scene
+{
+	std::string name;
+	std::string reference;		// golden images compared against, name when empty
+	pipeline_state state;
+	std::vector<Obj> objects;
+	std::vector<camera_view> path;
+};
+
+static std::vector<scene> make_scenes(int frames)
+{
+	std::shared_ptr<texture> checker = texture::checkerboard(256, 16, 0xffe0e0e0, 0xff3070c0);
+	const Obj flat("./objects/monkey.obj", checker);
+	const Obj smooth("./objects/monkey_smooth.obj", checker);
+
+	// monkey_smooth prepared by one of the load-time passes
+	auto prepared = [&](bool cluster, bool quantize) {
+		Mesh mesh = *smooth.mesh;
+		weld(mesh);
+		optimize_mesh(mesh);
+		if (cluster)
+			build_meshlets(mesh);
+		if (quantize)
+			mesh.quantize();
+		return Obj(std::make_shared<const Mesh>(std::move(mesh)), matrix44(), checker);
+	};
+
+	std::vector<scene> scenes(9);
+	scenes[0].name = "monkey";
+	scenes[0].objects.push_back(flat);
+	scenes[1].name = "monkey_smooth";
+	scenes[1].state.shade = SHADE_LAMBERT;
+	scenes[1].objects.push_back(smooth);
+	scenes[2].name = "monkey_smooth_x16";
+	scenes[2].objects.push_back(smooth);
+	scenes[2].objects[0].mesh = std::make_shared<const Mesh>(to_mesh([&](auto emit) { instance_grid(*smooth.mesh, 16, 1.25f, emit); }));
+	scenes[3].name = "monkey_smooth_x64";
+	scenes[3].objects.push_back(smooth);
+	scenes[3].objects[0].mesh = std::make_shared<const Mesh>(to_mesh([&](auto emit) { instance_grid(*smooth.mesh, 64, 1.25f, emit); }));
+	scenes[4].name = "monkey_wireframe";
+	scenes[4].state.wireframe = true;
+	scenes[4].state.cull = CULL_NONE;
+	scenes[4].objects.push_back(flat);
+
+	scenes[5].name = "monkey_smooth_welded";
+	scenes[5].objects.push_back(prepared(false, false));
+	scenes[6].name = "monkey_smooth_meshlets";
+	scenes[6].objects.push_back(prepared(true, false));
+	scenes[7].name = "monkey_smooth_quantized";
+	scenes[7].objects.push_back(prepared(false, true));
+	for (int i = 5; i <= 7; i++) {
+		scenes[i].reference = "monkey_smooth";
+		scenes[i].state = scenes[1].state;
+	}
+	scenes[8].name = "monkey_smooth_x16_instanced";
+	scenes[8].reference = "monkey_smooth_x16";
+	for (size_t k = 0; k < 16; k++) {
+		Obj copy = smooth;
+		const vec3 offset = grid_offset(*smooth.mesh, 16, 1.25f, k);
+		for (int axis = 0; axis < 3; axis++)
+			copy.model[3][axis] = offset[axis];
+		scenes[8].objects.push_back(copy);
+	}
+
+	for (scene& s : scenes) {
+		vec3 center;
+		float radius;
+		// instanced scenes frame like the baked grid they stand for
+		const scene& framed = s.reference.empty() ? s : *std::find_if(scenes.begin(), scenes.end(), [&](const scene& o) { return o.name == s.reference; });
+		orbit_framing(framed.objects[0].mesh->bounds, std::min(60.0f, 60.0f * WIDTH / HEIGHT), center, radius);
+		s.path = orbit_path(frames, center, radius, 20.0f);
+	}
+	return scenes;
+}
+
+static camera view_camera(const scene& s, const camera_view& v)
+{
+	camera cam(v.from, v.at, v.up, 60.0f, 0.1f, 1000.0f, WIDTH, HEIGHT);
+	cam.state = s.state;
+	return cam;
+}
+
+/*  Renders every view of s, calling frame(i, fb) in path order. The
+    pipelined path hands each frame back one submit late, so the last
+    frame comes out of the drain. */
+template <class F>
+static void render_path(const scene& s, bool pipelined, frame_pipeline& pipeline, framebuffer& fb, frame_geometry& geom, F frame)
+{
+	if (pipelined) {
+		size_t done = 0;
+		for (const camera_view& v : s.path) {
+			pipeline.submit(view_camera(s, v), s.objects);
+			if (const framebuffer* out = pipeline.acquire()) {
+				frame(done++, *out);
+				pipeline.release();
+			}
+		}
+		while (const framebuffer* out = pipeline.acquire(true)) {
+			frame(done++, *out);
+			pipeline.release();
+		}
+	}
+	else {
+		for (size_t i = 0; i < s.path.size(); i++) {
+			fb.clear();
+			view_camera(s, s.path[i]).render_scene(s.objects, fb, geom);
+			frame(i, fb);
+		}
+	}
+}
+
+struct image_check
+{
+	const char* status = "pass";	// pass, fail, missing or updated
+	int max_diff = 0;
+	size_t bad_pixels = 0;		// most over the tolerance in any frame
+	int worst_frame = -1;		// the one with max_diff
+};
+
+// Largest per-channel difference and the number of pixels whose difference exceeds tolerance.
+static int compare(const framebuffer& a, const framebuffer& b, int tolerance, size_t& bad)
+{
+	int worst = 0;
+	bad = 0;
+	for (size_t i = 0; i < a.color.size(); i++) {
+		int diff = 0;
+		for (int shift = 0; shift < 24; shift += 8)
+			diff = std::max(diff, std::abs((int)((a.color[i] >> shift) & 0xff) - (int)((b.color[i] >> shift) & 0xff)));
+		worst = std::max(worst, diff);
+		bad += diff > tolerance;
+	}
+	return worst;
+}
+
+// Two-sided 95% Student t quantiles for 1..30 degrees of freedom, normal beyond.
+static double t95(int dof)
+{
+	static const double table[30] = { 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+		2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+		2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+	return dof < 1 ? 0.0 : dof <= 30 ? table[dof - 1] : 1.960;
+}
+
+struct timing
+{
+	double mean = 0, stddev = 0, ci95 = 0, min = 0, median = 0, max = 0;
+};
+
+// Statistics of the per-frame time of each repetition.
+static timing summarize(std::vector<double> reps)
+{
+	timing t;
+	const size_t n = reps.size();
+	if (n == 0)
+		return t;
+	for (double r : reps)
+		t.mean += r;
+	t.mean /= n;
+	for (double r : reps)
+		t.stddev += (r - t.mean) * (r - t.mean);
+	t.stddev = n > 1 ? std::sqrt(t.stddev / (n - 1)) : 0.0;
+	t.ci95 = t95((int)n - 1) * t.stddev / std::sqrt((double)n);
+	std::sort(reps.begin(), reps.end());
+	t.min = reps.front();
+	t.max = reps.back();
+	t.median = n % 2 ? reps[n / 2] : 0.5 * (reps[n / 2 - 1] + reps[n / 2]);
+	return t;
+}
+
+int main(int argc, char* argv[])
+{
+	std::string golden = "golden";
+	bool update = false, pipelined = false;
+	int tolerance = 2, frames = 8, warmup = 2, reps = 10;
+	double maxBad = 0.001;
+	std::vector<std::string> only;
+	for (int i = 1; i < argc; i++) {
+		const bool value = i + 1 < argc;
+		if (strcmp(argv[i], "--golden") == 0 && value)
+			golden = argv[++i];
+		else if (strcmp(argv[i], "--update") == 0)
+			update = true;
+		else if (strcmp(argv[i], "--tolerance") == 0 && value)
+			tolerance = std::max(0, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--max-bad") == 0 && value)
+			maxBad = atof(argv[++i]);
+		else if (strcmp(argv[i], "--frames") == 0 && value)
+			frames = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--warmup") == 0 && value)
+			warmup = std::max(0, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--reps") == 0 && value)
+			reps = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--pipelined") == 0)
+			pipelined = true;
+		else if (strcmp(argv[i], "--scene") == 0 && value)
+			only.push_back(argv[++i]);
+		else {
+			usage();
+			return 1;
+		}
+	}
+
+	std::vector<scene> scenes = make_scenes(frames);
+	if (scenes[0].objects[0].mesh->triangle_count() == 0 || scenes[1].objects[0].mesh->triangle_count() == 0) {
+		fprintf(stderr, "cannot load objects/monkey.obj and objects/monkey_smooth.obj; run from the project directory\n");
+		return 1;
+	}
+
+	frame_pipeline pipeline;
+	framebuffer fb(WIDTH, HEIGHT), reference;
+	frame_geometry geom;
+	std::vector<uint8_t> file;
+	bool passed = true;
+
+	printf("{\"width\":%d,\"height\":%d,\"frames\":%d,\"warmup\":%d,\"repetitions\":%d,\"pipelined\":%s,"
+		"\"tolerance\":%d,\"max_bad\":%g,\"threads\":%u,\"scenes\":[",
+		WIDTH, HEIGHT, frames, warmup, reps, pipelined ? "true" : "false", tolerance, maxBad, std::thread::hardware_concurrency());
+	fprintf(stderr, "%-28s %9s %9s %9s %9s %9s  %s\n", "scene", "tris", "ms/frame", "+-95%", "min", "median", "golden");
+
+	bool first = true;
+	for (const scene& s : scenes) {
+		if (!only.empty() && std::find(only.begin(), only.end(), s.name) == only.end())
+			continue;
+
+		// correctness first, on an untimed pass
+		image_check check;
+		const std::string& images = s.reference.empty() ? s.name : s.reference;
+		render_path(s, pipelined, pipeline, fb, geom, [&](size_t i, const framebuffer& out) {
+			char path[512];
+			snprintf(path, sizeof(path), "%s/%s_%02d.qoi", golden.c_str(), images.c_str(), (int)i);
+			if (update && images == s.name) {
+				std::vector<uint8_t> encoded;
+				encode_qoi(out, encoded);
+				if (!write_file(path, encoded)) {
+					fprintf(stderr, "cannot write %s\n", path);
+					check.status = "fail";
+				}
+				else if (strcmp(check.status, "fail") != 0)
+					check.status = "updated";
+				return;
+			}
+			if (!read_file(path, file) || !decode_qoi(file.data(), file.size(), reference)) {
+				check.status = "missing";
+				return;
+			}
+			size_t bad = out.color.size();
+			const int diff = reference.width == out.width && reference.height == out.height ? compare(out, reference, tolerance, bad) : 255;
+			if (diff > check.max_diff || check.worst_frame < 0) {
+				check.max_diff = diff;
+				check.worst_frame = (int)i;
+			}
+			check.bad_pixels = std::max(check.bad_pixels, bad);
+			if (bad > maxBad * out.color.size())
+				check.status = "fail";
+		});
+		if (strcmp(check.status, "pass") != 0 && strcmp(check.status, "updated") != 0)
+			passed = false;
+
+		for (int i = 0; i < warmup; i++)
+			render_path(s, pipelined, pipeline, fb, geom, [](size_t, const framebuffer&) {});
+		std::vector<double> perFrame;
+		for (int r = 0; r < reps; r++) {
+			const auto start = std::chrono::steady_clock::now();
+			render_path(s, pipelined, pipeline, fb, geom, [](size_t, const framebuffer&) {});
+			perFrame.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / s.path.size());
+		}
+		const timing t = summarize(perFrame);
+
+		size_t tris = 0;
+		for (const Obj& o : s.objects)
+			tris += o.mesh->triangle_count();
+		printf("%s{\"name\":\"%s\",\"triangles\":%zu,\"frame_ms\":{\"mean\":%.4f,\"stddev\":%.4f,\"ci95\":%.4f,"
+			"\"min\":%.4f,\"median\":%.4f,\"max\":%.4f},\"golden\":{\"status\":\"%s\",\"max_diff\":%d,\"bad_pixels\":%zu,\"worst_frame\":%d}}",
+			first ? "" : ",", s.name.c_str(), tris, t.mean, t.stddev, t.ci95, t.min, t.median, t.max,
+			check.status, check.max_diff, check.bad_pixels, check.worst_frame);
+		fprintf(stderr, "%-28s %9zu %9.3f %9.3f %9.3f %9.3f  %s", s.name.c_str(), tris, t.mean, t.ci95, t.min, t.median, check.status);
+		if (check.worst_frame >= 0 && check.max_diff > 0)
+			fprintf(stderr, " (max diff %d in frame %d, up to %zu pixels over)", check.max_diff, check.worst_frame, check.bad_pixels);
+		fprintf(stderr, "\n");
+		first = false;
+	}
+	printf("],\"passed\":%s}\n", passed ? "true" : "false");
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,187 @@
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "render_protocol.h"
+
+// Load generator for the render server: several connections, each keeping
+// a number of requests in flight over a set of meshes and orbit views, with
+// client-side latency percentiles and the server's own stats at the end.
+
+static void usage()
+{
+	fprintf(stderr,
+		"usage: render_client [options]\n"
+		"  --socket PATH       server socket (/tmp/renderer.sock)\n"
+		"  --connections N     concurrent clients (4)\n"
+		"  --requests N        requests per client (50)\n"
+		"  --in-flight N       requests each client keeps outstanding (4)\n"
+		"  --mesh PATH         mesh to request, repeatable (objects/monkey_smooth.obj)\n"
+		"  --size WxH          image size (600x400)\n"
+		"  --format FORMAT     ppm, pam, qoi or png (png)\n"
+		"  --save PREFIX       write the images of the first client to PREFIX_0000.<ext>, ...\n");
+}
+
+struct client_result
+{
+	std::vector<float> latencies;	// ms per completed request
+	int errors = 0;
+	bool broken = false;
+};
+
+static bool read_stats(const char* path, std::string& json)
+{
+	const int fd = unix_connect(path);
+	if (fd < 0)
+		return false;
+	socket_reader reader(fd);
+	std::string line;
+	std::vector<uint8_t> payload;
+	size_t size;
+	const bool ok = send_all(fd, "stats\n", 6) && reader.read_line(line) && sscanf(line.c_str(), "stats %zu", &size) == 1 &&
+		reader.read_bytes(payload, size);
+	close(fd);
+	json.assign(payload.begin(), payload.end());
+	return ok;
+}
+
+int main(int argc, char* argv[])
+{
+	const char* path = "/tmp/renderer.sock";
+	const char* save = nullptr;
+	int connections = 4, requests = 50, inFlight = 4;
+	std::vector<std::string> meshes;
+	render_request base;
+	for (int i = 1; i < argc; i++) {
+		const bool value = i + 1 < argc;
+		if (strcmp(argv[i], "--socket") == 0 && value)
+			path = argv[++i];
+		else if (strcmp(argv[i], "--connections") == 0 && value)
+			connections = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--requests") == 0 && value)
+			requests = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--in-flight") == 0 && value)
+			inFlight = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--mesh") == 0 && value)
+			meshes.push_back(argv[++i]);
+		else if (strcmp(argv[i], "--size") == 0 && value)
+			sscanf(argv[++i], "%dx%d", &base.width, &base.height);
+		else if (strcmp(argv[i], "--format") == 0 && value && image_format_from_name(argv[i + 1], base.format))
+			i++;
+		else if (strcmp(argv[i], "--save") == 0 && value)
+			save = argv[++i];
+		else {
+			usage();
+			return 1;
+		}
+	}
+	if (meshes.empty())
+		meshes.push_back("objects/monkey_smooth.obj");
+	const std::vector<camera_view> views = orbit_path(36, vec3(0, 0, 0), 3.5f, 20.0f);
+
+	typedef std::chrono::steady_clock clock;
+	std::vector<client_result> results(connections);
+	auto client = [&](int c) {
+		client_result& result = results[c];
+		const int fd = unix_connect(path);
+		if (fd < 0) {
+			fprintf(stderr, "cannot connect to %s: %s\n", path, strerror(errno));
+			result.broken = true;
+			return;
+		}
+		socket_reader reader(fd);
+		std::unordered_map<uint64_t, clock::time_point> sent;
+		std::string line;
+		std::vector<uint8_t> payload;
+		int next = 0, received = 0;
+
+		auto send_next = [&] {
+			render_request r = base;
+			r.id = (uint64_t)c * requests + next;
+			r.mesh = meshes[next % meshes.size()];
+			r.view = views[(c * 7 + next) % views.size()];
+			const std::string text = format_render_request(r);
+			sent[r.id] = clock::now();
+			next++;
+			return send_all(fd, text.data(), text.size());
+		};
+
+		while (next < std::min(requests, inFlight))
+			if (!send_next())
+				result.broken = true;
+		while (!result.broken && received < requests) {
+			unsigned long long id;
+			char format[8];
+			int width, height;
+			size_t size;
+			if (!reader.read_line(line)) {
+				result.broken = true;
+				break;
+			}
+			if (sscanf(line.c_str(), "image %llu %7s %d %d %zu", &id, format, &width, &height, &size) == 5) {
+				if (!reader.read_bytes(payload, size)) {
+					result.broken = true;
+					break;
+				}
+				if (save && c == 0) {
+					char file[512];
+					snprintf(file, sizeof(file), "%s_%04llu.%s", save, id, format);
+					write_file(file, payload);
+				}
+			}
+			else if (sscanf(line.c_str(), "error %llu", &id) == 1) {
+				fprintf(stderr, "%s\n", line.c_str());
+				result.errors++;
+			}
+			else {
+				fprintf(stderr, "unexpected reply: %s\n", line.c_str());
+				result.broken = true;
+				break;
+			}
+
+			auto found = sent.find(id);
+			if (found != sent.end()) {
+				result.latencies.push_back(std::chrono::duration<float, std::milli>(clock::now() - found->second).count());
+				sent.erase(found);
+			}
+			received++;
+			if (next < requests && !send_next())
+				result.broken = true;
+		}
+		close(fd);
+	};
+
+	const auto start = clock::now();
+	std::vector<std::thread> threads;
+	for (int c = 0; c < connections; c++)
+		threads.emplace_back(client, c);
+	for (std::thread& t : threads)
+		t.join();
+	const double seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+	std::vector<float> latencies;
+	int errors = 0, broken = 0;
+	for (const client_result& r : results) {
+		latencies.insert(latencies.end(), r.latencies.begin(), r.latencies.end());
+		errors += r.errors;
+		broken += r.broken;
+	}
+	std::sort(latencies.begin(), latencies.end());
+	auto percentile = [&](float p) {
+		return latencies.empty() ? 0.0f : latencies[std::min(latencies.size() - 1, (size_t)(p / 100.0f * latencies.size()))];
+	};
+
+	printf("%zu replies (%d errors, %d connections lost) in %.3f s: %.1f requests/s\n", latencies.size(), errors, broken,
+		seconds, seconds > 0 ? latencies.size() / seconds : 0.0);
+	printf("latency ms: p50 %.3f  p95 %.3f  p99 %.3f  max %.3f\n", percentile(50), percentile(95), percentile(99),
+		latencies.empty() ? 0.0f : latencies.back());
+	std::string stats;
+	if (read_stats(path, stats))
+		printf("server: %s\n", stats.c_str());
+	return errors || broken ? 1 : 0;
+}
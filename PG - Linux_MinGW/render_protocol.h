@@ -0,0 +1,273 @@
+#ifndef RENDERPROTOCOLH
+#define RENDERPROTOCOLH
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "camera_path.h"
+#include "image_io.h"
+#include "camera.h"
+
+/*  Wire format of the render server, over a Unix domain stream socket.
+
+    Requests are single lines of words:
+        render id=7 mesh=objects/monkey.obj from=0,0.5,3 at=0,0,0 [up=0,1,0]
+               [fov=60] [size=600x400] [format=png] [shade=textured]
+        stats
+    Replies start with a line; image and stats replies are followed by
+    exactly <bytes> bytes of payload:
+        image <id> <format> <width> <height> <bytes>
+        error <id> <message>
+        stats <bytes>          (a JSON object)
+    A connection may have any number of requests in flight; replies come
+    back as renders finish, not in request order, so match them by id. */
+
+struct render_request
+{
+    uint64_t id = 0;
+    std::string mesh;
+    camera_view view = { vec3(0, 0, 5), vec3(0, 0, 0), vec3(0, 1, 0) };
+    float fov = 60.0f;
+    int width = WIDTH, height = HEIGHT;
+    image_format format = IMAGE_PNG;
+    int shade = SHADE_TEXTURED;
+};
+
+const char *const SHADE_NAMES[] = { "flat", "lambert", "textured" };
+
+// Largest image a request may ask for, per side.
+const int RENDER_MAX_SIZE = 8192;
+
+inline bool parse_vec3(const char *text, vec3 &v)
+{
+    float x, y, z;
+    if (sscanf(text, "%f,%f,%f", &x, &y, &z) != 3)
+        return false;
+    v = vec3(x, y, z);
+    return true;
+}
+
+// Parses the words after "render"; error names the first bad one.
+inline bool parse_render_request(const char *line, render_request &r, std::string &error)
+{
+    bool haveMesh = false;
+    const char *p = line;
+    while (*p)
+    {
+        while (*p == ' ' || *p == '\t')
+            p++;
+        const char *end = p;
+        while (*end && *end != ' ' && *end != '\t')
+            end++;
+        if (end == p)
+            break;
+        const std::string word(p, end);
+        p = end;
+
+        const size_t eq = word.find('=');
+        if (eq == std::string::npos)
+        {
+            error = "expected key=value: " + word;
+            return false;
+        }
+        const std::string key = word.substr(0, eq);
+        const char *value = word.c_str() + eq + 1;
+        bool ok = true;
+        if (key == "id")
+            r.id = strtoull(value, nullptr, 10);
+        else if (key == "mesh")
+        {
+            r.mesh = value;
+            haveMesh = !r.mesh.empty();
+        }
+        else if (key == "from")
+            ok = parse_vec3(value, r.view.from);
+        else if (key == "at")
+            ok = parse_vec3(value, r.view.at);
+        else if (key == "up")
+            ok = parse_vec3(value, r.view.up);
+        else if (key == "fov")
+            ok = (r.fov = (float)atof(value)) > 0.0f && r.fov < 180.0f;
+        else if (key == "size")
+            ok = sscanf(value, "%dx%d", &r.width, &r.height) == 2 && r.width > 0 && r.height > 0 &&
+                 r.width <= RENDER_MAX_SIZE && r.height <= RENDER_MAX_SIZE;
+        else if (key == "format")
+            ok = image_format_from_name(value, r.format);
+        else if (key == "shade")
+        {
+            ok = false;
+            for (int s = 0; s < 3; s++)
+                if (strcmp(value, SHADE_NAMES[s]) == 0)
+                {
+                    r.shade = s;
+                    ok = true;
+                }
+        }
+        else
+            ok = false;
+        if (!ok)
+        {
+            error = "bad " + word;
+            return false;
+        }
+    }
+    if (!haveMesh)
+    {
+        error = "no mesh";
+        return false;
+    }
+    return true;
+}
+
+inline std::string format_render_request(const render_request &r)
+{
+    char line[1024];
+    snprintf(line, sizeof(line), "render id=%llu mesh=%s from=%g,%g,%g at=%g,%g,%g up=%g,%g,%g fov=%g size=%dx%d format=%s shade=%s\n",
+             (unsigned long long)r.id, r.mesh.c_str(), r.view.from.x(), r.view.from.y(), r.view.from.z(),
+             r.view.at.x(), r.view.at.y(), r.view.at.z(), r.view.up.x(), r.view.up.y(), r.view.up.z(),
+             r.fov, r.width, r.height, IMAGE_EXTENSIONS[r.format], SHADE_NAMES[r.shade]);
+    return line;
+}
+
+inline int unix_socket(const char *path, sockaddr_un &address)
+{
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    return socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+}
+
+// Binds path (replacing a stale socket file) and listens; -1 with errno on failure.
+inline int unix_listen(const char *path)
+{
+    sockaddr_un address;
+    const int fd = unix_socket(path, address);
+    if (fd < 0)
+        return -1;
+    unlink(path);
+    if (bind(fd, (const sockaddr *)&address, sizeof(address)) != 0 || listen(fd, SOMAXCONN) != 0)
+    {
+        const int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+inline int unix_connect(const char *path)
+{
+    sockaddr_un address;
+    const int fd = unix_socket(path, address);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, (const sockaddr *)&address, sizeof(address)) != 0)
+    {
+        const int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+// Sends everything or fails; a closed peer is an error, not a SIGPIPE.
+inline bool send_all(int fd, const void *data, size_t size)
+{
+    const char *p = (const char *)data;
+    while (size > 0)
+    {
+        const ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+/*  Buffered reads of reply/request lines and payloads from a socket. fill()
+    reads whatever is available once, for callers that poll; the blocking
+    helpers loop on it. */
+class socket_reader
+{
+public:
+    explicit socket_reader(int fd) : fd(fd) {}
+
+    // One recv into the buffer; false on EOF or error.
+    bool fill()
+    {
+        char chunk[65536];
+        ssize_t n;
+        do
+            n = recv(fd, chunk, sizeof(chunk), 0);
+        while (n < 0 && errno == EINTR);
+        if (n <= 0)
+            return false;
+        buffer.append(chunk, n);
+        return true;
+    }
+
+    // Takes a complete line (without the newline) if one is buffered.
+    bool next_line(std::string &line)
+    {
+        const size_t end = buffer.find('\n', start);
+        if (end == std::string::npos)
+        {
+            compact();
+            return false;
+        }
+        line.assign(buffer, start, end - start);
+        start = end + 1;
+        return true;
+    }
+
+    size_t pending() const { return buffer.size() - start; }
+
+    bool read_line(std::string &line)
+    {
+        while (!next_line(line))
+            if (!fill())
+                return false;
+        return true;
+    }
+
+    bool read_bytes(std::vector<uint8_t> &out, size_t size)
+    {
+        while (pending() < size)
+            if (!fill())
+                return false;
+        out.assign(buffer.begin() + start, buffer.begin() + start + size);
+        start += size;
+        return true;
+    }
+
+private:
+    void compact()
+    {
+        buffer.erase(0, start);
+        start = 0;
+    }
+
+    int fd;
+    std::string buffer;
+    size_t start = 0;
+};
+
+#endif
@@ -0,0 +1,538 @@
+#ifndef RENDERSERVERH
+#define RENDERSERVERH
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <future>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <poll.h>
+#include <fcntl.h>
+#include "render_protocol.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+/*  Renders on behalf of other local processes (see render_protocol.h).
+
+    One thread owns the sockets: it accepts connections, reads request
+    lines and queues them per mesh. Requests for the same mesh are
+    coalesced: a worker takes up to max_batch of them at once and renders
+    them back to back with the mesh fetched once from a small LRU, so a
+    burst of views of one model pays the load (and the cold caches) once.
+    Meshes are served in the order their oldest request arrived, and a
+    mesh with more than a batch queued goes to the back of that order, so
+    one busy mesh cannot starve the others.
+
+    Replies never block: workers and the io thread write what the socket
+    takes at once and leave the rest in the connection's output buffer,
+    which the io thread drains as the client reads. A client that stops
+    reading only grows its own buffer, and loses the connection once that
+    passes max_output. */
+
+struct server_options
+{
+    unsigned workers = 0;       // 0: one per hardware thread
+    size_t meshes = 4;          // meshes kept loaded
+    size_t max_batch = 16;
+    size_t max_output = 64 << 20;   // reply bytes buffered for one client
+};
+
+/*  Loaded meshes by path, least recently used first out. Entries are
+    futures so a mesh is loaded once even when several workers want it at
+    the same time; the others wait for the first. */
+class mesh_cache
+{
+public:
+    typedef std::shared_ptr<const std::vector<Obj>> scene_ptr;
+
+    explicit mesh_cache(size_t capacity) : capacity(std::max<size_t>(1, capacity)) {}
+
+    // The scene holding path's mesh (empty if it cannot be loaded); hit tells whether it was cached.
+    scene_ptr get(const std::string &path, bool &hit)
+    {
+        std::promise<scene_ptr> loading;
+        std::shared_future<scene_ptr> result;
+        uint64_t serial = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto found = index.find(path);
+            hit = found != index.end();
+            if (hit)
+            {
+                order.splice(order.begin(), order, found->second);
+                result = found->second->scene;
+            }
+            else
+            {
+                result = loading.get_future().share();
+                serial = ++loads;
+                order.push_front(entry{ path, result, serial });
+                index[path] = order.begin();
+                if (order.size() > capacity)
+                {
+                    index.erase(order.back().path);
+                    order.pop_back();   // workers still rendering it keep their own reference
+                }
+            }
+        }
+        if (!hit)
+        {
+            TRACE_ZONE("mesh_cache::load");
+            auto scene = std::make_shared<std::vector<Obj>>();
+            scene->push_back(Obj(path.c_str(), checker()));
+            if (scene->back().mesh->triangle_count() == 0)
+            {
+                scene.reset();
+                forget(path, serial);   // the file may appear later
+            }
+            loading.set_value(scene);
+        }
+        return result.get();
+    }
+
+private:
+    void forget(const std::string &path, uint64_t serial)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = index.find(path);
+        if (found != index.end() && found->second->serial == serial)
+        {
+            order.erase(found->second);
+            index.erase(found);
+        }
+    }
+
+    static std::shared_ptr<texture> checker()
+    {
+        static const std::shared_ptr<texture> tex = texture::checkerboard(256, 16, 0xffe0e0e0, 0xff3070c0);
+        return tex;
+    }
+
+    struct entry
+    {
+        std::string path;
+        std::shared_future<scene_ptr> scene;
+        uint64_t serial;    // tells a reload of the same path apart
+    };
+
+    const size_t capacity;
+    std::list<entry> order;     // most recently used first
+    uint64_t loads = 0;
+    std::unordered_map<std::string, std::list<entry>::iterator> index;
+    std::mutex mutex;
+};
+
+// The last SAMPLES values of a series, for nearest-rank percentiles as in frame_profiler.
+class latency_window
+{
+public:
+    static const int SAMPLES = 4096;
+
+    void add(float ms)
+    {
+        samples[next] = ms;
+        next = (next + 1) % SAMPLES;
+        count = std::min(count + 1, SAMPLES);
+    }
+
+    float percentile(float p) const
+    {
+        if (count == 0)
+            return 0.0f;
+        std::vector<float> sorted(samples, samples + count);
+        const int rank = std::min(count - 1, (int)(p / 100.0f * count));
+        std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+        return sorted[rank];
+    }
+
+private:
+    float samples[SAMPLES];
+    int next = 0, count = 0;
+};
+
+class render_server
+{
+public:
+    explicit render_server(const server_options &options = server_options())
+        : options(options), meshes(options.meshes), pool(options.workers)
+    {
+    }
+
+    ~render_server()
+    {
+        if (listener >= 0)
+        {
+            close(listener);
+            unlink(socket_path.c_str());
+        }
+        for (int fd : wake)
+            if (fd >= 0)
+                close(fd);
+    }
+
+    render_server(const render_server &) = delete;
+    render_server &operator=(const render_server &) = delete;
+
+    bool listen(const char *path)
+    {
+        if (wake[0] < 0 && pipe2(wake, O_CLOEXEC | O_NONBLOCK) != 0)
+        {
+            fprintf(stderr, "cannot create the wake pipe: %s\n", strerror(errno));
+            return false;
+        }
+        listener = unix_listen(path);
+        if (listener < 0)
+        {
+            fprintf(stderr, "cannot listen on %s: %s\n", path, strerror(errno));
+            return false;
+        }
+        socket_path = path;
+        return true;
+    }
+
+    size_t workers() const { return pool.size(); }
+
+    // Serves until stop(); requests already queued are still rendered when the server is destroyed.
+    void run()
+    {
+        trace_thread_name("server io");
+        std::vector<pollfd> fds;
+        std::string line;
+        while (!stopping)
+        {
+            fds.assign(1, pollfd{ listener, POLLIN, 0 });
+            fds.push_back(pollfd{ wake[0], POLLIN, 0 });
+            for (const auto &c : connections)
+            {
+                std::lock_guard<std::mutex> lock(c->write);
+                fds.push_back(pollfd{ c->fd, (short)(c->sent < c->out.size() ? POLLIN | POLLOUT : POLLIN), 0 });
+            }
+            if (poll(fds.data(), fds.size(), 100) <= 0)
+                continue;
+
+            if (fds[0].revents & POLLIN)
+            {
+                const int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+                if (fd >= 0)
+                    connections.push_back(std::make_shared<connection>(fd));
+            }
+            if (fds[1].revents & POLLIN)
+            {
+                char drain[256];
+                while (read(wake[0], drain, sizeof(drain)) > 0)
+                    ;
+            }
+
+            // fds[i + 2] is connections[i]; closed ones are dropped after the pass
+            for (size_t i = 0; i + 2 < fds.size(); i++)
+            {
+                connection &c = *connections[i];
+                if (fds[i + 2].revents & POLLOUT)
+                    flush(c);
+                if (!(fds[i + 2].revents & (POLLIN | POLLHUP | POLLERR)))
+                    continue;
+                if (!c.reader.fill())
+                    c.open = false;
+                while (c.open && c.reader.next_line(line))
+                    handle(connections[i], line);
+                if (c.reader.pending() > MAX_LINE)
+                    c.open = false;     // not speaking the protocol
+            }
+            connections.erase(std::remove_if(connections.begin(), connections.end(),
+                                             [](const std::shared_ptr<connection> &c) {
+                                                 std::lock_guard<std::mutex> lock(c->write);
+                                                 return !c->open || c->broken;
+                                             }),
+                              connections.end());
+        }
+    }
+
+    // Safe from a signal handler.
+    void stop() { stopping = true; }
+
+    // Queue and latency metrics as a JSON object.
+    std::string stats_json()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        char text[1024];
+        snprintf(text, sizeof(text),
+                 "{\"queued\":%zu,\"max_queued\":%zu,\"received\":%llu,\"completed\":%llu,\"failed\":%llu,"
+                 "\"batches\":%llu,\"mean_batch\":%.2f,\"mesh_hits\":%llu,\"mesh_misses\":%llu,"
+                 "\"wait_ms\":{\"p50\":%.3f,\"p95\":%.3f,\"p99\":%.3f},"
+                 "\"latency_ms\":{\"p50\":%.3f,\"p95\":%.3f,\"p99\":%.3f}}",
+                 queued, max_queued, (unsigned long long)received, (unsigned long long)completed, (unsigned long long)failed,
+                 (unsigned long long)batches, batches ? (double)batched / batches : 0.0,
+                 (unsigned long long)mesh_hits, (unsigned long long)mesh_misses,
+                 wait.percentile(50), wait.percentile(95), wait.percentile(99),
+                 latency.percentile(50), latency.percentile(95), latency.percentile(99));
+        return text;
+    }
+
+private:
+    typedef std::chrono::steady_clock clock;
+    static const size_t MAX_LINE = 4096;
+
+    struct connection
+    {
+        explicit connection(int fd) : fd(fd), reader(fd) {}
+        ~connection() { close(fd); }    // after the last reply that references it
+
+        const int fd;
+        socket_reader reader;   // io thread only
+        bool open = true;       // io thread only
+        std::mutex write;       // guards the rest
+        std::string out;        // reply bytes the socket has not taken yet
+        size_t sent = 0;        // of out
+        bool broken = false;    // the client went away or stopped reading
+    };
+
+    struct pending
+    {
+        std::shared_ptr<connection> client;
+        render_request request;
+        clock::time_point arrived;
+    };
+
+    // True if line is verb alone or verb followed by its words.
+    static bool starts_with_verb(const std::string &line, const char *verb)
+    {
+        const size_t n = strlen(verb);
+        return line.compare(0, n, verb) == 0 && (line.size() == n || line[n] == ' ' || line[n] == '\t');
+    }
+
+    void handle(const std::shared_ptr<connection> &client, const std::string &line)
+    {
+        if (starts_with_verb(line, "render"))
+        {
+            pending p{ client, render_request(), clock::now() };
+            std::string error;
+            if (!parse_render_request(line.c_str() + 6, p.request, error))
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    received++;
+                    failed++;
+                }
+                reply_error(*client, p.request.id, error);
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                std::deque<pending> &queue = by_mesh[p.request.mesh];
+                if (queue.empty())
+                    ready.push_back(p.request.mesh);
+                queue.push_back(std::move(p));
+                received++;
+                max_queued = std::max(max_queued, ++queued);
+            }
+            pool.post([this] { render_batch(); });
+        }
+        else if (line == "stats")
+        {
+            const std::string json = stats_json();
+            char header[64];
+            const int n = snprintf(header, sizeof(header), "stats %zu\n", json.size());
+            reply(*client, header, n, json.data(), json.size());
+        }
+        else
+            reply_error(*client, 0, "unknown request");
+    }
+
+    // One job per queued request; a job finds nothing left if an earlier one batched its request.
+    void render_batch()
+    {
+        std::vector<pending> batch;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (ready.empty())
+                return;
+            const std::string mesh = std::move(ready.front());
+            ready.pop_front();
+            std::deque<pending> &queue = by_mesh[mesh];
+            while (!queue.empty() && batch.size() < options.max_batch)
+            {
+                batch.push_back(std::move(queue.front()));
+                queue.pop_front();
+            }
+            if (queue.empty())
+                by_mesh.erase(mesh);
+            else
+                ready.push_back(mesh);
+            queued -= batch.size();
+            batches++;
+            batched += batch.size();
+        }
+
+        TRACE_ZONE("render_server::batch");
+        const clock::time_point started = clock::now();
+        bool hit;
+        const mesh_cache::scene_ptr scene = meshes.get(batch[0].request.mesh, hit);
+
+        static thread_local framebuffer fb;
+        static thread_local frame_geometry geom;
+        static thread_local std::vector<uint8_t> encoded;
+        for (pending &p : batch)
+        {
+            const render_request &r = p.request;
+            if (!scene)
+            {
+                count_reply(false);
+                reply_error(*p.client, r.id, "cannot load mesh " + r.mesh);
+            }
+            else
+            {
+                if (fb.width != r.width || fb.height != r.height)
+                    fb.resize(r.width, r.height);
+                fb.clear();
+                camera cam(r.view.from, r.view.at, r.view.up, r.fov, 0.1f, 1000.0f, r.width, r.height);
+                cam.state.shade = r.shade;
+                cam.render_scene(*scene, fb, geom);
+
+                encoded.clear();
+                encode_image(fb, r.format, encoded);
+                char header[128];
+                const int n = snprintf(header, sizeof(header), "image %llu %s %d %d %zu\n", (unsigned long long)r.id,
+                                       IMAGE_EXTENSIONS[r.format], r.width, r.height, encoded.size());
+                // counted before it goes out, so stats never trail the replies a client has read
+                count_reply(true);
+                if (!reply(*p.client, header, n, encoded.data(), encoded.size()))
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    completed--;    // the client is gone; nobody saw it
+                    failed++;
+                }
+            }
+
+            const clock::time_point done = clock::now();
+            std::lock_guard<std::mutex> lock(mutex);
+            wait.add(std::chrono::duration<float, std::milli>(started - p.arrived).count());
+            latency.add(std::chrono::duration<float, std::milli>(done - p.arrived).count());
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (hit)
+            mesh_hits++;
+        else
+            mesh_misses++;
+    }
+
+    void count_reply(bool ok)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (ok)
+            completed++;
+        else
+            failed++;
+    }
+
+    bool reply_error(connection &client, uint64_t id, const std::string &message)
+    {
+        char line[512];
+        const int n = snprintf(line, sizeof(line), "error %llu %s", (unsigned long long)id, message.c_str());
+        const size_t size = std::min(n, (int)sizeof(line) - 2);
+        line[size] = '\n';
+        return reply(client, line, size + 1);
+    }
+
+    /*  Sends head then body without blocking: what the socket does not take
+        now is buffered and sent by the io thread. False if the client is
+        gone or has more than max_output waiting. */
+    bool reply(connection &client, const void *head, size_t headSize, const void *body = nullptr, size_t bodySize = 0)
+    {
+        std::lock_guard<std::mutex> lock(client.write);
+        if (client.broken)
+            return false;
+        if (client.sent == client.out.size())
+        {
+            client.out.clear();
+            client.sent = 0;
+            if (!send_some(client.fd, head, headSize) || (headSize == 0 && !send_some(client.fd, body, bodySize)))
+            {
+                client.broken = true;
+                return false;
+            }
+        }
+        if (headSize + bodySize == 0)
+            return true;
+        if (client.out.size() - client.sent + headSize + bodySize > options.max_output)
+        {
+            client.broken = true;   // not reading; the io thread closes it
+            wake_io();
+            return false;
+        }
+        client.out.append((const char *)head, headSize);
+        if (bodySize > 0)
+            client.out.append((const char *)body, bodySize);
+        wake_io();
+        return true;
+    }
+
+    // io thread: sends what the socket takes of client's buffered replies.
+    void flush(connection &client)
+    {
+        std::lock_guard<std::mutex> lock(client.write);
+        const void *data = client.out.data() + client.sent;
+        size_t size = client.out.size() - client.sent;
+        if (!send_some(client.fd, data, size))
+            client.broken = true;
+        client.sent = client.out.size() - size;
+        if (client.sent == client.out.size())
+        {
+            client.out.clear();
+            client.sent = 0;
+        }
+    }
+
+    // Sends what fits in the socket buffer, advancing data and size past it; false on an error.
+    static bool send_some(int fd, const void *&data, size_t &size)
+    {
+        while (size > 0)
+        {
+            const ssize_t n = send(fd, data, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            data = (const char *)data + n;
+            size -= n;
+        }
+        return true;
+    }
+
+    // Gets the io thread out of poll() to pick up new output or a broken client.
+    void wake_io()
+    {
+        const char byte = 0;
+        if (write(wake[1], &byte, 1) < 0)
+            return;     // full: a wake is already pending
+    }
+
+    const server_options options;
+    mesh_cache meshes;
+
+    int listener = -1;
+    int wake[2] = { -1, -1 };   // pipe whose read end is polled with the sockets
+    std::string socket_path;
+    std::atomic<bool> stopping{false};
+    std::vector<std::shared_ptr<connection>> connections;   // io thread only
+
+    std::mutex mutex;   // guards the queues and the metrics
+    std::unordered_map<std::string, std::deque<pending>> by_mesh;
+    std::deque<std::string> ready;  // meshes with queued requests, oldest first
+    size_t queued = 0, max_queued = 0;
+    uint64_t received = 0, completed = 0, failed = 0, batches = 0, batched = 0;
+    uint64_t mesh_hits = 0, mesh_misses = 0;
+    latency_window wait, latency;   // arrival to batch start, arrival to reply sent
+
+    thread_pool pool;   // last, so it drains before the queues above go away
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef RESOLUTIONSCALERH
+#define RESOLUTIONSCALERH
+
+#include <cmath>
+#include <algorithm>
+
+/*  Picks the internal render resolution so the measured render cost stays
+    under a frame time budget. Cost is assumed to grow with the pixel count,
+    so each sample is stored divided by scale^2 (cost per unit of area) and
+    the rolling mean of those predicts the cost at any scale. The scale only
+    moves when the prediction misses the budget by more than a dead band,
+    which keeps it from flickering between two sizes. */
+class resolution_scaler
+{
+public:
+    static const int WINDOW = 16;       // frames in the rolling mean
+
+    float target_ms = 16.0f;
+    float min_scale = 0.25f, max_scale = 1.0f;
+
+    float scale() const { return current; }
+    float average_ms() const { return count ? (float)(sum / count) : 0.0f; }    // at full resolution
+
+    /*  Feeds the cost of a frame rendered at frameScale (which lags behind
+        scale() when frames are pipelined); returns the scale for the next one. */
+    float update(double frameMs, float frameScale)
+    {
+        const double normalized = frameMs / (frameScale * frameScale);
+        if (count == WINDOW)
+            sum -= samples[next];
+        else
+            count++;
+        samples[next] = normalized;
+        sum += normalized;
+        next = (next + 1) % WINDOW;
+
+        const float wanted = std::min(max_scale, std::max(min_scale, (float)std::sqrt(target_ms / std::max(average_ms(), 1e-3f))));
+        if (std::fabs(wanted - current) > 0.05f * current)
+            current += 0.5f * (wanted - current);   // ease in, the samples lag behind the change
+        return current;
+    }
+
+    void reset()
+    {
+        current = max_scale;
+        count = next = 0;
+        sum = 0;
+    }
+
+    // Image size at the current scale for a full-resolution w x h; width kept a multiple of 4.
+    void size(int w, int h, int &scaledW, int &scaledH) const
+    {
+        scaledW = std::min(w, std::max(4, ((int)(w * current) + 2) & ~3));
+        scaledH = std::max(1, (int)((float)scaledW * h / w + 0.5f));
+    }
+
+private:
+    float current = 1.0f;
+    double samples[WINDOW] = {};
+    double sum = 0;
+    int count = 0, next = 0;
+};
+
+#endif
@@ -0,0 +1,123 @@
+
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include "scene_generator.h"
+#include "mesh_io.h"
+
+// Writes stress scenes for scaling tests: the monkey subdivided to any
+// triangle count, grids of many copies, or random scatters with a chosen
+// overlap and depth complexity. Triangles are streamed to the file, so the
+// output can be far larger than memory; use .mesh for anything past a few
+// million triangles, it loads without parsing.
+
+static void usage()
+{
+	fprintf(stderr,
+		"usage: scene_gen subdivide|grid|scatter [options] --output FILE\n"
+		"  --mesh PATH         source mesh (objects/monkey_smooth.obj)\n"
+		"  --output FILE       .obj or .mesh (native)\n"
+		"subdivide:\n"
+		"  --triangles N       at least N triangles, e.g. 10k, 2.5m (1m)\n"
+		"grid and scatter:\n"
+		"  --instances N       copies of the mesh, e.g. 10k (1k)\n"
+		"  --spacing F         grid: mesh sizes between copies (1.25)\n"
+		"  --depth-complexity F  scatter: copies along an average ray down -z (4)\n"
+		"  --overlap F         scatter: copy size over mean spacing, above 1 they intersect (0.5)\n"
+		"  --seed N            scatter: random seed (1)\n");
+}
+
+// 1500, 10k, 2.5m or 1g.
+static size_t parse_count(const char* text)
+{
+	char* end;
+	double value = strtod(text, &end);
+	switch (*end) {
+	case 'k': case 'K': value *= 1e3; break;
+	case 'm': case 'M': value *= 1e6; break;
+	case 'g': case 'G': value *= 1e9; break;
+	}
+	return value > 0 ? (size_t)(value + 0.5) : 0;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2 || argv[1][0] == '-') {
+		usage();
+		return 1;
+	}
+	const std::string mode = argv[1];
+	const char* meshPath = "objects/monkey_smooth.obj";
+	const char* output = nullptr;
+	size_t triangles = 1000000, instances = 1000;
+	float spacing = 1.25f;
+	scatter_options scatterOptions;
+	for (int i = 2; i < argc; i++) {
+		const bool value = i + 1 < argc;
+		if (strcmp(argv[i], "--mesh") == 0 && value)
+			meshPath = argv[++i];
+		else if (strcmp(argv[i], "--output") == 0 && value)
+			output = argv[++i];
+		else if (strcmp(argv[i], "--triangles") == 0 && value)
+			triangles = parse_count(argv[++i]);
+		else if (strcmp(argv[i], "--instances") == 0 && value)
+			instances = parse_count(argv[++i]);
+		else if (strcmp(argv[i], "--spacing") == 0 && value)
+			spacing = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--depth-complexity") == 0 && value)
+			scatterOptions.depth_complexity = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--overlap") == 0 && value)
+			scatterOptions.overlap = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--seed") == 0 && value)
+			scatterOptions.seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+		else {
+			usage();
+			return 1;
+		}
+	}
+	if (!output || (mode != "subdivide" && mode != "grid" && mode != "scatter")) {
+		usage();
+		return 1;
+	}
+
+	Mesh source;
+	if (!source.load_mesh_from_file(meshPath) || source.tris.empty()) {
+		fprintf(stderr, "cannot load %s\n", meshPath);
+		return 1;
+	}
+
+	mesh_writer writer;
+	if (!writer.open(output, mesh_file_format_for(output))) {
+		fprintf(stderr, "cannot write %s\n", output);
+		return 1;
+	}
+	auto emit = [&](const Triangle& t) { writer.add(t); };
+
+	const auto start = std::chrono::steady_clock::now();
+	if (mode == "subdivide") {
+		const int n = subdivision_for(source.tris.size(), triangles);
+		fprintf(stderr, "%zu triangles split %dx%d\n", source.tris.size(), n, n);
+		subdivide(source, n, emit);
+	}
+	else if (mode == "grid") {
+		instance_grid(source, instances, spacing, emit);
+	}
+	else {
+		scatterOptions.count = instances;
+		scatter(source, scatterOptions, emit);
+	}
+	const bool ok = writer.close();
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	const float* b = writer.written_bounds();
+	fprintf(stderr, "%s: %llu triangles in %.2f s (%.1f M/s), bounds [%g %g %g] - [%g %g %g]\n", output,
+		(unsigned long long)writer.triangles(), seconds, seconds > 0 ? writer.triangles() / seconds * 1e-6 : 0.0,
+		b[min_x], b[min_y], b[min_z], b[max_x], b[max_y], b[max_z]);
+	if (!ok) {
+		fprintf(stderr, "writing %s failed\n", output);
+		return 1;
+	}
+	return 0;
+}
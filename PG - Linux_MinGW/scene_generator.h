@@ -0,0 +1,149 @@
+#ifndef SCENEGENERATORH
+#define SCENEGENERATORH
+
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <random>
+#include <algorithm>
+#include "object.h"
+
+/*  Stress scenes built from a source mesh, for measuring how loading,
+    culling and raster scale past the 968 triangle monkey.
+
+        subdivide       every triangle split into n x n coplanar ones
+        instance_grid   copies on a square grid in the xy plane
+        scatter         copies at random positions, sized so that a
+                        ray down -z crosses depth_complexity of them on
+                        average and overlap sets how much they intersect
+
+    Each generator hands triangles to emit(const Triangle &) one at a
+    time instead of returning a mesh, so a hundred million of them can go
+    straight to a file (see mesh_io.h); to_mesh() collects them in memory
+    when the scene is small enough to render. */
+
+// Side of the per-triangle split that gives at least target triangles.
+inline int subdivision_for(size_t sourceTris, size_t target)
+{
+    if (sourceTris == 0 || target <= sourceTris)
+        return 1;
+    return (int)std::ceil(std::sqrt((double)target / sourceTris));
+}
+
+/*  Splits each triangle into n^2 with the same winding and uvs lerped.
+    Points are (p0 (n - i - j) + p1 i + p2 j) / n, which rounds the same
+    for both triangles on a shared edge, so the result has no cracks. The
+    image is close to the source's but not the same: the new corners round
+    slightly off the plane and every small triangle is set up on its own,
+    so some edge pixels and texels change (about 1% of the monkey's pixels
+    when textured, a few when flat shaded). */
+template <class F>
+void subdivide(const Mesh &mesh, int n, F emit)
+{
+    if (n < 1)
+        n = 1;
+    const float inv = 1.0f / n;
+    auto corner = [&](const Triangle &t, int i, int j) {
+        Vertex v;
+        const float w0 = (float)(n - i - j), w1 = (float)i, w2 = (float)j;
+        v.pos = (t.vertex[0].pos * w0 + t.vertex[1].pos * w1 + t.vertex[2].pos * w2) * inv;
+        v.uv = (t.vertex[0].uv * w0 + t.vertex[1].uv * w1 + t.vertex[2].uv * w2) * inv;
+        return v;
+    };
+    for (const Triangle &t : mesh.tris)
+    {
+        for (int j = 0; j < n; j++)
+        {
+            for (int i = 0; i + j < n; i++)
+            {
+                const Vertex a = corner(t, i, j), b = corner(t, i + 1, j), c = corner(t, i, j + 1);
+                emit(Triangle(a, b, c));
+                if (i + j + 1 < n)
+                    emit(Triangle(b, corner(t, i + 1, j + 1), c));
+            }
+        }
+    }
+}
+
+// The mesh turned by yaw radians about y, scaled, then moved to offset.
+template <class F>
+void emit_instance(const Mesh &mesh, const vec3 &offset, float yaw, float scale, F &emit)
+{
+    const float c = std::cos(yaw) * scale, s = std::sin(yaw) * scale;
+    for (Triangle t : mesh.tris)
+    {
+        for (Vertex &v : t.vertex)
+        {
+            const vec3 p = v.pos;
+            v.pos = vec3(c * p.x() + s * p.z() + offset.x(), p.y() * scale + offset.y(), -s * p.x() + c * p.z() + offset.z());
+        }
+        emit(t);
+    }
+}
+
+// Copy k of count, row by row on a square grid in the xy plane centered on
+// the origin; spacing is in mesh widths and heights.
+inline vec3 grid_offset(const Mesh &mesh, size_t count, float spacing, size_t k)
+{
+    const size_t side = (size_t)std::ceil(std::sqrt((double)count));
+    const float stepX = spacing * (mesh.bounds[max_x] - mesh.bounds[min_x]);
+    const float stepY = spacing * (mesh.bounds[max_y] - mesh.bounds[min_y]);
+    const float x = ((float)(k % side) - 0.5f * (side - 1)) * stepX;
+    const float y = ((float)(k / side) - 0.5f * (side - 1)) * stepY;
+    return vec3(x, y, 0);
+}
+
+// count copies at grid_offset(), facing +z like the mesh.
+template <class F>
+void instance_grid(const Mesh &mesh, size_t count, float spacing, F emit)
+{
+    for (size_t k = 0; k < count; k++)
+        emit_instance(mesh, grid_offset(mesh, count, spacing, k), 0.0f, 1.0f, emit);
+}
+
+struct scatter_options
+{
+    size_t count = 1000;
+    float depth_complexity = 4.0f;  // copies a ray along -z crosses, on average
+    float overlap = 0.5f;           // copy size over the mean distance between copies; above 1 they interpenetrate
+    uint32_t seed = 1;
+};
+
+/*  Uniform random copies in a box centered on the origin, each turned by a
+    random yaw. With a the xy footprint of the mesh, the box is
+    sqrt(count a / depth_complexity) on each side in x and y, and deep
+    enough that the mean spacing is size / overlap. Positions come from
+    mt19937 bits directly, so a seed gives the same scene everywhere. */
+template <class F>
+void scatter(const Mesh &mesh, const scatter_options &options, F emit)
+{
+    const float ex = mesh.bounds[max_x] - mesh.bounds[min_x];
+    const float ey = mesh.bounds[max_y] - mesh.bounds[min_y];
+    const float ez = mesh.bounds[max_z] - mesh.bounds[min_z];
+    const float size = std::sqrt(ex * ex + ey * ey + ez * ez);
+    const double n = (double)options.count;
+
+    const float width = (float)std::sqrt(n * ex * ey / std::max(options.depth_complexity, 1e-3f));
+    const float spacing = size / std::max(options.overlap, 1e-3f);
+    const float depth = (float)(n * spacing * spacing * spacing / ((double)width * width));
+
+    std::mt19937 rng(options.seed);
+    auto unit = [&] { return (float)(rng() / 4294967296.0); };
+    for (size_t k = 0; k < options.count; k++)
+    {
+        const float x = (unit() - 0.5f) * width, y = (unit() - 0.5f) * width, z = (unit() - 0.5f) * depth;
+        emit_instance(mesh, vec3(x, y, z), unit() * 2.0f * (float)M_PI, 1.0f, emit);
+    }
+}
+
+// Runs a generator into a mesh, with its bounds computed.
+template <class G>
+Mesh to_mesh(G generate)
+{
+    Mesh mesh;
+    generate([&](const Triangle &t) { mesh.tris.push_back(t); });
+    mesh.compute_bounds();
+    return mesh;
+}
+
+#endif
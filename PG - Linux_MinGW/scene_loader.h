@@ -0,0 +1,132 @@
+#ifndef SCENELOADERH
+#define SCENELOADERH
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <future>
+#include <chrono>
+#include <unordered_map>
+#include <cstdio>
+#include "object.h"
+#include "mesh_io.h"
+#include "mesh_registry.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+/*  Loads the meshes of a scene in the background while it is drawn. add()
+    puts an Obj in the scene at once, holding a wireframe box of the mesh's
+    bounds, and hands the load to the loader's own pool through
+    mesh_registry::load_async(); poll() swaps the finished meshes in
+    between frames. The first frame needs no mesh at all.
+
+    Nothing is shared with the renderer but the handles: the pool builds a
+    mesh nobody else sees, the registry lock is only held to look a path
+    up, and poll() runs on the thread that owns the objects and never
+    waits. Frames already in flight keep their own copy of the objects
+    (frame_pipeline.h) and finish with the box.
+
+    A box has the bounds stored in a .mesh header (mesh_io.h); an OBJ has
+    to be read whole to know them, so it stands in as [-1, 1] on every
+    axis until it loads. Objects are found again by index, so the vector
+    passed to add() must not be reordered or shrunk while loads are
+    pending. */
+class scene_loader
+{
+public:
+    // threads load meshes; keep them few, the frame pipeline wants the cores
+    explicit scene_loader(mesh_registry &registry, unsigned threads = 2) : registry(registry), pool(threads) {}
+
+    // Appends an object placing path's mesh at model, a box until the mesh is ready; returns its index.
+    size_t add(std::vector<Obj> &objects, const std::string &path, const matrix44 &model = matrix44(),
+               const std::shared_ptr<texture> &tex = nullptr, const mesh_registry::prepare_fn &prepare = mesh_registry::prepare_fn())
+    {
+        const size_t index = objects.size();
+        objects.push_back(Obj(placeholder(path), model, tex));
+        objects.back().placeholder = true;
+        loads.push_back(pending_load{ index, path, registry.load_async(path, pool, prepare) });
+        return index;
+    }
+
+    // The box drawn for path while it loads.
+    mesh_handle placeholder(const std::string &path)
+    {
+        mesh_handle &box = boxes[path];
+        if (!box)
+        {
+            float bounds[6] = { -1, 1, -1, 1, -1, 1 };
+            read_mesh_bounds(path.c_str(), bounds);
+            box = make_box(bounds);
+        }
+        return box;
+    }
+
+    // Swaps in every mesh that finished loading, without waiting; returns how many.
+    size_t poll(std::vector<Obj> &objects)
+    {
+        TRACE_ZONE("scene_loader::poll");
+        size_t done = 0;
+        for (size_t i = 0; i < loads.size();)
+        {
+            if (loads[i].mesh.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            {
+                i++;
+                continue;
+            }
+            Obj &obj = objects[loads[i].index];
+            obj.mesh = loads[i].mesh.get();
+            if (!obj.mesh)
+            {
+                fprintf(stderr, "cannot load %s\n", loads[i].path.c_str());
+                obj.mesh = std::make_shared<const Mesh>();
+            }
+            obj.placeholder = false;
+            loads[i] = std::move(loads.back());
+            loads.pop_back();
+            done++;
+        }
+        return done;
+    }
+
+    // Blocks until every pending mesh is in objects.
+    void wait(std::vector<Obj> &objects)
+    {
+        for (const pending_load &load : loads)
+            load.mesh.wait();
+        poll(objects);
+    }
+
+    size_t pending() const { return loads.size(); }
+
+private:
+    struct pending_load
+    {
+        size_t index;
+        std::string path;
+        std::shared_future<mesh_handle> mesh;
+    };
+
+    static mesh_handle make_box(const float bounds[6])
+    {
+        vec3 corner[8];
+        for (int k = 0; k < 8; k++)
+            corner[k] = vec3(bounds[k & 1 ? max_x : min_x], bounds[k & 2 ? max_y : min_y], bounds[k & 4 ? max_z : min_z]);
+        // two triangles per face, counterclockwise seen from outside
+        static const int faces[6][4] = { { 0, 4, 6, 2 }, { 1, 3, 7, 5 }, { 0, 1, 5, 4 }, { 2, 6, 7, 3 }, { 0, 2, 3, 1 }, { 4, 5, 7, 6 } };
+        std::shared_ptr<Mesh> box = std::make_shared<Mesh>();
+        for (const int *f : faces)
+        {
+            box->tris.push_back(Triangle(corner[f[0]], corner[f[1]], corner[f[2]]));
+            box->tris.push_back(Triangle(corner[f[0]], corner[f[2]], corner[f[3]]));
+        }
+        box->compute_bounds();
+        return box;
+    }
+
+    mesh_registry &registry;
+    std::vector<pending_load> loads;
+    std::unordered_map<std::string, mesh_handle> boxes;
+    thread_pool pool;   // last, so its destructor finishes the loads before the rest goes
+};
+
+#endif
@@ -0,0 +1,62 @@
+
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include "render_server.h"
+
+// Serves render requests from other processes on this machine over a Unix
+// socket; see render_protocol.h for the requests and render_client.cpp for
+// a load generator.
+
+static render_server* active = nullptr;
+
+static void on_signal(int)
+{
+	if (active)
+		active->stop();
+}
+
+static void usage()
+{
+	fprintf(stderr,
+		"usage: server [options]\n"
+		"  --socket PATH       where to listen (/tmp/renderer.sock)\n"
+		"  --workers N         render threads (one per core)\n"
+		"  --meshes N          meshes kept loaded (4)\n"
+		"  --batch N           most requests of one mesh rendered per batch (16)\n");
+}
+
+int main(int argc, char* argv[])
+{
+	const char* path = "/tmp/renderer.sock";
+	server_options options;
+	for (int i = 1; i < argc; i++) {
+		const bool value = i + 1 < argc;
+		if (strcmp(argv[i], "--socket") == 0 && value)
+			path = argv[++i];
+		else if (strcmp(argv[i], "--workers") == 0 && value)
+			options.workers = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--meshes") == 0 && value)
+			options.meshes = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--batch") == 0 && value)
+			options.max_batch = std::max(1, atoi(argv[++i]));
+		else {
+			usage();
+			return 1;
+		}
+	}
+
+	trace_thread_name("main");
+	render_server server(options);
+	if (!server.listen(path))
+		return 1;
+
+	active = &server;
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	fprintf(stderr, "listening on %s with %zu workers\n", path, server.workers());
+	server.run();
+
+	fprintf(stderr, "%s\n", server.stats_json().c_str());
+	return 0;
+}
@@ -0,0 +1,234 @@
+#ifndef TEXTUREH
+#define TEXTUREH
+
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TEXTURE_SSE2
+#endif
+
+/*  Texels are 0xAARRGGBB, the same layout as the framebuffer, so a sample
+    can be written out without any swizzling. */
+
+const int TEXTURE_TILE_SHIFT = 2;   // 4x4 texels per tile
+const int TEXTURE_TILE_SIZE = 1 << TEXTURE_TILE_SHIFT;
+
+struct mip_level
+{
+    int width, height;          // always powers of two
+    int tiles_x;                // tiles per row
+    std::vector<uint32_t> texels; // tiled layout: each 4x4 tile is 16 contiguous texels
+
+    // the tiled address splits into independent row and column offsets
+    inline int row_offset(int y) const
+    {
+        return (((y >> TEXTURE_TILE_SHIFT) * tiles_x) << (2 * TEXTURE_TILE_SHIFT)) + ((y & (TEXTURE_TILE_SIZE - 1)) << TEXTURE_TILE_SHIFT);
+    }
+
+    inline int column_offset(int x) const
+    {
+        return ((x >> TEXTURE_TILE_SHIFT) << (2 * TEXTURE_TILE_SHIFT)) + (x & (TEXTURE_TILE_SIZE - 1));
+    }
+
+    inline int index(int x, int y) const { return row_offset(y) + column_offset(x); }
+
+    inline uint32_t fetch(int x, int y) const { return texels[index(x, y)]; }
+    inline void store(int x, int y, uint32_t c) { texels[index(x, y)] = c; }
+
+    // Bilinear sample with wrap addressing; u, v in texture space [0, 1).
+    inline uint32_t sample(float u, float v) const
+    {
+        // 24.8 texel coordinates: the shift floors and the low byte is the weight
+        const int fu = (int)(u * (width << 8)) - 128;
+        const int fv = (int)(v * (height << 8)) - 128;
+        const int x0 = fu >> 8, y0 = fv >> 8;
+        const int wx = fu & 0xff, wy = fv & 0xff;
+
+        const int mx = width - 1, my = height - 1;
+        const int xa = column_offset(x0 & mx), xb = column_offset((x0 + 1) & mx);
+        const int ya = row_offset(y0 & my), yb = row_offset((y0 + 1) & my);
+
+        return lerp4(texels[ya + xa], texels[ya + xb], texels[yb + xa], texels[yb + xb], wx, wy);
+    }
+
+    // 8.8 fixed point blend of a 2x2 footprint (c00 c10 / c01 c11).
+    static inline uint32_t lerp4(uint32_t c00, uint32_t c10, uint32_t c01, uint32_t c11, int wx, int wy)
+    {
+        // one weight per texel (they add up to 256)
+        const int w11 = (wx * wy) >> 8, w10 = wx - w11, w01 = wy - w11, w00 = 256 - wx - wy + w11;
+#ifdef TEXTURE_SSE2
+        // broadcast each weight over the four channels of its texel
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i top = _mm_unpacklo_epi8(_mm_set_epi32(0, 0, (int)c10, (int)c00), zero);
+        const __m128i bot = _mm_unpacklo_epi8(_mm_set_epi32(0, 0, (int)c11, (int)c01), zero);
+        __m128i wt = _mm_cvtsi32_si128(w00 | (w10 << 16));
+        __m128i wb = _mm_cvtsi32_si128(w01 | (w11 << 16));
+        wt = _mm_unpacklo_epi16(wt, wt);
+        wb = _mm_unpacklo_epi16(wb, wb);
+        const __m128i m = _mm_add_epi16(_mm_mullo_epi16(top, _mm_unpacklo_epi32(wt, wt)), _mm_mullo_epi16(bot, _mm_unpacklo_epi32(wb, wb)));
+        const __m128i sum = _mm_srli_epi16(_mm_add_epi16(m, _mm_srli_si128(m, 8)), 8);
+        return (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+#else
+        uint32_t out = 0;
+        for (int s = 0; s < 32; s += 8)
+        {
+            const uint32_t sum = ((c00 >> s) & 0xff) * w00 + ((c10 >> s) & 0xff) * w10 + ((c01 >> s) & 0xff) * w01 + ((c11 >> s) & 0xff) * w11;
+            out |= (sum >> 8) << s;
+        }
+        return out;
+#endif
+    }
+};
+
+class texture
+{
+public:
+    std::vector<mip_level> levels;
+
+    texture() {}
+
+    int width() const { return levels.empty() ? 0 : levels[0].width; }
+    int height() const { return levels.empty() ? 0 : levels[0].height; }
+
+    /*  Builds the whole mip chain from a linear (row-major) image. Images that
+        are not power-of-two are resampled up to the next power of two so the
+        sampler can wrap with a mask. */
+    void build(int w, int h, const uint32_t *pixels)
+    {
+        levels.clear();
+        if (w <= 0 || h <= 0)
+            return;
+
+        int pw = 1, ph = 1;
+        while (pw < w) pw <<= 1;
+        while (ph < h) ph <<= 1;
+
+        levels.push_back(make_level(pw, ph));
+        mip_level &base = levels[0];
+        for (int y = 0; y < ph; y++)
+            for (int x = 0; x < pw; x++)
+                base.store(x, y, pixels[(y * h / ph) * w + (x * w / pw)]);
+
+        // box filter each level down to 1x1
+        while (levels.back().width > 1 || levels.back().height > 1)
+        {
+            const mip_level &src = levels.back();
+            mip_level dst = make_level(std::max(1, src.width >> 1), std::max(1, src.height >> 1));
+            for (int y = 0; y < dst.height; y++)
+            {
+                for (int x = 0; x < dst.width; x++)
+                {
+                    const int x0 = std::min(2 * x, src.width - 1), x1 = std::min(2 * x + 1, src.width - 1);
+                    const int y0 = std::min(2 * y, src.height - 1), y1 = std::min(2 * y + 1, src.height - 1);
+                    dst.store(x, y, average(src.fetch(x0, y0), src.fetch(x1, y0), src.fetch(x0, y1), src.fetch(x1, y1)));
+                }
+            }
+            levels.push_back(std::move(dst));
+        }
+    }
+
+    // Binary PPM (P6, maxval 255). There is no image library in the tree.
+    bool load_ppm(const char *path)
+    {
+        std::ifstream f(path, std::ios::binary);
+        if (!f.is_open())
+        {
+            std::cerr << "Texture cannot be oppened or does not exist\n";
+            return false;
+        }
+
+        std::string magic;
+        int w = 0, h = 0, maxval = 0;
+        f >> magic;
+        skip_comments(f); f >> w;
+        skip_comments(f); f >> h;
+        skip_comments(f); f >> maxval;
+        f.get();
+        if (magic != "P6" || w <= 0 || h <= 0 || maxval != 255)
+        {
+            std::cerr << "Unsupported texture format: " << path << "\n";
+            return false;
+        }
+
+        std::vector<unsigned char> rgb((size_t)w * h * 3);
+        f.read(reinterpret_cast<char *>(rgb.data()), rgb.size());
+        std::vector<uint32_t> pixels((size_t)w * h);
+        for (size_t i = 0; i < pixels.size(); i++)
+            pixels[i] = 0xff000000u | (rgb[3 * i] << 16) | (rgb[3 * i + 1] << 8) | rgb[3 * i + 2];
+
+        build(w, h, pixels.data());
+        return true;
+    }
+
+    static std::shared_ptr<texture> checkerboard(int size, int cells, uint32_t c0, uint32_t c1)
+    {
+        std::vector<uint32_t> pixels((size_t)size * size);
+        const int cell = std::max(1, size / cells);
+        for (int y = 0; y < size; y++)
+            for (int x = 0; x < size; x++)
+                pixels[y * size + x] = ((x / cell + y / cell) & 1) ? c1 : c0;
+
+        std::shared_ptr<texture> t = std::make_shared<texture>();
+        t->build(size, size, pixels.data());
+        return t;
+    }
+
+    /*  Picks the mip level for a whole triangle from the ratio between its
+        area in texel space and in raster space. */
+    int select_level(float uvArea, float rasterArea) const
+    {
+        if (rasterArea <= 0.0f || levels.empty())
+            return 0;
+        const float texelArea = uvArea * levels[0].width * levels[0].height;
+        const float lod = 0.5f * std::log2(std::max(texelArea / rasterArea, 1.0f));
+        return std::min((int)lod, (int)levels.size() - 1);
+    }
+
+    inline uint32_t sample(float u, float v, int level) const
+    {
+        return levels[level].sample(u, v);
+    }
+
+private:
+    static mip_level make_level(int w, int h)
+    {
+        mip_level m;
+        m.width = w;
+        m.height = h;
+        m.tiles_x = (w + TEXTURE_TILE_SIZE - 1) >> TEXTURE_TILE_SHIFT;
+        const int tilesY = (h + TEXTURE_TILE_SIZE - 1) >> TEXTURE_TILE_SHIFT;
+        m.texels.assign((size_t)m.tiles_x * tilesY * TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE, 0);
+        return m;
+    }
+
+    static uint32_t average(uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+    {
+        uint32_t out = 0;
+        for (int s = 0; s < 32; s += 8)
+        {
+            const uint32_t sum = ((a >> s) & 0xff) + ((b >> s) & 0xff) + ((c >> s) & 0xff) + ((d >> s) & 0xff);
+            out |= ((sum + 2) >> 2) << s;
+        }
+        return out;
+    }
+
+    static void skip_comments(std::istream &f)
+    {
+        f >> std::ws;
+        while (f.peek() == '#')
+        {
+            std::string line;
+            std::getline(f, line);
+            f >> std::ws;
+        }
+    }
+};
+
+#endif
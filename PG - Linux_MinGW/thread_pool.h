@@ -0,0 +1,145 @@
+#ifndef THREADPOOLH
+#define THREADPOOLH
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include "trace.h"
+
+/*  Fixed set of worker threads draining a FIFO of jobs. Jobs must not block
+    waiting on other jobs of the same pool. The FIFO is a ring that only
+    grows, so once it has room for the usual backlog posting a job whose
+    captures fit in std::function does not allocate. */
+class thread_pool
+{
+public:
+    // 0 threads means one per hardware thread
+    explicit thread_pool(unsigned count = 0)
+    {
+        if (count == 0)
+            count = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned i = 0; i < count; i++)
+            workers.emplace_back([this] { work(); });
+    }
+
+    ~thread_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &t : workers)
+            t.join();
+    }
+
+    thread_pool(const thread_pool &) = delete;
+    thread_pool &operator=(const thread_pool &) = delete;
+
+    size_t size() const { return workers.size(); }
+
+    void post(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (queued == jobs.size())
+                grow();
+            jobs[(first + queued) % jobs.size()] = std::move(job);
+            queued++;
+        }
+        wake.notify_one();
+    }
+
+    template <class F>
+    auto submit(F &&f) -> std::future<decltype(f())>
+    {
+        auto task = std::make_shared<std::packaged_task<decltype(f())()>>(std::forward<F>(f));
+        std::future<decltype(f())> result = task->get_future();
+        post([task] { (*task)(); });
+        return result;
+    }
+
+    /*  Runs fn(i) for i in [0, count) on the pool and the calling thread,
+        handing out indices one at a time; returns when all are done. */
+    void parallel_for(size_t count, const std::function<void(size_t)> &fn)
+    {
+        if (count == 0)
+            return;
+
+        struct shared_state
+        {
+            std::atomic<size_t> next{0};
+            std::atomic<size_t> done{0};
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        auto state = std::make_shared<shared_state>();
+
+        auto run = [state, count, &fn] {
+            size_t i;
+            while ((i = state->next++) < count)
+            {
+                fn(i);
+                if (++state->done == count)
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->finished.notify_all();
+                }
+            }
+        };
+
+        const size_t helpers = std::min(count - 1, workers.size());
+        for (size_t i = 0; i < helpers; i++)
+            post(run);
+        run();
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->finished.wait(lock, [&] { return state->done == count; });
+    }
+
+private:
+    void work()
+    {
+        trace_thread_name("pool worker");
+        while (true)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || queued > 0; });
+                if (queued == 0)
+                    return;
+                job = std::move(jobs[first]);
+                jobs[first] = nullptr;
+                first = (first + 1) % jobs.size();
+                queued--;
+            }
+            job();
+        }
+    }
+
+    // Doubles the ring, unrolling it so the oldest job lands at index 0.
+    void grow()
+    {
+        std::vector<std::function<void()>> larger(std::max<size_t>(16, jobs.size() * 2));
+        for (size_t i = 0; i < queued; i++)
+            larger[i] = std::move(jobs[(first + i) % jobs.size()]);
+        jobs.swap(larger);
+        first = 0;
+    }
+
+    std::vector<std::thread> workers;
+    std::vector<std::function<void()>> jobs;    // ring of queued jobs starting at first
+    size_t first = 0, queued = 0;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+};
+
+#endif
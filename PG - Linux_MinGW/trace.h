@@ -0,0 +1,207 @@
+#ifndef TRACEH
+#define TRACEH
+
+/*  Scoped instrumentation zones, exported as Chrome trace JSON (loads in
+    chrome://tracing and ui.perfetto.dev).
+
+        TRACE_ZONE("camera::render_scene");
+
+    records one complete event when the enclosing scope exits. Zone names
+    must be string literals: only the pointer is stored. Every thread writes
+    to its own ring of the last TRACE_CAPACITY events without locking; the
+    rings are registered once per thread and kept for the whole run, so
+    trace_export() can read them at any time (events overwritten during the
+    export are dropped).
+
+    With the allocation hook compiled in (-DALLOC_HOOK, see alloc_hook.h)
+    each event also carries the allocations its thread made inside the
+    zone, exported as args.
+
+    Build with -DNO_TRACE to compile every zone out. */
+
+#include <cstdint>
+#include <cstddef>
+
+#ifndef NO_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include <cstdio>
+#include "alloc_hook.h"
+
+const size_t TRACE_CAPACITY = 1 << 16;  // events per thread
+
+struct trace_event
+{
+    const char *name;
+    int64_t begin, end;     // ns since the trace epoch
+    alloc_counts allocs;
+};
+
+// Relaxed atomics so the exporter may read a slot the owner is rewriting; plain stores on x86.
+struct trace_slot
+{
+    std::atomic<const char *> name;
+    std::atomic<int64_t> begin, end;
+#ifdef ALLOC_HOOK
+    std::atomic<uint64_t> allocs, alloc_bytes;
+#endif
+};
+
+struct trace_buffer
+{
+    trace_slot events[TRACE_CAPACITY];
+    std::atomic<uint64_t> head{0};  // events ever written; only the owner thread stores
+    std::atomic<const char *> thread_name{nullptr};
+    int tid = 0;
+
+    void push(const char *name, int64_t begin, int64_t end, alloc_counts allocs)
+    {
+        const uint64_t h = head.load(std::memory_order_relaxed);
+        trace_slot &e = events[h % TRACE_CAPACITY];
+        e.name.store(name, std::memory_order_relaxed);
+        e.begin.store(begin, std::memory_order_relaxed);
+        e.end.store(end, std::memory_order_relaxed);
+#ifdef ALLOC_HOOK
+        e.allocs.store(allocs.count, std::memory_order_relaxed);
+        e.alloc_bytes.store(allocs.bytes, std::memory_order_relaxed);
+#else
+        (void)allocs;
+#endif
+        head.store(h + 1, std::memory_order_release);
+    }
+};
+
+struct trace_registry
+{
+    std::mutex mutex;
+    std::vector<std::shared_ptr<trace_buffer>> buffers;
+    const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+    static trace_registry &get()
+    {
+        static trace_registry registry;
+        return registry;
+    }
+};
+
+inline int64_t trace_now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - trace_registry::get().epoch).count();
+}
+
+// The calling thread's buffer, registered on first use.
+inline trace_buffer &trace_local()
+{
+    static thread_local trace_buffer *local = nullptr;
+    if (!local)
+    {
+        std::shared_ptr<trace_buffer> b = std::make_shared<trace_buffer>();
+        trace_registry &r = trace_registry::get();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        b->tid = (int)r.buffers.size() + 1;
+        r.buffers.push_back(b);
+        local = b.get();
+    }
+    return *local;
+}
+
+// Names the calling thread in the exported trace; name must be a string literal.
+inline void trace_thread_name(const char *name)
+{
+    trace_local().thread_name = name;
+}
+
+class trace_zone
+{
+public:
+    template <size_t N>
+    explicit trace_zone(const char (&literal)[N]) : name(literal), begin(trace_now()), allocs(alloc_thread_totals()) {}
+
+    ~trace_zone()
+    {
+        const alloc_counts now = alloc_thread_totals();
+        trace_local().push(name, begin, trace_now(), alloc_counts{ now.count - allocs.count, now.bytes - allocs.bytes });
+    }
+
+    trace_zone(const trace_zone &) = delete;
+    trace_zone &operator=(const trace_zone &) = delete;
+
+private:
+    const char *name;
+    int64_t begin;
+    alloc_counts allocs;    // thread totals when the zone was entered
+};
+
+// Writes every event still held by the thread rings; returns false if the file cannot be written.
+inline bool trace_export(const char *path)
+{
+    FILE *f = fopen(path, "w");
+    if (!f)
+        return false;
+
+    std::vector<std::shared_ptr<trace_buffer>> buffers;
+    {
+        trace_registry &r = trace_registry::get();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        buffers = r.buffers;
+    }
+
+    fprintf(f, "{\"traceEvents\":[\n");
+    bool first = true;
+    std::vector<trace_event> copy;
+    for (const std::shared_ptr<trace_buffer> &b : buffers)
+    {
+        fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", b->tid, b->thread_name.load() ? b->thread_name.load() : "thread");
+        first = false;
+
+        const uint64_t head = b->head.load(std::memory_order_acquire);
+        const uint64_t start = head > TRACE_CAPACITY ? head - TRACE_CAPACITY : 0;
+        copy.clear();
+        for (uint64_t i = start; i < head; i++)
+        {
+            const trace_slot &e = b->events[i % TRACE_CAPACITY];
+            trace_event copied = { e.name.load(std::memory_order_relaxed), e.begin.load(std::memory_order_relaxed),
+                                   e.end.load(std::memory_order_relaxed), alloc_counts{ 0, 0 } };
+#ifdef ALLOC_HOOK
+            copied.allocs = alloc_counts{ e.allocs.load(std::memory_order_relaxed), e.alloc_bytes.load(std::memory_order_relaxed) };
+#endif
+            copy.push_back(copied);
+        }
+
+        // the owner kept writing meanwhile: anything it may have reached is unreliable
+        const uint64_t after = b->head.load(std::memory_order_acquire);
+        const uint64_t valid = after > TRACE_CAPACITY ? after - TRACE_CAPACITY : 0;
+        for (uint64_t i = std::max(start, valid); i < head; i++)
+        {
+            const trace_event &e = copy[i - start];
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                    e.name, b->tid, e.begin / 1000.0, (e.end - e.begin) / 1000.0);
+            if (ALLOC_HOOK_ENABLED)
+                fprintf(f, ",\"args\":{\"allocs\":%llu,\"bytes\":%llu}", (unsigned long long)e.allocs.count, (unsigned long long)e.allocs.bytes);
+            fprintf(f, "}");
+        }
+    }
+    fprintf(f, "\n]}\n");
+    return fclose(f) == 0;
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_ZONE(name) trace_zone TRACE_CONCAT(trace_zone_, __LINE__)(name)
+
+#else
+
+inline void trace_thread_name(const char *) {}
+inline bool trace_export(const char *) { return false; }
+
+#define TRACE_ZONE(name) ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef UPSCALEH
+#define UPSCALEH
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include "framebuffer.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define UPSCALE_SSE2
+#endif
+
+/*  Bilinear stretch of src into a dstW x dstH 0xAARRGGBB image whose rows are
+    pitch bytes apart (e.g. a locked SDL texture). Pixel centers are aligned
+    and edges are clamped. Each output row first blends its two source rows
+    into a scratch row, then every output pixel blends two neighbours of it;
+    both passes use 8 bit weights. Same size is a plain row copy. */
+inline void upscale_bilinear(const framebuffer &src, void *dst, int dstW, int dstH, int pitch)
+{
+    if (src.width == dstW && src.height == dstH)
+    {
+        for (int y = 0; y < dstH; y++)
+            memcpy((char *)dst + (size_t)y * pitch, &src.color[(size_t)y * src.width], dstW * sizeof(uint32_t));
+        return;
+    }
+
+    // 24.8 source coordinate of an output pixel center
+    auto source = [](int i, int srcSize, int dstSize, int &i0, int &w) {
+        const int f = std::max(0, (int)(((2 * i + 1) * (int64_t)srcSize * 128) / dstSize) - 128);
+        i0 = std::min(f >> 8, srcSize - 1);
+        w = f & 0xff;
+    };
+
+    // per column: left texel, and the weights of both texels repeated over the four channels
+    static thread_local std::vector<int> columns;
+    static thread_local std::vector<uint16_t> weights;
+    static thread_local std::vector<uint32_t> row;
+    columns.resize(dstW);
+    weights.resize((size_t)dstW * 8 + 8);
+    row.resize(src.width + 4);
+    for (int x = 0; x < dstW; x++)
+    {
+        int x0, w;
+        source(x, src.width, dstW, x0, w);
+        columns[x] = x0;
+        for (int c = 0; c < 4; c++)
+        {
+            weights[(size_t)x * 8 + c] = (uint16_t)(256 - w);
+            weights[(size_t)x * 8 + 4 + c] = (uint16_t)w;
+        }
+    }
+
+    for (int y = 0; y < dstH; y++)
+    {
+        int y0, wy;
+        source(y, src.height, dstH, y0, wy);
+        const uint32_t *a = &src.color[(size_t)y0 * src.width];
+        const uint32_t *b = &src.color[(size_t)std::min(y0 + 1, src.height - 1) * src.width];
+        uint32_t *out = (uint32_t *)((char *)dst + (size_t)y * pitch);
+
+        int x = 0;
+#ifdef UPSCALE_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i wa = _mm_set1_epi16((short)(256 - wy)), wb = _mm_set1_epi16((short)wy);
+        for (; x + 4 <= src.width; x += 4)
+        {
+            const __m128i pa = _mm_loadu_si128((const __m128i *)(a + x));
+            const __m128i pb = _mm_loadu_si128((const __m128i *)(b + x));
+            const __m128i lo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(pa, zero), wa),
+                                                            _mm_mullo_epi16(_mm_unpacklo_epi8(pb, zero), wb)), 8);
+            const __m128i hi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(pa, zero), wa),
+                                                            _mm_mullo_epi16(_mm_unpackhi_epi8(pb, zero), wb)), 8);
+            _mm_storeu_si128((__m128i *)&row[x], _mm_packus_epi16(lo, hi));
+        }
+#endif
+        for (; x < src.width; x++)
+        {
+            uint32_t c = 0;
+            for (int s = 0; s < 32; s += 8)
+                c |= ((((a[x] >> s) & 0xff) * (256 - wy) + ((b[x] >> s) & 0xff) * wy) >> 8) << s;
+            row[x] = c;
+        }
+        row[src.width] = row[src.width - 1]; // right neighbour of the last column
+
+        x = 0;
+#ifdef UPSCALE_SSE2
+        // two output pixels per register: each lane pairs a left and a right texel
+        for (; x + 2 <= dstW; x += 2)
+        {
+            const __m128i l = _mm_unpacklo_epi8(_mm_set_epi32(0, 0, (int)row[columns[x + 1]], (int)row[columns[x]]), zero);
+            const __m128i r = _mm_unpacklo_epi8(_mm_set_epi32(0, 0, (int)row[columns[x + 1] + 1], (int)row[columns[x] + 1]), zero);
+            const __m128i w0 = _mm_loadu_si128((const __m128i *)&weights[(size_t)x * 8]);      // x: left | right
+            const __m128i w1 = _mm_loadu_si128((const __m128i *)&weights[(size_t)x * 8 + 8]);  // x + 1: left | right
+            const __m128i wl = _mm_unpacklo_epi64(w0, w1), wr = _mm_unpackhi_epi64(w0, w1);
+            const __m128i sum = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(l, wl), _mm_mullo_epi16(r, wr)), 8);
+            _mm_storel_epi64((__m128i *)(out + x), _mm_packus_epi16(sum, sum));
+        }
+#endif
+        for (; x < dstW; x++)
+        {
+            const uint32_t l = row[columns[x]], r = row[columns[x] + 1];
+            const int wl = weights[(size_t)x * 8], wr = weights[(size_t)x * 8 + 4];
+            uint32_t c = 0;
+            for (int s = 0; s < 32; s += 8)
+                c |= ((((l >> s) & 0xff) * wl + ((r >> s) & 0xff) * wr) >> 8) << s;
+            out[x] = c;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,360 @@
+#ifndef VIDEOSTREAMH
+#define VIDEOSTREAMH
+
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include "framebuffer.h"
+#include "trace.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <poll.h>
+#endif
+
+/*  Streams rendered frames to stdout or a named pipe for an external
+    encoder, e.g.
+        main --stream - | ffmpeg -f rawvideo -pix_fmt bgra -s 600x400 -r 30 -i - out.mp4
+        main --stream - --stream-format y4m | ffmpeg -i - out.mp4
+
+    VIDEO_RAW is the framebuffer memory as is: 0xAARRGGBB words, which is
+    BGRA byte order on little-endian machines, with no header. VIDEO_Y4M is
+    YUV4MPEG2 with 4:4:4 BT.601 studio-range planes.
+
+    The stream owns two framebuffers. The renderer draws into frame() and
+    present() swaps it with the one the writer thread is done with, so
+    pixels are never copied on the render thread. If the writer is still
+    busy, present() drops the frame and returns at once unless the stream
+    is blocking, in which case it waits: only a blocking stream lets a slow
+    consumer pace the renderer. */
+
+enum video_format
+{
+    VIDEO_RAW,
+    VIDEO_Y4M,
+};
+
+inline bool video_format_from_name(const char *name, video_format &format)
+{
+    if (strcmp(name, "raw") == 0 || strcmp(name, "bgra") == 0)
+        format = VIDEO_RAW;
+    else if (strcmp(name, "y4m") == 0)
+        format = VIDEO_Y4M;
+    else
+        return false;
+    return true;
+}
+
+struct video_part
+{
+    const void *data;
+    size_t size;
+};
+
+class video_stream
+{
+public:
+    // path "-" is stdout; a FIFO must have a reader before the open returns.
+    video_stream(const char *path, video_format format, int width, int height, int fps = 30, bool blocking = false)
+        : format(format), blocking(blocking)
+    {
+        buffers[0].resize(width, height);
+        buffers[1].resize(width, height);
+        if (strcmp(path, "-") == 0)
+        {
+            fd = 1;
+#ifdef _WIN32
+            _setmode(fd, _O_BINARY);
+#endif
+        }
+        else
+        {
+#ifdef _WIN32
+            fd = _open(path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644);
+#else
+            fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+            owned = fd >= 0;
+        }
+        if (fd < 0)
+        {
+            fprintf(stderr, "cannot open stream %s: %s\n", path, strerror(errno));
+            broken = true;
+            return;
+        }
+
+#ifndef _WIN32
+        signal(SIGPIPE, SIG_IGN);   // a consumer that quits shows up as EPIPE, not a dead renderer
+#endif
+#ifdef __linux__
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode))
+        {
+            splice = true;
+            fcntl(fd, F_SETPIPE_SZ, (int)frame_bytes());    // best effort, capped by pipe-max-size
+        }
+#endif
+
+        if (format == VIDEO_Y4M)
+        {
+            char header[128];
+            const int n = snprintf(header, sizeof(header), "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", width, height, fps);
+            video_part part = { header, (size_t)n };
+            broken = !send(&part, 1);
+            planes.resize((size_t)width * height * 3);
+        }
+        worker = std::thread([this] { run(); });
+    }
+
+    ~video_stream()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        changed.notify_all();
+        if (worker.joinable())
+            worker.join();
+        if (owned)
+        {
+#ifdef _WIN32
+            _close(fd);
+#else
+            close(fd);
+#endif
+        }
+    }
+
+    video_stream(const video_stream &) = delete;
+    video_stream &operator=(const video_stream &) = delete;
+
+    // The buffer to render the next frame into; changes after every present().
+    framebuffer &frame() { return buffers[back]; }
+
+    // Hands frame() to the writer. False if the frame was dropped (writer busy, or the consumer is gone).
+    bool present()
+    {
+        TRACE_ZONE("video_stream::present");
+        std::unique_lock<std::mutex> lock(mutex);
+        if (broken)
+            return false;
+        if (busy && !blocking)
+        {
+            dropped++;
+            return false;
+        }
+        changed.wait(lock, [&] { return !busy || broken; });
+        if (broken)
+            return false;
+        back ^= 1;
+        busy = true;
+        changed.notify_all();
+        return true;
+    }
+
+    // Waits until the last presented frame has been written.
+    void flush()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return !busy; });
+    }
+
+    bool ok() const { return !broken; }
+    int width() const { return buffers[0].width; }
+    int height() const { return buffers[0].height; }
+
+    uint64_t frames_written() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return written;
+    }
+
+    uint64_t frames_dropped() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return dropped;
+    }
+
+private:
+    size_t frame_bytes() const { return (size_t)buffers[0].width * buffers[0].height * (format == VIDEO_Y4M ? 3 : 4); }
+
+    void run()
+    {
+        trace_thread_name("video stream");
+        while (true)
+        {
+            const framebuffer *fb;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&] { return stopping || busy; });
+                if (!busy)
+                    return;
+                fb = &buffers[back ^ 1];    // the renderer only touches the back buffer
+            }
+
+            bool sent;
+            {
+                TRACE_ZONE("video_stream::write");
+                if (format == VIDEO_Y4M)
+                {
+                    to_yuv444(*fb);
+                    static const char FRAME[] = "FRAME\n";
+                    const video_part parts[2] = { { FRAME, sizeof(FRAME) - 1 }, { planes.data(), planes.size() } };
+                    sent = send(parts, 2);
+                }
+                else
+                {
+                    const video_part part = { fb->color.data(), fb->color.size() * sizeof(uint32_t) };
+                    sent = send(&part, 1);
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                busy = false;
+                if (sent)
+                    written++;
+                else
+                    broken = true;
+            }
+            changed.notify_all();
+        }
+    }
+
+    // BT.601 studio range, planar Y then Cb then Cr.
+    void to_yuv444(const framebuffer &fb)
+    {
+        const size_t n = fb.color.size();
+        uint8_t *y = planes.data(), *u = y + n, *v = u + n;
+        for (size_t i = 0; i < n; i++)
+        {
+            const int r = (fb.color[i] >> 16) & 0xff, g = (fb.color[i] >> 8) & 0xff, b = fb.color[i] & 0xff;
+            y[i] = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+            u[i] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            v[i] = (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+
+    // Writes every part in order; false once the consumer is gone.
+    bool send(const video_part *parts, int count)
+    {
+#ifdef __linux__
+        if (splice)
+            return send_spliced(parts, count);
+#endif
+#ifdef _WIN32
+        for (int p = 0; p < count; p++)
+        {
+            const char *data = (const char *)parts[p].data;
+            size_t left = parts[p].size;
+            while (left > 0)
+            {
+                const int n = _write(fd, data, (unsigned)(left < (1u << 30) ? left : (1u << 30)));
+                if (n <= 0)
+                    return false;
+                data += n;
+                left -= n;
+            }
+        }
+        return true;
+#else
+        struct iovec iov[4];
+        for (int p = 0; p < count; p++)
+            iov[p] = { const_cast<void *>(parts[p].data), parts[p].size };
+        return send_iov(iov, count, false);
+#endif
+    }
+
+#ifndef _WIN32
+    // writev (or vmsplice) until every iovec is consumed, advancing past partial writes.
+    bool send_iov(struct iovec *iov, int count, bool spliced)
+    {
+        while (count > 0)
+        {
+#ifdef __linux__
+            const ssize_t n = spliced ? vmsplice(fd, iov, count, 0) : writev(fd, iov, count);
+#else
+            const ssize_t n = writev(fd, iov, count);
+#endif
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            size_t done = (size_t)n;
+            while (count > 0 && done >= iov->iov_len)
+            {
+                done -= iov->iov_len;
+                iov++;
+                count--;
+            }
+            if (count > 0)
+            {
+                iov->iov_base = (char *)iov->iov_base + done;
+                iov->iov_len -= done;
+            }
+        }
+        return true;
+    }
+#endif
+
+#ifdef __linux__
+    /*  vmsplice maps the pages into the pipe instead of copying them, so
+        they must not change until the consumer has read them: wait for
+        the pipe to drain before the buffer goes back to the renderer. Only
+        this thread waits; the renderer is paced by present() alone. */
+    bool send_spliced(const video_part *parts, int count)
+    {
+        struct iovec iov[4];
+        for (int p = 0; p < count; p++)
+            iov[p] = { const_cast<void *>(parts[p].data), parts[p].size };
+        if (!send_iov(iov, count, true))
+        {
+            if (errno != EINVAL && errno != ENOSYS)
+                return false;
+            splice = false;     // not a pipe vmsplice can write to after all
+            return send(parts, count);
+        }
+        int pending;
+        struct pollfd readers = { fd, 0, 0 };
+        while (ioctl(fd, FIONREAD, &pending) == 0 && pending > 0)
+        {
+            if (poll(&readers, 1, 0) > 0 && (readers.revents & POLLERR))
+                return false;   // reader closed with our pages still queued
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        return true;
+    }
+#endif
+
+    framebuffer buffers[2];
+    int back = 0;               // buffers[back ^ 1] belongs to the writer while busy
+    bool busy = false, stopping = false, broken = false;
+    uint64_t written = 0, dropped = 0;
+
+    const video_format format;
+    const bool blocking;
+    int fd = -1;
+    bool owned = false, splice = false;
+    std::vector<uint8_t> planes;    // Y4M conversion, writer thread only
+
+    mutable std::mutex mutex;
+    std::condition_variable changed;
+    std::thread worker;
+};
+
+#endif
@@ -0,0 +1,289 @@
+#ifndef WELDH
+#define WELDH
+
+#include <vector>
+#include <unordered_map>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include "object.h"
+#include "thread_pool.h"
+
+/*  Merges the corners of a triangle soup into shared vertices and fills
+    Mesh::vertices and Mesh::indices. Two corners merge when every
+    position component is within epsilon and both uv components within
+    uv_epsilon; an epsilon of 0 merges only exact copies.
+
+    The spatial hash has cells 2 epsilon wide, so a corner's matches lie in
+    its own cell or the neighbour on its nearer side along each axis: 8
+    cells to probe. Cells are split into shards by hash and every pass
+    runs over blocks of corners or over shards on the pool:
+
+        1. shard of each corner, counted per block
+        2. corners scattered into shard order, still ascending within a shard
+        3. per shard: the first corner of each distinct tuple in a cell
+           becomes a representative, later matches point at it
+        4. per corner: the lowest representative that matches in any of
+           the 8 cells; one sequential pass then follows links to roots
+        5. roots numbered in order of first use, indices written
+
+    Every step is linear in the corners, and the result does not depend
+    on the number of threads. The soup is freed afterwards unless
+    keep_soup asks for it: it holds a full copy of each vertex per
+    triangle, more than the indexed mesh it was welded into. A mesh
+    welded before is expanded back into its soup first, so it can be
+    welded again with other epsilons. */
+
+struct weld_options
+{
+    float epsilon = 1e-6f;
+    float uv_epsilon = 1e-6f;
+    bool keep_soup = false;     // leave Mesh::tris next to the indexed copy
+};
+
+struct weld_stats
+{
+    size_t corners = 0;     // 3 per triangle
+    size_t vertices = 0;    // after merging
+};
+
+namespace weld_detail
+{
+    struct cell_key
+    {
+        int64_t x, y, z;
+        bool operator==(const cell_key &o) const { return x == o.x && y == o.y && z == o.z; }
+    };
+
+    struct cell_hash
+    {
+        size_t operator()(const cell_key &k) const
+        {
+            uint64_t h = (uint64_t)k.x * 0x9e3779b97f4a7c15ull ^ (uint64_t)k.y * 0xc2b2ae3d27d4eb4full ^ (uint64_t)k.z * 0x165667b19e3779f9ull;
+            h ^= h >> 29;
+            h *= 0xbf58476d1ce4e5b9ull;
+            return (size_t)(h ^ (h >> 32));
+        }
+    };
+
+    struct chain
+    {
+        uint32_t head, tail;    // representatives in the cell, linked by nextRep
+    };
+
+    typedef std::unordered_map<cell_key, chain, cell_hash> shard_map;
+
+    const size_t SHARDS = 256;
+    const size_t BLOCK = 1 << 16;
+    const uint32_t NONE = 0xffffffffu;
+
+    // With epsilon 0 the cell is the bit pattern itself (-0 folded onto 0).
+    inline int64_t cell_of(float p, float inv)
+    {
+        if (inv == 0)
+        {
+            p += 0.0f;
+            int32_t bits;
+            memcpy(&bits, &p, 4);
+            return bits;
+        }
+        return (int64_t)std::floor((double)p * inv);
+    }
+
+    // -1 or +1: the neighbour cell on the side the point is nearer to.
+    inline int64_t near_side(float p, float inv)
+    {
+        const double scaled = (double)p * inv;
+        return scaled - std::floor(scaled) < 0.5 ? -1 : 1;
+    }
+}
+
+inline weld_stats weld(Mesh &mesh, const weld_options &options = weld_options(), thread_pool *pool = nullptr)
+{
+    using namespace weld_detail;
+    TRACE_ZONE("weld");
+    if (mesh.tris.empty() && mesh.indexed() && !mesh.vertices.empty())
+    {
+        mesh.tris.reserve(mesh.indices.size() / 3);
+        for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+            mesh.tris.push_back(Triangle(mesh.vertices[mesh.indices[i]], mesh.vertices[mesh.indices[i + 1]], mesh.vertices[mesh.indices[i + 2]]));
+    }
+    weld_stats stats;
+    const size_t n = 3 * mesh.tris.size();
+    stats.corners = n;
+    mesh.vertices.clear();
+    mesh.indices.clear();
+    mesh.packed = quantized_mesh();
+    mesh.lods.clear();
+    mesh.clear_meshlets();
+    if (n == 0 || n >= NONE)
+        return stats;
+
+    auto corner = [&](size_t i) -> const Vertex & { return mesh.tris[i / 3].vertex[i % 3]; };
+    const float eps = std::max(options.epsilon, 0.0f), uvEps = std::max(options.uv_epsilon, 0.0f);
+    const float inv = eps > 0 ? 0.5f / eps : 0.0f;
+    auto key_of = [&](const vec3 &p) { return cell_key{ cell_of(p.x(), inv), cell_of(p.y(), inv), cell_of(p.z(), inv) }; };
+    auto matches = [&](const Vertex &a, const Vertex &b) {
+        return std::fabs(a.pos.x() - b.pos.x()) <= eps && std::fabs(a.pos.y() - b.pos.y()) <= eps &&
+               std::fabs(a.pos.z() - b.pos.z()) <= eps && std::fabs(a.uv.x() - b.uv.x()) <= uvEps &&
+               std::fabs(a.uv.y() - b.uv.y()) <= uvEps;
+    };
+    auto parallel = [&](size_t count, const std::function<void(size_t)> &fn) {
+        if (pool)
+            pool->parallel_for(count, fn);
+        else
+            for (size_t i = 0; i < count; i++)
+                fn(i);
+    };
+
+    const size_t blocks = (n + BLOCK - 1) / BLOCK;
+    auto block_range = [&](size_t b, size_t &begin, size_t &end) {
+        begin = b * BLOCK;
+        end = std::min(n, begin + BLOCK);
+    };
+
+    // 1. shards, counted per block
+    std::vector<uint8_t> shard(n);
+    std::vector<uint32_t> counts(blocks * SHARDS, 0);
+    parallel(blocks, [&](size_t b) {
+        size_t begin, end;
+        block_range(b, begin, end);
+        uint32_t *count = &counts[b * SHARDS];
+        for (size_t i = begin; i < end; i++)
+        {
+            shard[i] = (uint8_t)(cell_hash()(key_of(corner(i).pos)) % SHARDS);
+            count[shard[i]]++;
+        }
+    });
+
+    // 2. scatter into shard order; counts become the write offset of each (shard, block)
+    std::vector<size_t> shardStart(SHARDS + 1, 0);
+    {
+        size_t offset = 0;
+        for (size_t s = 0; s < SHARDS; s++)
+        {
+            shardStart[s] = offset;
+            for (size_t b = 0; b < blocks; b++)
+            {
+                const uint32_t c = counts[b * SHARDS + s];
+                counts[b * SHARDS + s] = (uint32_t)offset;
+                offset += c;
+            }
+        }
+        shardStart[SHARDS] = offset;
+    }
+    std::vector<uint32_t> order(n);
+    parallel(blocks, [&](size_t b) {
+        size_t begin, end;
+        block_range(b, begin, end);
+        uint32_t *cursor = &counts[b * SHARDS];
+        for (size_t i = begin; i < end; i++)
+            order[cursor[shard[i]]++] = (uint32_t)i;
+    });
+    std::vector<uint8_t>().swap(shard);
+    std::vector<uint32_t>().swap(counts);
+
+    // 3. representatives per cell, within each shard
+    std::vector<uint32_t> remap(n), nextRep(n, NONE);
+    std::vector<shard_map> maps(SHARDS);
+    parallel(SHARDS, [&](size_t s) {
+        shard_map &map = maps[s];
+        map.reserve(shardStart[s + 1] - shardStart[s]);
+        for (size_t o = shardStart[s]; o < shardStart[s + 1]; o++)
+        {
+            const uint32_t i = order[o];
+            const Vertex &v = corner(i);
+            auto found = map.emplace(key_of(v.pos), chain{ i, i });
+            remap[i] = i;
+            if (found.second)
+                continue;
+            uint32_t rep = found.first->second.head;
+            while (rep != NONE && !matches(corner(rep), v))
+                rep = nextRep[rep];
+            if (rep != NONE)
+                remap[i] = rep;
+            else
+            {
+                nextRep[found.first->second.tail] = i;
+                found.first->second.tail = i;
+            }
+        }
+    });
+
+    // 4. lowest matching representative across the neighbour cells, then roots
+    if (eps > 0)
+    {
+        parallel(blocks, [&](size_t b) {
+            size_t begin, end;
+            block_range(b, begin, end);
+            for (size_t i = begin; i < end; i++)
+            {
+                const Vertex &v = corner(i);
+                const cell_key own = key_of(v.pos);
+                const int64_t side[3] = { near_side(v.pos.x(), inv), near_side(v.pos.y(), inv), near_side(v.pos.z(), inv) };
+                uint32_t best = remap[i];
+                for (int k = 1; k < 8; k++)
+                {
+                    const cell_key cell{ own.x + (k & 1 ? side[0] : 0), own.y + (k & 2 ? side[1] : 0), own.z + (k & 4 ? side[2] : 0) };
+                    const shard_map &map = maps[cell_hash()(cell) % SHARDS];
+                    auto found = map.find(cell);
+                    if (found == map.end())
+                        continue;
+                    for (uint32_t rep = found->second.head; rep != NONE && rep < best; rep = nextRep[rep])
+                        if (matches(corner(rep), v))
+                            best = rep;
+                }
+                remap[i] = best;
+            }
+        });
+
+        // every link points to a lower index, so one ascending pass reaches the roots
+        for (size_t i = 0; i < n; i++)
+            remap[i] = remap[remap[i]];
+    }
+    std::vector<shard_map>().swap(maps);
+    std::vector<uint32_t>().swap(nextRep);
+
+    // 5. number the roots in first-use order; order is reused for their new index
+    std::vector<size_t> rootsBefore(blocks + 1, 0);
+    parallel(blocks, [&](size_t b) {
+        size_t begin, end;
+        block_range(b, begin, end);
+        size_t roots = 0;
+        for (size_t i = begin; i < end; i++)
+            roots += remap[i] == i;
+        rootsBefore[b + 1] = roots;
+    });
+    for (size_t b = 0; b < blocks; b++)
+        rootsBefore[b + 1] += rootsBefore[b];
+
+    mesh.vertices.resize(rootsBefore[blocks]);
+    mesh.indices.resize(n);
+    parallel(blocks, [&](size_t b) {
+        size_t begin, end;
+        block_range(b, begin, end);
+        uint32_t next = (uint32_t)rootsBefore[b];
+        for (size_t i = begin; i < end; i++)
+        {
+            if (remap[i] == i)
+            {
+                order[i] = next;
+                mesh.vertices[next++] = corner(i);
+            }
+        }
+    });
+    parallel(blocks, [&](size_t b) {
+        size_t begin, end;
+        block_range(b, begin, end);
+        for (size_t i = begin; i < end; i++)
+            mesh.indices[i] = order[remap[i]];
+    });
+
+    stats.vertices = mesh.vertices.size();
+    if (!options.keep_soup)
+        std::vector<Triangle>().swap(mesh.tris);
+    return stats;
+}
+
+#endif